@@ -8,7 +8,11 @@
 #include <string.h>
 #include <cstring>
 #include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include "btree.h"
+#include "string_node.h"
 #include "filescan.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
@@ -25,6 +29,187 @@
 namespace badgerdb
 {
 
+// -----------------------------------------------------------------------------
+// ArrayLeafLayout / ArrayNonLeafLayout
+// INTEGER and DOUBLE nodes keep sorted key arrays, searched with the vector kernels of
+// node_search.h. STRING nodes are slotted pages, see string_node.h.
+// -----------------------------------------------------------------------------
+template<class L_T, class K> struct ArrayLeafLayout
+{
+	static int capacity()
+	{
+		return sizeof(((L_T*) 0)->ridArray) / sizeof(RecordId);
+	}
+
+	static void init(L_T* leaf)
+	{
+		leaf->count = 0;
+	}
+
+	static int lowerBound(const L_T* leaf, K key)
+	{
+		return badgerdb::lowerBound(leaf->keyArray, leaf->count, key);
+	}
+
+	static int upperBound(const L_T* leaf, K key)
+	{
+		return badgerdb::upperBound(leaf->keyArray, leaf->count, key);
+	}
+
+	static int compareAt(const L_T* leaf, int i, K key)
+	{
+		return KeyTraits<K>::compare(leaf->keyArray[i], key);
+	}
+
+	static void keyBytesAt(const L_T* leaf, int i, char* bytes)
+	{
+		memcpy(bytes, &(leaf->keyArray[i]), sizeof(K));
+	}
+
+	static RecordId ridAt(const L_T* leaf, int i)
+	{
+		return leaf->ridArray[i];
+	}
+
+	static void copyRids(const L_T* leaf, int from, int n, RecordId* out)
+	{
+		memcpy(out, &(leaf->ridArray[from]), n * sizeof(RecordId));
+	}
+
+	static bool fits(const L_T* leaf, K key)
+	{
+		return leaf->count < capacity();
+	}
+
+	static void insertAt(L_T* leaf, int pos, K key, RecordId rid)
+	{
+		memmove(&(leaf->keyArray[pos + 1]), &(leaf->keyArray[pos]), (leaf->count - pos) * sizeof(K));
+		memmove(&(leaf->ridArray[pos + 1]), &(leaf->ridArray[pos]), (leaf->count - pos) * sizeof(RecordId));
+		leaf->keyArray[pos] = key;
+		leaf->ridArray[pos] = rid;
+		leaf->count++;
+	}
+
+	static int splitPoint(const L_T* leaf, int pos, K key, bool& toLeft)
+	{
+		// the entries and the new one are divided evenly between the two leaves
+		int leftCount = (leaf->count + 1) / 2;
+		toLeft = pos < leftCount;
+		return toLeft ? leftCount - 1 : leftCount;
+	}
+
+	static void moveTail(L_T* leaf, int from, L_T* to)
+	{
+		memcpy(to->keyArray, &(leaf->keyArray[from]), (leaf->count - from) * sizeof(K));
+		memcpy(to->ridArray, &(leaf->ridArray[from]), (leaf->count - from) * sizeof(RecordId));
+		to->count = leaf->count - from;
+		leaf->count = from;
+	}
+
+	static void separator(K left, K right, char* bytes)
+	{
+		memcpy(bytes, &right, sizeof(K));
+	}
+
+	static int fill(L_T* leaf, const RIDKeyPair<K>* entries, int n, double fillFactor)
+	{
+		int perLeaf = std::max(1, std::min(capacity(), (int)(capacity() * fillFactor)));
+		int count = std::min(perLeaf, n);
+		for (int i = 0; i < count; i++) {
+			leaf->keyArray[i] = entries[i].key;
+			leaf->ridArray[i] = entries[i].rid;
+		}
+		leaf->count = count;
+		return count;
+	}
+};
+
+template<class NL_T, class K> struct ArrayNonLeafLayout
+{
+	static int capacity()
+	{
+		return sizeof(((NL_T*) 0)->keyArray) / sizeof(K);
+	}
+
+	static int lowerBound(const NL_T* node, K key)
+	{
+		return badgerdb::lowerBound(node->keyArray, (int) node->count, key);
+	}
+
+	static int upperBound(const NL_T* node, K key)
+	{
+		return badgerdb::upperBound(node->keyArray, (int) node->count, key);
+	}
+
+	static int compareAt(const NL_T* node, int i, K key)
+	{
+		return KeyTraits<K>::compare(node->keyArray[i], key);
+	}
+
+	static void keyBytesAt(const NL_T* node, int i, char* bytes)
+	{
+		memcpy(bytes, &(node->keyArray[i]), sizeof(K));
+	}
+
+	static PageId childAt(const NL_T* node, int i)
+	{
+		return node->pageNoArray[i];
+	}
+
+	static bool fits(const NL_T* node, K key)
+	{
+		return node->count < capacity();
+	}
+
+	static bool safe(const NL_T* node)
+	{
+		return node->count < capacity();
+	}
+
+	static void insertAt(NL_T* node, int pos, K key, PageId child)
+	{
+		// the new child goes right of the new key
+		memmove(&(node->keyArray[pos + 1]), &(node->keyArray[pos]), (node->count - pos) * sizeof(K));
+		memmove(&(node->pageNoArray[pos + 2]), &(node->pageNoArray[pos + 1]), (node->count - pos) * sizeof(PageId));
+		node->keyArray[pos] = key;
+		node->pageNoArray[pos + 1] = child;
+		node->count++;
+	}
+
+	static void build(NL_T* node, int level, const K* keys, const PageId* children, int n)
+	{
+		node->level = level;
+		node->count = n;
+		memcpy(node->keyArray, keys, n * sizeof(K));
+		memcpy(node->pageNoArray, children, (n + 1) * sizeof(PageId));
+	}
+
+	static int splitPoint(const K* keys, int n)
+	{
+		return n / 2;
+	}
+
+	static int fill(NL_T* node, int level, const PageKeyPair<K>* children, int n, double fillFactor)
+	{
+		// a node with k keys holds k+1 children
+		int perNode = std::max(2, std::min(capacity(), (int)(capacity() * fillFactor)) + 1);
+		int count = std::min(perNode, n);
+		node->level = level;
+		node->count = count - 1;
+		node->pageNoArray[0] = children[0].pageNo;
+		for (int i = 1; i < count; i++) {
+			node->keyArray[i - 1] = children[i].key;
+			node->pageNoArray[i] = children[i].pageNo;
+		}
+		return count;
+	}
+};
+
+template<> struct LeafLayout<LeafNodeInt> : ArrayLeafLayout<LeafNodeInt, int> {};
+template<> struct LeafLayout<LeafNodeDouble> : ArrayLeafLayout<LeafNodeDouble, double> {};
+template<> struct NonLeafLayout<NonLeafNodeInt> : ArrayNonLeafLayout<NonLeafNodeInt, int> {};
+template<> struct NonLeafLayout<NonLeafNodeDouble> : ArrayNonLeafLayout<NonLeafNodeDouble, double> {};
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -34,34 +219,64 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		std::string & outIndexName,
 		BufMgr *bufMgrIn,
 		const int attrByteOffset,
-		const Datatype attrType)
+		const Datatype attrType,
+		const double fillFactor)
 {
 	this->bufMgr = bufMgrIn;
-	this->scanExecuting = false; // we are not scanning yet
+	this->relationBufMgr = bufMgrIn;
 
-	// Save attributes
-	if (attrType == INTEGER) {
-		this->leafOccupancy = INTARRAYLEAFSIZE;
-		this->nodeOccupancy = INTARRAYNONLEAFSIZE;
-	}
-	else if (attrType == DOUBLE) {
-		this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
-		this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
-	}
-	else if (attrType == STRING) {
-		this->leafOccupancy = STRINGARRAYLEAFSIZE;
-		this->nodeOccupancy = STRINGARRAYNONLEAFSIZE; 
+	outIndexName = indexFileName(relationName, attrByteOffset);
+	this->open(relationName, outIndexName, attrByteOffset, attrType, fillFactor);
+}
+
+BTreeIndex::BTreeIndex(const std::string & relationName,
+		std::string & outIndexName,
+		BufferPools *pools,
+		const int attrByteOffset,
+		const Datatype attrType,
+		const double fillFactor)
+{
+	outIndexName = indexFileName(relationName, attrByteOffset);
+	this->bufMgr = pools->poolFor(outIndexName);
+	this->relationBufMgr = pools->poolFor(relationName);
+	if (this->bufMgr == NULL) {
+		throw BadIndexInfoException("No buffer pool to open the index in");
 	}
 
-	// Construct index file name
+	this->open(relationName, outIndexName, attrByteOffset, attrType, fillFactor);
+}
+
+std::string BTreeIndex::indexFileName(const std::string & relationName, const int attrByteOffset)
+{
 	std::ostringstream idxStr;
 	idxStr << relationName << '.' << attrByteOffset;
-	std::string indexName = idxStr.str();
+	return idxStr.str();
+}
+
+void BTreeIndex::open(const std::string & relationName,
+		const std::string & indexName,
+		const int attrByteOffset,
+		const Datatype attrType,
+		const double fillFactor)
+{
+	this->currentScan = NULL; // we are not scanning yet
+
+	// fill factor outside (0, 1] falls back to the default
+	this->fillFactor = (fillFactor > 0 && fillFactor <= 1) ? fillFactor : DEFAULTFILLFACTOR;
+	this->readAheadLeaves = DEFAULTREADAHEAD;
 
 	if (File::exists(indexName)) {
 		// Open existing index file
 		this->file = new BlobFile(indexName, false);
-		this->openIndexFile(relationName, attrByteOffset, attrType);
+		try {
+			this->openIndexFile(relationName, attrByteOffset, attrType);
+		}
+		catch (BadIndexInfoException e) {
+			// the destructor does not run for an index that failed to open
+			this->bufMgr->flushFile(this->file);
+			delete this->file;
+			throw;
+		}
 	}
 	else {
 		// Create new index file
@@ -69,8 +284,6 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		this->createIndexFile(relationName, attrByteOffset, attrType);
 
 	}
-	// Output index file name
-	outIndexName = indexName;
 }
 
 
@@ -80,8 +293,12 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 
 BTreeIndex::~BTreeIndex()
 {
+	// a scan left open keeps its leaf pinned
+	if (this->currentScan != NULL) {
+		delete this->currentScan;
+		this->currentScan = NULL;
+	}
 	this->bufMgr->flushFile(this->file);
-	this->scanExecuting = false;
 	delete this->file;
 }
 
@@ -91,94 +308,112 @@ BTreeIndex::~BTreeIndex()
 
 const void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
 {
-	
-	Page* rootPage;
-
-	bool isLeaf = false; // if lower level is leaf
 	if (this->attributeType == INTEGER) {
-		RIDKeyPair<int> leafEntry;
-		leafEntry.set(rid, *((int*)(key)));
-		// Special case: root is the leaf
-		if (rootIsLeaf){
-			insertRootLeaf<int, struct LeafNodeInt,struct NonLeafNodeInt,PageKeyPair<int>,RIDKeyPair<int>>(leafEntry);
-		}
-		// Filter paramters base on conditions; traverse and insert the entry later down the recursion
-		else {
-			PageKeyPair<int>	newPagePair;
-			newPagePair.set(0,leafEntry.key);
-
-			traverse<int, struct LeafNodeInt,struct NonLeafNodeInt,PageKeyPair<int>,RIDKeyPair<int>>(this->rootPageNum, newPagePair, leafEntry);
-			PageId oldPageNum = this->rootPageNum;
-			this->bufMgr->readPage(this->file, oldPageNum, rootPage);
-			NonLeafNodeInt* rootNode = (NonLeafNodeInt*)rootPage;
-			
-			// if new child node is created (split happened in immediate child level)
-			if (newPagePair.pageNo != 0) {
-				createNewRoot<int, struct LeafNodeInt,struct NonLeafNodeInt,PageKeyPair<int>,RIDKeyPair<int>>(oldPageNum, newPagePair, false);
-			}
-			this->bufMgr->unPinPage(this->file, oldPageNum, true);
-		}
+		insertEntryAs<int>(key, rid);
 	}
-	// same case for other attribute types
 	else if (this->attributeType == DOUBLE) {
-		RIDKeyPair<double> leafEntry;
-		leafEntry.set(rid, *((double*)(key)));
-		if (rootIsLeaf) {
-			insertRootLeaf<double, struct LeafNodeDouble,struct NonLeafNodeDouble,PageKeyPair<double>,RIDKeyPair<double>>(leafEntry);
-		}
-		else {
-			PageKeyPair<double>	newPagePair;
-			newPagePair.set(0,leafEntry.key);
-			traverse<double, struct LeafNodeDouble,struct NonLeafNodeDouble,PageKeyPair<double>,RIDKeyPair<double>>(this->rootPageNum, newPagePair, leafEntry);
-
-			PageId oldPageNum = this->rootPageNum;
-			this->bufMgr->readPage(this->file, oldPageNum, rootPage);
-			NonLeafNodeDouble* rootNode = (NonLeafNodeDouble*)rootPage;
-			if (newPagePair.pageNo!= 0) {
-				if (rootNode->pageNoArray[nodeOccupancy] == 0) {
-					putEntryNonLeaf<double, struct NonLeafNodeDouble,PageKeyPair<double>> (rootNode,newPagePair);
-				}
-				else{
-					PageKeyPair<double> rightFirstEntry;
-					splitNonLeaf<double, struct NonLeafNodeDouble,PageKeyPair<double>>(rootNode,newPagePair,rightFirstEntry);
-					createNewRoot<double, struct LeafNodeDouble,struct NonLeafNodeDouble,PageKeyPair<double>,RIDKeyPair<double>>(this->rootPageNum, rightFirstEntry, false);
-				}
-			}
-			this->bufMgr->unPinPage(this->file, oldPageNum, true);
-		}
+		insertEntryAs<double>(key, rid);
 	}
 	else if (this->attributeType == STRING) {
-		RIDKeyPair<char*> leafEntry;
-		char* trimmedString = (char*)malloc(STRINGSIZE);
-		snprintf(trimmedString, STRINGSIZE,"%s",(char*)key);
-		leafEntry.set(rid, trimmedString);
-		if(rootIsLeaf){
-			insertRootLeaf<char*, struct LeafNodeString,struct NonLeafNodeString,PageKeyPair<char*>,RIDKeyPair<char*>>(leafEntry);
-		}
-		else{
-			PageKeyPair<char*>	newPagePair;
-			newPagePair.set(0,leafEntry.key);
-			PageId oldPageNum = this->rootPageNum;
-			traverse<char*, struct LeafNodeString,struct NonLeafNodeString,PageKeyPair<char*>,RIDKeyPair<char*>>(oldPageNum, newPagePair, leafEntry);
-			
-			this->bufMgr->readPage(this->file, oldPageNum, rootPage);
-			NonLeafNodeString* rootNode = (NonLeafNodeString*)rootPage;
-
-			if (newPagePair.pageNo!= 0) {
-				if (rootNode->pageNoArray[nodeOccupancy] == 0) {
-					putEntryNonLeaf<char*, struct NonLeafNodeString,PageKeyPair<char*>> (rootNode,newPagePair);
-				}
-				else{
-					PageKeyPair<char*> rightFirstEntry;
-					splitNonLeaf<char*, struct NonLeafNodeString,PageKeyPair<char*>>(rootNode,newPagePair,rightFirstEntry);
-					createNewRoot<char*, struct LeafNodeString,struct NonLeafNodeString,PageKeyPair<char*>,RIDKeyPair<char*>>(oldPageNum, rightFirstEntry, false);
-				}
-			}
-			this->bufMgr->unPinPage(this->file, oldPageNum, true);
-		}
+		insertEntryAs<char*>(key, rid);
 	}
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntryAs
+// -----------------------------------------------------------------------------
+template<class T> void BTreeIndex::insertEntryAs(const void* key, const RecordId rid)
+{
+	// string keys are cut short in this buffer
+	char keyBytes[STRINGSIZE];
+	RIDKeyPair<T> leafEntry;
+	leafEntry.set(rid, KeyTraits<T>::fromParam(key, keyBytes));
+	insert<T>(leafEntry);
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::bound
+// -----------------------------------------------------------------------------
+template<class T> T ScanCursor::bound(bool high)
+{
+	return KeyTraits<T>::fromBytes(high ? this->highVal : this->lowVal);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::openScan
+// -----------------------------------------------------------------------------
+
+ScanCursor* BTreeIndex::openScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm,
+				   const ScanOrder order)
+{
+	// an open end of the range has no operator to check
+	if(lowValParm != NULL && lowOpParm != GT && lowOpParm != GTE){
+		throw BadOpcodesException ();
+	}
+	if(highValParm != NULL && highOpParm != LT && highOpParm != LTE){
+		throw BadOpcodesException ();
+	}
+
+	if (attributeType == INTEGER) {
+		return openScanAs<int>(lowValParm, lowOpParm, highValParm, highOpParm, order);
+	}
+	else if (attributeType == DOUBLE) {
+		return openScanAs<double>(lowValParm, lowOpParm, highValParm, highOpParm, order);
+	}
+	return openScanAs<char*>(lowValParm, lowOpParm, highValParm, highOpParm, order);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::openScanAs
+// -----------------------------------------------------------------------------
+template<class T> ScanCursor* BTreeIndex::openScanAs(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm,
+				   const ScanOrder order)
+{
+	char lowBytes[STRINGSIZE];
+	char highBytes[STRINGSIZE];
+	T lowVal = T();
+	T highVal = T();
+	if (lowValParm != NULL) {
+		lowVal = KeyTraits<T>::fromParam(lowValParm, lowBytes);
+	}
+	if (highValParm != NULL) {
+		highVal = KeyTraits<T>::fromParam(highValParm, highBytes);
+	}
+	if (lowValParm != NULL && highValParm != NULL && KeyTraits<T>::compare(lowVal, highVal) > 0) {
+		throw BadScanrangeException();
+	}
+
+	// held until returned, so a throw lets go of the cursor and the leaf it pins
+	std::unique_ptr<ScanCursor> cursor(new ScanCursor(this));
+	cursor->order = order;
+	cursor->readAheadWindow = this->readAheadLeaves;
+	cursor->lowOp = lowOpParm;
+	cursor->highOp = highOpParm;
+	cursor->hasLowVal = (lowValParm != NULL);
+	cursor->hasHighVal = (highValParm != NULL);
+	if (cursor->hasLowVal) {
+		KeyTraits<T>::toBytes(cursor->lowVal, lowVal);
+	}
+	if (cursor->hasHighVal) {
+		KeyTraits<T>::toBytes(cursor->highVal, highVal);
+	}
+
+	cursor->seekStart<T>();
+	bool found = cursor->inRange<T>();
+	cursor->suspend();
+
+	if (!found) {
+		throw NoSuchKeyFoundException();
+	}
+	return cursor.release();
+}
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::startScan
 // -----------------------------------------------------------------------------
@@ -186,351 +421,632 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 const void BTreeIndex::startScan(const void* lowValParm,
 				   const Operator lowOpParm,
 				   const void* highValParm,
-				   const Operator highOpParm)
+				   const Operator highOpParm,
+				   const ScanOrder order)
 {
-		if(lowOpParm != GT && lowOpParm != GTE){
-			throw BadOpcodesException ();
-		}
-		if(highOpParm != LT && highOpParm != LTE){
-			throw BadOpcodesException ();
-		}
+	// if another scan is executing, end it here
+	if (currentScan != NULL) {
+		endScan();
+	}
+	currentScan = openScan(lowValParm, lowOpParm, highValParm, highOpParm, order);
+}
 
-		// if another scan is executing, end it here
-		if (scanExecuting) {
-			endScan();
+// -----------------------------------------------------------------------------
+// BTreeIndex::seek
+// -----------------------------------------------------------------------------
+template<class T> void BTreeIndex::seek(ScanCursor* cursor, const T* key, Operator op)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+
+	// the header latch guards rootPageNum and height, crab from it into the root
+	PageHandle headerPage = readLatched(this->headerPageNum, LATCH_SHARED);
+	int level = this->height;
+	PageHandle page = readLatched(this->rootPageNum, LATCH_SHARED);
+	headerPage.release();
+
+	// GTE and LT look left of every key equal to key, GT and LTE right of them.
+	// Without a key take the first or the last child all the way down.
+	bool forward = (op == GT || op == GTE);
+	bool leftOfEqual = (op == GTE || op == LT);
+	while (level > 1) {
+		NL_T* node = (NL_T*) page.get();
+		int pos;
+		if (key == NULL) {
+			pos = forward ? 0 : (int) node->count;
 		}
-
-		if (attributeType == INTEGER) {
-			if (*(int*)lowValParm > *(int*)highValParm){
-				throw BadScanrangeException();
-			}
-			lowValInt = *(int*)lowValParm;
-			highValInt = *(int*)highValParm;
+		else if (leftOfEqual) {
+			pos = NonLeafLayout<NL_T>::lowerBound(node, *key);
 		}
-		if (attributeType == DOUBLE) {
-			if (*(double*)lowValParm > *(double*)highValParm){
-				throw BadScanrangeException();
-			}
-			lowValDouble = *(double*)lowValParm;
-			highValDouble = *(double*)highValParm;
+		else {
+			pos = NonLeafLayout<NL_T>::upperBound(node, *key);
 		}
-		if (attributeType==STRING) {
-			if (strncmp((char*)lowValParm,(char*)highValParm,STRINGSIZE)>0){
-				throw BadScanrangeException();
-			}
-			this->lowValString = std::string((char*)lowValParm,STRINGSIZE);
-			this->highValString = std::string((char*)highValParm,STRINGSIZE);
+		if (level == 2 && cursor->readAheadWindow > 0) {
+			cursor->learnUpcoming<T>(node, pos);
 		}
+		// moving the child in lets go of the parent once the child is latched
+		page = readLatched(NonLeafLayout<NL_T>::childAt(node, pos), LATCH_SHARED);
+		level--;
+	}
+
+	// the leaf stays pinned and latched
+	L_T* leaf = (L_T*) page.get();
+	cursor->currentPage = std::move(page);
+	int pos;
+	if (key == NULL) {
+		pos = forward ? 0 : leaf->count;
+	}
+	else if (leftOfEqual) {
+		pos = LeafLayout<L_T>::lowerBound(leaf, *key);
+	}
+	else {
+		pos = LeafLayout<L_T>::upperBound(leaf, *key);
+	}
+	// LT and LTE want the entry left of the position
+	cursor->nextEntry = forward ? pos : pos - 1;
 
-		scanExecuting = true;
-		lowOp = lowOpParm;
-		highOp = highOpParm;
+	// the entry may lie in a sibling of the leaf
+	cursor->skipExhaustedLeaves<T>();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::findUpcomingLeaves
+// -----------------------------------------------------------------------------
+template<class T> void BTreeIndex::findUpcomingLeaves(ScanCursor* cursor, T key, Operator op)
+{
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
 
-		if(attributeType == INTEGER){
-			scan<int, struct LeafNodeInt,struct NonLeafNodeInt,class PageKeyPair<int>,class RIDKeyPair<int>>(lowValInt);
+	PageHandle headerPage = readLatched(this->headerPageNum, LATCH_SHARED);
+	int level = this->height;
+	if (level == 1) {
+		return;
+	}
+	PageHandle page = readLatched(this->rootPageNum, LATCH_SHARED);
+	headerPage.release();
+
+	while (true) {
+		NL_T* node = (NL_T*) page.get();
+		int pos;
+		if (op == GTE) {
+			pos = NonLeafLayout<NL_T>::lowerBound(node, key);
 		}
-		if(attributeType == DOUBLE){
-			scan<double, struct LeafNodeDouble,struct NonLeafNodeDouble,class PageKeyPair<double>,class RIDKeyPair<double>>(lowValDouble);
+		else {
+			pos = NonLeafLayout<NL_T>::upperBound(node, key);
 		}
-		if(attributeType == STRING){
-			char* key = (char*)malloc(STRINGSIZE);
-			snprintf(key, STRINGSIZE, "%s",lowValString.c_str());
-			scan<char*, struct LeafNodeString,struct NonLeafNodeString,class PageKeyPair<char*>,class RIDKeyPair<char*>>(key);
+		if (level == 2) {
+			cursor->learnUpcoming<T>(node, pos);
+			return;
 		}
+		page = readLatched(NonLeafLayout<NL_T>::childAt(node, pos), LATCH_SHARED);
+		level--;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setReadAhead
+// -----------------------------------------------------------------------------
 
+void BTreeIndex::setReadAhead(int leaves)
+{
+	this->readAheadLeaves = std::max(0, leaves);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::scan
+// BTreeIndex::scanNext
 // -----------------------------------------------------------------------------
-template<class T,class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::scan(T lowVal) 
+
+const void BTreeIndex::scanNext(RecordId& outRid) 
 {
-	Page* tmpPage;
-	PageId tmpPageNo;
-	NL_T* tmpNonLeafNode;
-	
-	// if root is leaf, that means the curent page for scanning is the only page in the tree
-	if (rootIsLeaf){
-		this->currentPageNum = this->rootPageNum;		
-		this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);	
-		nextEntry = findPos<T, L_T,NL_T,P_T,RID_T>(true, false, this->rootPageNum, lowVal);
-
-		if (nextEntry == -1) {
-			throw IndexScanCompletedException();
-		}
-		return;
+	if (currentScan == NULL){
+		throw ScanNotInitializedException();
 	}
+	currentScan->scanNext(outRid);
+}
 
-	// else we need to traverse down to the right leaf node
-	tmpPageNo = this->rootPageNum;
-	this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-	this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-	tmpNonLeafNode = (NL_T*) tmpPage;
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatch
+// -----------------------------------------------------------------------------
 
-	// if current node is not the level above leaf node, keep traversing
-	while (tmpNonLeafNode->level != 1) {
-		int nextPos = findPos<T, L_T,NL_T,P_T,RID_T>(false, true, tmpPageNo, lowVal);
-		tmpPageNo = tmpNonLeafNode->pageNoArray[nextPos];
-		this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-		tmpNonLeafNode = (NL_T*)tmpPage;
-		this->bufMgr->unPinPage(this->file,tmpPageNo,false);
+size_t BTreeIndex::scanNextBatch(RecordId* outRids, size_t maxRids)
+{
+	if (currentScan == NULL){
+		throw ScanNotInitializedException();
 	}
-	
-	// traversed to the right nonleafnode. Get the correct current page and then 
-	// unpin this nonleafnode page.
-	
-	int leafPagePos = findPos<T,L_T,NL_T,P_T,RID_T>(false, true,tmpPageNo, lowVal);
+	return currentScan->scanNextBatch(outRids, maxRids);
+}
 
-	if (leafPagePos == -1) {
-		// exit scan if error happens
-		throw IndexScanCompletedException();
+// -----------------------------------------------------------------------------
+// BTreeIndex::endScan
+// -----------------------------------------------------------------------------
+//
+const void BTreeIndex::endScan() 
+{
+	// if no scan is live, throw exception
+	if (currentScan == NULL) {
+		throw ScanNotInitializedException();
 	}
-	this->currentPageNum = tmpNonLeafNode->pageNoArray[leafPagePos];
+	// deleting the cursor unpins its leaf
+	delete currentScan;
+	currentScan = NULL;
+}
 
-	nextEntry = findPos<T, L_T,NL_T,P_T,RID_T>(true, false,this->currentPageNum, lowVal);
+// -----------------------------------------------------------------------------
+// ScanCursor::ScanCursor -- Constructor
+// -----------------------------------------------------------------------------
 
-	if (nextEntry == -1) {
-		// exit scan if error happens
-		throw IndexScanCompletedException();
-	}
+ScanCursor::ScanCursor(BTreeIndex *index)
+{
+	this->index = index;
+	this->order = ASCENDING;
+	this->nextEntry = 0;
+	this->pageVersion = 0;
+	this->hasLastKey = false;
+	this->lastKeyDups = 0;
+	this->hasLowVal = false;
+	this->hasHighVal = false;
+	memset(this->lowVal, 0, sizeof(this->lowVal));
+	memset(this->highVal, 0, sizeof(this->highVal));
+	this->readAheadWindow = 0;
+	this->upcomingPos = 0;
+	this->prefetchedUpTo = 0;
+	this->upcomingComplete = false;
+	this->needsUpcoming = false;
+}
 
-	this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-	this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+// -----------------------------------------------------------------------------
+// ScanCursor::~ScanCursor -- destructor
+// -----------------------------------------------------------------------------
 
+ScanCursor::~ScanCursor()
+{
+	// between calls the leaf is pinned but not latched, currentPage unpins it
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// ScanCursor::release
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::scanNext(RecordId& outRid) 
+void ScanCursor::release()
 {
-	if (!scanExecuting){
-		throw ScanNotInitializedException();
+	this->currentPage.release();
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::suspend
+// -----------------------------------------------------------------------------
+
+void ScanCursor::suspend()
+{
+	if (this->currentPage) {
+		this->pageVersion = this->currentPage.version();
+		this->currentPage.unlatch(LATCH_SHARED);
 	}
-	if (this->currentPageNum == 0){
-		throw IndexScanCompletedException();
-	} 
-	if (attributeType == INTEGER){
-		LeafNodeInt* currLeaf = (LeafNodeInt*) (this->currentPageData);
-		if(highOp == LT && compareKey((void*)&(currLeaf->keyArray[nextEntry]),(void*)(&highValInt)) >=0)  {
-			throw IndexScanCompletedException();
-		}
-		else if(highOp == LTE && compareKey((void*)&(currLeaf->keyArray[nextEntry]),(void*)(&highValInt)) >0)  {
-			throw IndexScanCompletedException();
-		}		
-		outRid = currLeaf->ridArray[nextEntry];	
-		nextEntry++;
-			
-		if( nextEntry == leafOccupancy ||  currLeaf->ridArray[nextEntry].page_number == 0 ){
-			
-			this->currentPageNum =  currLeaf->rightSibPageNo;
-			if(currLeaf->rightSibPageNo == 0) return;
-			this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-			this->bufMgr->unPinPage(this->file,this->currentPageNum,false);
-			nextEntry = 0;
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::learnUpcoming
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::learnUpcoming(typename KeyTraits<T>::NonLeaf* parent, int childPos)
+{
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+
+	this->upcomingLeaves.clear();
+	this->upcomingPos = 0;
+	this->prefetchedUpTo = 0;
+	this->upcomingComplete = false;
+	this->needsUpcoming = false;
+
+	int count = parent->count;
+	if (this->order == ASCENDING) {
+		// child i holds no key less than key i-1
+		for (int i = childPos + 1; i <= count; i++) {
+			if (this->hasHighVal) {
+				int cmp = NonLeafLayout<NL_T>::compareAt(parent, i - 1, bound<T>(true));
+				if ((highOp == LT) ? (cmp >= 0) : (cmp > 0)) {
+					this->upcomingComplete = true;
+					break;
+				}
+			}
+			this->upcomingLeaves.push_back(NonLeafLayout<NL_T>::childAt(parent, i));
 		}
 	}
-	else if(attributeType == DOUBLE){
-		LeafNodeDouble* currLeaf = (LeafNodeDouble*) (this->currentPageData);	
-		if(highOp == LT && compareKey((void*)&(currLeaf->keyArray[nextEntry]),(void*)(&highValDouble)) >=0)  {
-			throw IndexScanCompletedException();
-		}
-		else if(highOp == LTE && compareKey((void*)&(currLeaf->keyArray[nextEntry]),(void*)(&highValDouble)) >0)  {
-			throw IndexScanCompletedException();
-		}	
-		outRid = currLeaf->ridArray[nextEntry];	
-		nextEntry++;
-		if( nextEntry == leafOccupancy || currLeaf->ridArray[nextEntry].page_number == 0 ){
-			this->currentPageNum =  currLeaf->rightSibPageNo;
-			if(currLeaf->rightSibPageNo == 0) return;
-			this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-			this->bufMgr->unPinPage(this->file,this->currentPageNum,false);
-			nextEntry = 0;
+	else {
+		// child i holds no key greater than key i
+		for (int i = childPos - 1; i >= 0; i--) {
+			if (this->hasLowVal) {
+				int cmp = NonLeafLayout<NL_T>::compareAt(parent, i, bound<T>(false));
+				if ((lowOp == GT) ? (cmp <= 0) : (cmp < 0)) {
+					this->upcomingComplete = true;
+					break;
+				}
+			}
+			this->upcomingLeaves.push_back(NonLeafLayout<NL_T>::childAt(parent, i));
 		}
 	}
-	else if(attributeType == STRING){
-		LeafNodeString* currLeaf = (LeafNodeString*) (this->currentPageData);
-		char* key = (char*) (malloc)(STRINGSIZE);
-		snprintf(key,STRINGSIZE, "%s",highValString.c_str());
+	prefetchUpcoming();
+}
 
-		if(highOp == LT && compareKey((void*)&(currLeaf->keyArray[nextEntry]),key) >=0)  {
-			throw IndexScanCompletedException();
+// -----------------------------------------------------------------------------
+// ScanCursor::enterLeaf
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::enterLeaf(PageId pageNo, typename KeyTraits<T>::Leaf* leaf)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	if (this->readAheadWindow == 0) {
+		return;
+	}
+
+	// a leaf split off since the list was learnt is not on it, the rest still lies ahead
+	size_t end = std::min(this->upcomingLeaves.size(), this->upcomingPos + this->readAheadWindow);
+	for (size_t i = this->upcomingPos; i < end; i++) {
+		if (this->upcomingLeaves[i] == pageNo) {
+			this->upcomingPos = i + 1;
+			prefetchUpcoming();
+			return;
 		}
-		else if(highOp == LTE && compareKey((void*)&(currLeaf->keyArray[nextEntry]),key) >0)  {
-			throw IndexScanCompletedException();
-		}	
-		outRid = currLeaf->ridArray[nextEntry];	
-		nextEntry++;
-		if(nextEntry == leafOccupancy || currLeaf->ridArray[nextEntry].page_number == 0 ) {
-			this->currentPageNum =  currLeaf->rightSibPageNo;
-			if(currLeaf->rightSibPageNo == 0) return;
-			this->bufMgr->readPage(this->file,this->currentPageNum,this->currentPageData);
-			this->bufMgr->unPinPage(this->file,this->currentPageNum,false);
-			nextEntry = 0;
-		}	
 	}
-	
+
+	// past the last child of the parent the list came from
+	if (this->upcomingPos >= this->upcomingLeaves.size() && !this->upcomingComplete && leaf->count > 0) {
+		this->needsUpcoming = true;
+		LeafLayout<L_T>::keyBytesAt(leaf, (this->order == ASCENDING) ? 0 : leaf->count - 1, this->upcomingKey);
+	}
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::endScan
+// ScanCursor::prefetchUpcoming
 // -----------------------------------------------------------------------------
-//
-const void BTreeIndex::endScan() 
+
+void ScanCursor::prefetchUpcoming()
 {
-	// if no scan is live, throw exception
-	if (!scanExecuting) {
-		throw ScanNotInitializedException();
-	}
-	// unpin any pinned pages
-	try{
-		if(this->currentPageNum !=0) this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+	size_t end = std::min(this->upcomingLeaves.size(), this->upcomingPos + this->readAheadWindow);
+	size_t from = std::max(this->prefetchedUpTo, this->upcomingPos);
+	if (from < end) {
+		index->bufMgr->prefetchPages(index->file, &(this->upcomingLeaves[from]), end - from);
+		this->prefetchedUpTo = end;
 	}
-	catch(PageNotPinnedException e){
+}
 
+// -----------------------------------------------------------------------------
+// ScanCursor::refillUpcoming
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::refillUpcoming()
+{
+	if (!this->needsUpcoming) {
+		return;
+	}
+	this->needsUpcoming = false;
+	if (this->currentPage) {
+		index->findUpcomingLeaves<T>(this, KeyTraits<T>::fromBytes(this->upcomingKey), (this->order == ASCENDING) ? GTE : LTE);
 	}
-	
-	scanExecuting = false;
 }
 
-///////////////////////
-// Custom Functions //
-/////////////////////
-
 // -----------------------------------------------------------------------------
-// BTreeIndex::compareKey
+// ScanCursor::seekStart
 // -----------------------------------------------------------------------------
-template<class T> int BTreeIndex::compare(T k1, T k2) {
-	if (k1 > k2) {
-		return 1;
+template<class T> void ScanCursor::seekStart()
+{
+	if (this->order == ASCENDING) {
+		T lowVal = bound<T>(false);
+		index->seek<T>(this, this->hasLowVal ? &lowVal : NULL, this->hasLowVal ? this->lowOp : GTE);
 	}
-	else if (k1 < k2) {
-		return -1;
+	else {
+		T highVal = bound<T>(true);
+		index->seek<T>(this, this->hasHighVal ? &highVal : NULL, this->hasHighVal ? this->highOp : LTE);
 	}
-	return 0;
 }
 
-template<> int BTreeIndex::compare<char*>(char* k1, char* k2) {
-	return strcmp((char*)k1, (char*)k2);
+// -----------------------------------------------------------------------------
+// ScanCursor::resume
+// -----------------------------------------------------------------------------
+template<class T> bool ScanCursor::resume()
+{
+	if (!this->currentPage) {
+		return false;
+	}
+
+	this->currentPage.latch(LATCH_SHARED);
+	if (this->currentPage.version() == this->pageVersion) {
+		return true;
+	}
+
+	// the leaf changed since the last call and entries may have moved
+	release();
+	reposition<T>();
+	return (bool) this->currentPage;
 }
 
+// -----------------------------------------------------------------------------
+// ScanCursor::reposition
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::reposition()
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	if (!this->hasLastKey) {
+		seekStart<T>();
+		return;
+	}
+
+	T lastKey = KeyTraits<T>::fromBytes(this->lastKey);
+	if (this->order == ASCENDING) {
+		index->seek<T>(this, &lastKey, GTE);
 
-int BTreeIndex::compareKey(void* k1, void* k2) {
-	if(attributeType == INTEGER){
-		if(*(int*)k1 > *(int*)k2){
-			return 1;
+		// equal keys are inserted after each other, so the ones returned come first
+		int skip = this->lastKeyDups;
+		while (skip > 0 && this->currentPage) {
+			L_T* leaf = (L_T*) this->currentPage.get();
+			if (LeafLayout<L_T>::compareAt(leaf, this->nextEntry, lastKey) != 0) {
+				break;
+			}
+			this->nextEntry++;
+			skip--;
+			skipExhaustedLeaves<T>();
 		}
-		else if(*(int*)k1 < *(int*)k2){
-			return -1;
+		return;
+	}
+
+	// Equal keys inserted since went after the ones returned, where a descending scan has
+	// been already. Walk back from the last equal key to the last entry returned instead.
+	index->seek<T>(this, &lastKey, LTE);
+	while (this->currentPage) {
+		L_T* leaf = (L_T*) this->currentPage.get();
+		if (LeafLayout<L_T>::compareAt(leaf, this->nextEntry, lastKey) != 0) {
+			return;
 		}
-		else{
-			return 0;
+		bool returned = (LeafLayout<L_T>::ridAt(leaf, this->nextEntry) == this->lastRid);
+		this->nextEntry--;
+		skipExhaustedLeaves<T>();
+		if (returned) {
+			return;
 		}
 	}
-	else if(attributeType == DOUBLE){
-		if(*(double*)k1 > *(double*)k2){
-				return 1;
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::skipExhaustedLeaves
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::skipExhaustedLeaves()
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	while (this->currentPage) {
+		L_T* leaf = (L_T*) this->currentPage.get();
+		if (this->order == ASCENDING) {
+			if (this->nextEntry < leaf->count) {
+				return;
+			}
+			PageId sibPageNo = leaf->rightSibPageNo;
+			if (sibPageNo == 0) {
+				release();
+				return;
+			}
+			// latch the sibling before letting go of this leaf
+			this->currentPage = index->readLatched(sibPageNo, LATCH_SHARED);
+			this->nextEntry = 0;
+			enterLeaf<T>(sibPageNo, (L_T*) this->currentPage.get());
 		}
-		else if(*(double*)k1 < *(double*)k2){
-			return -1;
+		else {
+			if (this->nextEntry >= 0) {
+				return;
+			}
+			PageId sibPageNo = leaf->leftSibPageNo;
+			if (sibPageNo == 0) {
+				release();
+				return;
+			}
+			// A split latches the leaf right of the new one while holding the leaf it splits,
+			// so waiting for the sibling while holding this leaf could deadlock.
+			PageId pageNo = this->currentPage.pageNumber();
+			release();
+			PageHandle sibPage = index->readLatched(sibPageNo, LATCH_SHARED);
+			L_T* sib = (L_T*) sibPage.get();
+			if (sib->rightSibPageNo != pageNo) {
+				// the sibling was split in between, its right part lies between the two
+				sibPage.release();
+				reposition<T>();
+				return;
+			}
+			this->currentPage = std::move(sibPage);
+			this->nextEntry = sib->count - 1;
+			enterLeaf<T>(sibPageNo, sib);
 		}
-		else{
-			return 0;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::rememberLast
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::rememberLast(typename KeyTraits<T>::Leaf* leaf, int first, int last)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	char keyBytes[STRINGSIZE];
+	LeafLayout<L_T>::keyBytesAt(leaf, last, keyBytes);
+	T key = KeyTraits<T>::fromBytes(keyBytes);
+	int back = (this->order == ASCENDING) ? -1 : 1;
+	int equal = 1;
+	int i = last;
+	while (i != first && LeafLayout<L_T>::compareAt(leaf, i + back, key) == 0) {
+		equal++;
+		i += back;
+	}
+
+	// the run of equal keys may have started before these entries
+	if (i == first && this->hasLastKey && KeyTraits<T>::compare(KeyTraits<T>::fromBytes(this->lastKey), key) == 0) {
+		this->lastKeyDups += equal;
+	}
+	else {
+		this->lastKeyDups = equal;
+	}
+	KeyTraits<T>::toBytes(this->lastKey, key);
+	this->lastRid = LeafLayout<L_T>::ridAt(leaf, last);
+	this->hasLastKey = true;
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::inRange
+// -----------------------------------------------------------------------------
+template<class T> bool ScanCursor::inRange()
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	if (!this->currentPage) {
+		return false;
+	}
+	L_T* leaf = (L_T*) this->currentPage.get();
+	if (this->order == ASCENDING) {
+		if (!this->hasHighVal) {
+			return true;
 		}
+		int cmp = LeafLayout<L_T>::compareAt(leaf, this->nextEntry, bound<T>(true));
+		return (highOp == LT) ? (cmp < 0) : (cmp <= 0);
 	}
-	else if(attributeType == STRING){
-		return strcmp((char*)k1, (char*)k2);
+	if (!this->hasLowVal) {
+		return true;
 	}
-	return -2;
+	int cmp = LeafLayout<L_T>::compareAt(leaf, this->nextEntry, bound<T>(false));
+	return (lowOp == GT) ? (cmp > 0) : (cmp >= 0);
 }
 
+// -----------------------------------------------------------------------------
+// ScanCursor::next
+// -----------------------------------------------------------------------------
+template<class T> void ScanCursor::next(RecordId& outRid)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	if (!resume<T>()) {
+		throw IndexScanCompletedException();
+	}
+	if (!inRange<T>()) {
+		release();
+		throw IndexScanCompletedException();
+	}
+	L_T* leaf = (L_T*) this->currentPage.get();
+	outRid = LeafLayout<L_T>::ridAt(leaf, this->nextEntry);
+	rememberLast<T>(leaf, this->nextEntry, this->nextEntry);
+	this->nextEntry += (this->order == ASCENDING) ? 1 : -1;
+	skipExhaustedLeaves<T>();
+	suspend();
+	refillUpcoming<T>();
+}
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::findPos
+// ScanCursor::nextBatch
 // -----------------------------------------------------------------------------
-//
-template<class T, class L_T,class NL_T,class P_T,class RID_T> int BTreeIndex::findPos(
-bool leaf, bool nonleaf, PageId tmpPageNo, T lowVal){
-	int result = -1;
-	int count = 0;
-	if (nonleaf) {
-		int pos = 0;
-		Page* tmpPage;
-
-		this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-		NL_T* currNode = (NL_T*) tmpPage;
-		T itr;
-		
-		while (pos < nodeOccupancy && currNode->pageNoArray[pos] != 0) {
-			itr = currNode->keyArray[pos];
-			if (attributeType == STRING) {
-				if(compare(itr, lowVal) > 0) {
-					this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-					return pos;
+template<class T> size_t ScanCursor::nextBatch(RecordId* outRids, size_t maxRids)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+
+	if (maxRids == 0 || !resume<T>()) {
+		return 0;
+	}
+
+	size_t copied = 0;
+	while (copied < maxRids && this->currentPage) {
+		L_T* leaf = (L_T*) this->currentPage.get();
+
+		if (this->order == ASCENDING) {
+			// entries of this leaf up to the high bound form one run
+			int end = leaf->count;
+			if (this->hasHighVal) {
+				T highVal = bound<T>(true);
+				if (highOp == LT) {
+					end = LeafLayout<L_T>::lowerBound(leaf, highVal);
 				}
-			}
-			else {
-				if(compare<T>(itr, lowVal) > 0) {
-					this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-					return pos;
+				else {
+					end = LeafLayout<L_T>::upperBound(leaf, highVal);
 				}
 			}
-			pos++;
-		}
+			size_t run = std::min((size_t) std::max(end - this->nextEntry, 0), maxRids - copied);
+			if (run > 0) {
+				LeafLayout<L_T>::copyRids(leaf, this->nextEntry, (int) run, outRids + copied);
+				rememberLast<T>(leaf, this->nextEntry, this->nextEntry + (int) run - 1);
+				copied += run;
+				this->nextEntry += run;
+			}
 
-		this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-		result = (currNode->pageNoArray[pos] == 0)? (pos-1) : pos;
-	}
-	if(leaf){
-		int pos = 0;
-		Page* tmpPage;
-		T itr;
-
-		this->bufMgr->readPage(this->file,tmpPageNo,tmpPage);
-		L_T* currNode = (L_T*) tmpPage;
-
-		while (pos < leafOccupancy && currNode->ridArray[pos].page_number != 0) {
-			itr = currNode->keyArray[pos];
-			if(lowOp == GT){
-				if (attributeType == STRING) {
-					if (compare(itr, lowVal) > 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
-					}
+			// the high bound falls inside this leaf
+			if (this->nextEntry >= end && end < leaf->count) {
+				release();
+				break;
+			}
+		}
+		else {
+			// entries of this leaf down to the low bound form one run, copied last to first
+			int start = 0;
+			if (this->hasLowVal) {
+				T lowVal = bound<T>(false);
+				if (lowOp == GT) {
+					start = LeafLayout<L_T>::upperBound(leaf, lowVal);
 				}
 				else {
-					if (compare<T>(itr, lowVal) > 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
-					}
+					start = LeafLayout<L_T>::lowerBound(leaf, lowVal);
 				}
 			}
-			else if(lowOp == GTE){
-				if (attributeType == STRING) {
-					if (compare(itr, lowVal) >= 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
-					}
-				}
-				else {
-					if (compare<T>(itr, lowVal) >= 0) {
-						this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-						return pos;
-					}
+			size_t run = std::min((size_t) std::max(this->nextEntry + 1 - start, 0), maxRids - copied);
+			if (run > 0) {
+				for (size_t i = 0; i < run; i++) {
+					outRids[copied + i] = LeafLayout<L_T>::ridAt(leaf, this->nextEntry - (int) i);
 				}
+				rememberLast<T>(leaf, this->nextEntry, this->nextEntry - (int) run + 1);
+				copied += run;
+				this->nextEntry -= (int) run;
+			}
+
+			// the low bound falls inside this leaf
+			if (this->nextEntry < start && start > 0) {
+				release();
+				break;
 			}
-			pos++;	
 		}
-		this->bufMgr->unPinPage(this->file,tmpPageNo,false);
-		result = (pos == leafOccupancy || currNode->ridArray[pos].page_number == 0)? (pos - 1):pos ;
+		skipExhaustedLeaves<T>();
 	}
+	suspend();
+	refillUpcoming<T>();
+	return copied;
+}
 
-	return result;
+// -----------------------------------------------------------------------------
+// ScanCursor::scanNextBatch
+// -----------------------------------------------------------------------------
 
+size_t ScanCursor::scanNextBatch(RecordId* outRids, size_t maxRids)
+{
+	if (index->attributeType == INTEGER) {
+		return nextBatch<int>(outRids, maxRids);
+	}
+	else if (index->attributeType == DOUBLE) {
+		return nextBatch<double>(outRids, maxRids);
+	}
+	else if (index->attributeType == STRING) {
+		return nextBatch<char*>(outRids, maxRids);
+	}
+	return 0;
+}
+
+// -----------------------------------------------------------------------------
+// ScanCursor::scanNext
+// -----------------------------------------------------------------------------
+
+const void ScanCursor::scanNext(RecordId& outRid)
+{
+	if (index->attributeType == INTEGER) {
+		next<int>(outRid);
+	}
+	else if (index->attributeType == DOUBLE) {
+		next<double>(outRid);
+	}
+	else if (index->attributeType == STRING) {
+		next<char*>(outRid);
+	}
 }
-	
 
+///////////////////////
+// Custom Functions //
+/////////////////////
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::openIndexFile
@@ -539,7 +1055,6 @@ bool leaf, bool nonleaf, PageId tmpPageNo, T lowVal){
 const void BTreeIndex::openIndexFile(const std::string & relationName, const int attrByteOffset, const Datatype attrType) 
 {
 	Page* metaPage; // header page that stores struct IndexMetaInfo
-	Page* rootPage; // root of Btree
 	IndexMetaInfo * meta;
 
 	// Read meta info page (header page)
@@ -559,27 +1074,199 @@ const void BTreeIndex::openIndexFile(const std::string & relationName, const int
 		throw BadIndexInfoException("Index info not matched");
 	}
 	
-	this->rootIsLeaf = (meta->rootPageNo == 2);
-	this->scanExecuting = false;	
 
-	if (attrType == INTEGER) {
-		this->leafOccupancy = INTARRAYLEAFSIZE;
-		this->nodeOccupancy = INTARRAYNONLEAFSIZE;
+	if (meta->version > INDEXFORMATVERSION) {
+		this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+		throw BadIndexInfoException("Index format version not supported");
 	}
-	else if (attrType == DOUBLE) {
-		this->leafOccupancy = DOUBLEARRAYLEAFSIZE;
-		this->nodeOccupancy = DOUBLEARRAYNONLEAFSIZE;
+	if (attrType == STRING && meta->version < 4 &&
+	    !File::exists(std::string(meta->relationName, strnlen(meta->relationName, sizeof(meta->relationName))))) {
+		// truncated keys are no good for the current format, and the full ones are gone
+		this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+		throw BadIndexInfoException("Relation of the string index to upgrade not found");
 	}
-	else if (attrType == STRING) {
-		this->leafOccupancy = STRINGARRAYLEAFSIZE;
-		this->nodeOccupancy = STRINGARRAYNONLEAFSIZE; 
+
+	// Files of an older format are brought up to the current one. Entries that no longer
+	// fit their leaf are inserted again once the index is usable.
+	bool upgraded = false;
+	std::vector<RecordId> overflowRids;
+	std::vector<char> overflowKeys;
+	if (meta->version < INDEXFORMATVERSION) {
+		if (attrType == INTEGER) {
+			upgradeIndexFile<struct LeafNodeInt,struct LeafNodeIntFormat2,struct NonLeafNodeInt>(meta, overflowRids, overflowKeys);
+		}
+		else if (attrType == DOUBLE) {
+			upgradeIndexFile<struct LeafNodeDouble,struct LeafNodeDouble,struct NonLeafNodeDouble>(meta, overflowRids, overflowKeys);
+		}
+		else if (attrType == STRING) {
+			upgradeStringIndexFile(meta);
+		}
+		upgraded = true;
+	}
+
+	this->height = meta->height;
+
+	this->bufMgr->unPinPage(this->file, this->headerPageNum, upgraded);
+
+	size_t keySize = overflowRids.empty() ? 0 : overflowKeys.size() / overflowRids.size();
+	for (size_t i = 0; i < overflowRids.size(); i++) {
+		insertEntry(&overflowKeys[i * keySize], overflowRids[i]);
+	}
+
+}
+
+
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::upgradeIndexFile
+// bring an index file of an older format up to the current format
+// -----------------------------------------------------------------------------
+template<class L_T,class OLD_L_T,class NL_T> void BTreeIndex::upgradeIndexFile(IndexMetaInfo* meta, std::vector<RecordId>& rids, std::vector<char>& keys)
+{
+	if (meta->version < 2) {
+		// format 1 only knows the root is a leaf while it is still the first page after the header
+		meta->height = upgradeNode<OLD_L_T,NL_T>(meta->rootPageNo, meta->rootPageNo == 2);
+	}
+	if (meta->version < 3) {
+		linkLeaves<L_T,OLD_L_T,NL_T>(meta, rids, keys);
+	}
+	meta->version = INDEXFORMATVERSION;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::upgradeStringIndexFile
+// -----------------------------------------------------------------------------
+void BTreeIndex::upgradeStringIndexFile(IndexMetaInfo* meta)
+{
+	if (meta->version < 2) {
+		meta->height = upgradeNode<struct LeafNodeStringFormat3,struct NonLeafNodeStringFormat3>(meta->rootPageNo, meta->rootPageNo == 2);
+	}
+	if (meta->version < 4) {
+		rebuildStringIndex(meta);
 	}
+	meta->version = INDEXFORMATVERSION;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::rebuildStringIndex
+// -----------------------------------------------------------------------------
+void BTreeIndex::rebuildStringIndex(IndexMetaInfo* meta)
+{
+	// every page of the old tree, non-leaf levels top-down, then the leaves left to right
+	std::vector<PageId> pages;
+	std::vector<PageId> levelPages(1, meta->rootPageNo);
+	for (int level = meta->height; level > 1; level--) {
+		std::vector<PageId> below;
+		for (size_t i = 0; i < levelPages.size(); i++) {
+			Page* page;
+			this->bufMgr->readPage(this->file, levelPages[i], page);
+			NonLeafNodeStringFormat3* node = (NonLeafNodeStringFormat3*) page;
+			below.insert(below.end(), node->pageNoArray, node->pageNoArray + node->count + 1);
+			this->bufMgr->unPinPage(this->file, levelPages[i], false);
+			pages.push_back(levelPages[i]);
+		}
+		levelPages.swap(below);
+	}
+
+	for (size_t i = 0; i < levelPages.size(); i++) {
+		pages.push_back(levelPages[i]);
+	}
+
+	// the lowest page becomes the root leaf, the new nodes take the others in order
+	std::sort(pages.begin(), pages.end(), std::greater<PageId>());
+	this->rootPageNum = pages.back();
+	pages.pop_back();
+	this->reusablePages.swap(pages);
+	this->height = 1;
+
+	// the old leaves only hold the keys cut to STRINGSIZEFORMAT3 bytes, the relation the
+	// full keys
+	Page* rootPage;
+	this->bufMgr->readPage(this->file, this->rootPageNum, rootPage);
+	loadRelation<char*>(std::string(meta->relationName, strnlen(meta->relationName, sizeof(meta->relationName))),
+	                    rootPage);
+
+	// pages the new tree did not need stay unused
+	this->reusablePages.clear();
+	meta->rootPageNo = this->rootPageNum;
+	meta->height = this->height;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::upgradeNode
+// -----------------------------------------------------------------------------
+template<class L_T,class NL_T> int BTreeIndex::upgradeNode(PageId pageNo, bool isLeaf)
+{
+	Page* page;
+	this->bufMgr->readPage(this->file, pageNo, page);
+
+	if (isLeaf) {
+		L_T* leafNode = (L_T*) page;
+		leafNode->count = countOccupied(leafNode->ridArray, sizeof(leafNode->ridArray) / sizeof(RecordId));
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+		return 1;
+	}
+
+	NL_T* nonLeafNode = (NL_T*) page;
+	int children = countOccupied(nonLeafNode->pageNoArray, sizeof(nonLeafNode->pageNoArray) / sizeof(PageId));
+	bool childIsLeaf = (nonLeafNode->level == 1);
+	nonLeafNode->count = children - 1;
 
-	this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+	// children are upgraded one at a time, keep only this node pinned while doing so
+	std::vector<PageId> childPageNos(nonLeafNode->pageNoArray, nonLeafNode->pageNoArray + children);
+	this->bufMgr->unPinPage(this->file, pageNo, true);
 
+	int childHeight = 0;
+	for (size_t i = 0; i < childPageNos.size(); i++) {
+		childHeight = upgradeNode<L_T,NL_T>(childPageNos[i], childIsLeaf);
+	}
+	return childHeight + 1;
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::linkLeaves
+// -----------------------------------------------------------------------------
+template<class L_T,class OLD_L_T,class NL_T> void BTreeIndex::linkLeaves(IndexMetaInfo* meta, std::vector<RecordId>& rids, std::vector<char>& keys)
+{
+	// down the leftmost path to the first leaf
+	PageId pageNo = meta->rootPageNo;
+	for (int level = meta->height; level > 1; level--) {
+		Page* page;
+		this->bufMgr->readPage(this->file, pageNo, page);
+		PageId childPageNo = ((NL_T*) page)->pageNoArray[0];
+		this->bufMgr->unPinPage(this->file, pageNo, false);
+		pageNo = childPageNo;
+	}
+
+	PageId prevPageNo = 0;
+	while (pageNo != 0) {
+		Page* page;
+		this->bufMgr->readPage(this->file, pageNo, page);
+
+		// the layouts overlap, work from a copy of the old one
+		OLD_L_T old;
+		memcpy(&old, page, sizeof(OLD_L_T));
+		L_T* leafNode = (L_T*) page;
+		const size_t keySize = sizeof(old.keyArray[0]);
+
+		int keep = std::min(old.count, (int) (sizeof(leafNode->ridArray) / sizeof(RecordId)));
+		memcpy(leafNode->keyArray, old.keyArray, keep * keySize);
+		memcpy(leafNode->ridArray, old.ridArray, keep * sizeof(RecordId));
+		for (int i = keep; i < old.count; i++) {
+			size_t keyOffset = keys.size();
+			keys.resize(keyOffset + keySize);
+			memcpy(&keys[keyOffset], &(old.keyArray[i]), keySize);
+			rids.push_back(old.ridArray[i]);
+		}
+		leafNode->count = keep;
+		leafNode->rightSibPageNo = old.rightSibPageNo;
+		leafNode->leftSibPageNo = prevPageNo;
 
+		this->bufMgr->unPinPage(this->file, pageNo, true);
+		prevPageNo = pageNo;
+		pageNo = old.rightSibPageNo;
+	}
+}
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::createIndexFile
@@ -593,7 +1280,7 @@ const void BTreeIndex::createIndexFile(const std::string & relationName, const i
 	// Save attributes
 	this->attrByteOffset = attrByteOffset;
 	this->attributeType = attrType;
-	this->rootIsLeaf = true; // root node is initially a LeafNode
+	this->height = 1; // root node is initially a LeafNode
 
 	// allocate metaInfo page, allocate root page
 	this->bufMgr->allocPage(this->file, this->headerPageNum, metaPage);
@@ -604,211 +1291,437 @@ const void BTreeIndex::createIndexFile(const std::string & relationName, const i
 	meta->attrByteOffset = this->attrByteOffset;
 	meta->attrType = this->attributeType;
 	meta->rootPageNo = this->rootPageNum;
+	meta->version = INDEXFORMATVERSION;
+	meta->height = this->height;
 	strcpy(meta->relationName, relationName.c_str());
 
-	// Cast rootPage to LeafNode (root is a leaf for a new Btree)
+	this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
 	if (attrType == INTEGER) {
-		LeafNodeInt* root = (LeafNodeInt*)rootPage;
-		root->rightSibPageNo = 0;
+		loadRelation<int>(relationName, rootPage);
 	}
 	else if (attrType == DOUBLE) {
-		LeafNodeDouble* root = (LeafNodeDouble*)rootPage;
-		root->rightSibPageNo = 0;
+		loadRelation<double>(relationName, rootPage);
 	}
 	else if (attrType == STRING) {
-		LeafNodeString* root = (LeafNodeString*)rootPage;
-		root->rightSibPageNo = 0;
+		loadRelation<char*>(relationName, rootPage);
 	}
+	std::cout << "Finished creating new index file." << std::endl;
 
+	this->bufMgr->flushFile(this->file);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::loadRelation
+// -----------------------------------------------------------------------------
+template<class T> void BTreeIndex::loadRelation(const std::string & relationName, Page* rootPage)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
 
+	// Cast rootPage to LeafNode (root is a leaf for a new Btree)
+	L_T* root = (L_T*) rootPage;
+	root->rightSibPageNo = 0;
+	root->leftSibPageNo = 0;
+	LeafLayout<L_T>::init(root);
 	this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
-	this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
 
-	// Scan the relation file
+	// Scan the relation file and collect every (key, rid) pair.
+	// Keys are copied into one flat buffer; string keys take their length and a NUL.
+	std::vector<RecordId> rids;
+	std::vector<char> keys;
+	std::vector<size_t> keyOffsets;
 
-	FileScan* scan = new FileScan(relationName, this->bufMgr);
+	FileScan* scan = new FileScan(relationName, this->relationBufMgr);
 	try {
 		while (1) {
 			std::string recordString;
 			const char* record;
-
-			//const char* key;
 			RecordId rid;
-			int attr_int;
-			double attr_double;
 
 			// Iterate the records in relation file
 			scan->scanNext(rid);
 			recordString = scan->getRecord();
 			record = recordString.c_str();
-			void* key = (void*)(record+attrByteOffset);
-			insertEntry(key,rid);
+
+			char keyBytes[STRINGSIZE];
+			size_t keyLen = KeyTraits<T>::recordToBytes(keyBytes, record + attrByteOffset, recordString.size() - attrByteOffset);
+			keyOffsets.push_back(keys.size());
+			keys.insert(keys.end(), keyBytes, keyBytes + keyLen);
+			rids.push_back(rid);
 		}
-		
 	}
 	catch (EndOfFileException e) 
 	{
 		// do nothing
-		std::cout << "Finished creating new index file." << std::endl;		
 	}
-
-	this->bufMgr->flushFile(this->file);
 	delete scan;
+
+	// Build the tree bottom-up from the collected pairs.
+	// String keys point into the flat key buffer, which outlives the load.
+	std::vector<RIDKeyPair<T> > entries(rids.size());
+	for (size_t i = 0; i < rids.size(); i++) {
+		entries[i].set(rids[i], KeyTraits<T>::fromBytes(&keys[keyOffsets[i]]));
+	}
+	bulkLoad<T>(entries);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertRootLeaf
-// insert entry into root when root is a leaf node 
-// split old root into two leafs and create new root if old root is full after insert
+// BTreeIndex::bulkLoad
+// sort all entries, pack them into leaves and build the non-leaf levels bottom-up
 // ----------------------------------------------------------------------------
-template<class T, class L_T,class NL_T,class P_T, class RID_T> void BTreeIndex::insertRootLeaf( RID_T RIDPair){
+template<class T> void BTreeIndex::bulkLoad(std::vector<RIDKeyPair<T> >& entries)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+	typedef PageKeyPair<T> P_T;
+	typedef RIDKeyPair<T> RID_T;
+
+	if (entries.empty()) {
+		// empty relation, the root stays an empty leaf
+		return;
+	}
 
+	// order by key, break ties by rid so the build is deterministic
+	std::sort(entries.begin(), entries.end(), [this](const RID_T& a, const RID_T& b) {
+		int cmp = KeyTraits<T>::compare(a.key, b.key);
+		if (cmp != 0) {
+			return cmp < 0;
+		}
+		if (a.rid.page_number != b.rid.page_number) {
+			return a.rid.page_number < b.rid.page_number;
+		}
+		return a.rid.slot_number < b.rid.slot_number;
+	});
+
+	// (separator, pageNo) of every node on the level being built. The separators are kept
+	// in a buffer of their own, keySize bytes each, and the keys point at it once it is complete.
+	std::vector<P_T> level;
+	const size_t keySize = KeyTraits<T>::bytesSize();
+	std::vector<char> separators;
+
+	// The root page allocated by createIndexFile becomes the first leaf, so an
+	// index that fits in one leaf keeps its root at page 2.
+	PageId leafPageNo = this->rootPageNum;
+	PageId prevPageNo = 0;
 	Page* leafPage;
-	L_T* leafNode;
+	this->bufMgr->readPage(this->file, leafPageNo, leafPage);
+
+	size_t next = 0;
+	while (next < entries.size()) {
+		L_T* leafNode = (L_T*) leafPage;
+		int n = LeafLayout<L_T>::fill(leafNode, &entries[next], (int) (entries.size() - next), this->fillFactor);
+		leafNode->leftSibPageNo = prevPageNo;
+
+		size_t separatorOffset = separators.size();
+		separators.resize(separatorOffset + keySize);
+		if (next == 0) {
+			KeyTraits<T>::toBytes(&separators[separatorOffset], entries[next].key);
+		}
+		else {
+			LeafLayout<L_T>::separator(entries[next - 1].key, entries[next].key, &separators[separatorOffset]);
+		}
+		P_T firstEntry;
+		firstEntry.set(leafPageNo, entries[next].key);
+		level.push_back(firstEntry);
+		next += n;
+
+		if (next < entries.size()) {
+			// link to the next leaf before letting go of this one; the leaves are written
+			// once and are not to push the rest of the pool out
+			PageId nextPageNo;
+			Page* nextPage;
+			allocNodePage(nextPageNo, nextPage, ACCESS_BULKWRITE);
+			leafNode->rightSibPageNo = nextPageNo;
+			this->bufMgr->unPinPage(this->file, leafPageNo, true);
+			prevPageNo = leafPageNo;
+			leafPageNo = nextPageNo;
+			leafPage = nextPage;
+		}
+		else {
+			leafNode->rightSibPageNo = 0;
+			this->bufMgr->unPinPage(this->file, leafPageNo, true);
+		}
+	}
+	for (size_t i = 0; i < level.size(); i++) {
+		level[i].key = KeyTraits<T>::fromBytes(&separators[i * keySize]);
+	}
 
-	this->bufMgr->readPage(this->file, this->rootPageNum, leafPage);
-	PageId oldPageNum = this->rootPageNum;
-	leafNode = (L_T*) leafPage;
+	if (level.size() == 1) {
+		// everything fits in the root leaf
+		return;
+	}
 
-	// If rootLeaf is not full just put the entry in
-	if ( leafNode->ridArray[this->leafOccupancy-1].page_number == 0 ) {
-		putEntryLeaf<T, L_T,RID_T> (leafNode,RIDPair);
+	// Nodes right above the leaves are at level 1, all others at level 0
+	buildNonLeafLevel<T>(level, 1);
+	this->height = 2;
+	while (level.size() > 1) {
+		buildNonLeafLevel<T>(level, 0);
+		this->height++;
 	}
-	else {
-		// splite leaf node into 2
-		P_T newChildPage;
-		splitLeaf<T, L_T,P_T,RID_T>(leafNode, RIDPair, newChildPage);
 
-		// create a new root (non-leaf node)
-		createNewRoot<T, L_T,NL_T,P_T,RID_T>(rootPageNum, newChildPage, true);
+	// The last node built is the new root
+	Page* headerPage;
+	IndexMetaInfo* meta;
 
-	}
-	this->bufMgr->unPinPage(this->file, oldPageNum, true);
+	this->rootPageNum = level[0].pageNo;
+	this->bufMgr->readPage(file, headerPageNum, headerPage);
+	meta = (IndexMetaInfo*) headerPage;
+	meta->rootPageNo = this->rootPageNum;
+	meta->height = this->height;
+	this->bufMgr->unPinPage(file, headerPageNum, true);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::assign
-// assign value
+// BTreeIndex::buildNonLeafLevel
+// pack the nodes of one level under as few new non-leaf nodes as the fill factor allows
 // ----------------------------------------------------------------------------
+template<class T> void BTreeIndex::buildNonLeafLevel(std::vector<PageKeyPair<T> >& children, int level)
+{
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+	typedef PageKeyPair<T> P_T;
+
+	std::vector<P_T> parents;
+
+	size_t next = 0;
+	while (next < children.size()) {
+		PageId newPageNo;
+		Page* newPage;
+		allocNodePage(newPageNo, newPage);
+		NL_T* newNode = (NL_T*) newPage;
+
+		int remaining = (int) (children.size() - next);
+		int n = NonLeafLayout<NL_T>::fill(newNode, level, &children[next], remaining, this->fillFactor);
+		// never leave a single child for the last node, hand it one from this node instead
+		if (remaining - n == 1 && n > 2) {
+			n = NonLeafLayout<NL_T>::fill(newNode, level, &children[next], n - 1, this->fillFactor);
+		}
 
-void BTreeIndex::assignPrime (void* des, void* src) {
-	if (attributeType == INTEGER) {
-		*((int*)des) = *((int*)src);
-	}
-	else if (attributeType == DOUBLE) {
-		*(double*) des = *(double*)src;
-	}
-	else {
-		// string is not handled here
+		P_T firstEntry;
+		firstEntry.set(newPageNo, children[next].key);
+		parents.push_back(firstEntry);
+		this->bufMgr->unPinPage(this->file, newPageNo, true);
+		next += n;
 	}
-}
 
+	children.swap(parents);
+}
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::assign
-// assign value for int and double
-// ----------------------------------------------------------------------------
-template<class T> void BTreeIndex::assign(T a, T b) {
-	
+// BTreeIndex::allocNodePage
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::allocNodePage(PageId& pageNo, Page*& page, const AccessStrategy strategy)
+{
+	if (this->reusablePages.empty()) {
+		this->bufMgr->allocPage(this->file, pageNo, page, strategy);
+		return;
+	}
+	pageNo = this->reusablePages.back();
+	this->reusablePages.pop_back();
+	this->bufMgr->readPage(this->file, pageNo, page, strategy);
 }
- 
+
 // -----------------------------------------------------------------------------
-// BTreeIndex::assign
-// assign value for char*
-// ----------------------------------------------------------------------------
-template<> void BTreeIndex::assign <char*> (char* a, char* b) {
-	strncpy(a, b, STRINGSIZE);
+// BTreeIndex::readLatched / releaseLatched
+// -----------------------------------------------------------------------------
+
+void BTreeIndex::readLatched(PageId pageNo, Page*& page, LatchMode mode)
+{
+	this->bufMgr->readPage(this->file, pageNo, page);
+	this->bufMgr->latchPage(this->file, pageNo, mode);
+}
+
+PageHandle BTreeIndex::readLatched(PageId pageNo, LatchMode mode)
+{
+	PageHandle page = this->bufMgr->readPage(this->file, pageNo);
+	page.latch(mode);
+	return page;
 }
 
+void BTreeIndex::releaseLatched(PageId pageNo, LatchMode mode, bool dirty)
+{
+	this->bufMgr->unlatchPage(this->file, pageNo, mode);
+	this->bufMgr->unPinPage(this->file, pageNo, dirty);
+}
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::putEntryLeaf
-// insert entry into leaf when leaf is not null
+// BTreeIndex::insert
+// Most inserts fit into their leaf. Try with shared latches down to the leaf first and
+// latch the whole path exclusive only when the leaf turns out to be full.
 // ----------------------------------------------------------------------------
-template<class T, class L_T,class RID_T> void BTreeIndex::putEntryLeaf(L_T* leafNode, RID_T RIDPair){
-	
-	int pos = 0;
-	int i = 0;
-	RID_T itr;
-
-	while( (pos < leafOccupancy) && (leafNode->ridArray[pos].page_number != 0)) {
-		itr.set(leafNode->ridArray[pos], leafNode->keyArray[pos]);
-		if ( compare(itr.key, RIDPair.key) >= 0) {
-			break;
-		}
-		pos++;
+template<class T> void BTreeIndex::insert(RIDKeyPair<T> entry)
+{
+	if (!insertOptimistic<T>(entry)) {
+		insertPessimistic<T>(entry);
 	}
-	// else shift everything to the right, insert at pos
-	for (i = leafOccupancy-1; i > pos; i--){
+}
 
-		leafNode->ridArray[i] = leafNode->ridArray[i-1];
-		if (attributeType == STRING) {
-			assign( leafNode->keyArray[i], leafNode->keyArray[i-1]);
-		}
-		else {
-			assignPrime( &(leafNode->keyArray[i]), &(leafNode->keyArray[i-1]) );
-		}
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertOptimistic
+// ----------------------------------------------------------------------------
+template<class T> bool BTreeIndex::insertOptimistic(RIDKeyPair<T> entry)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+
+	PageHandle headerPage = readLatched(this->headerPageNum, LATCH_SHARED);
+	int level = this->height;
+	PageHandle page = readLatched(this->rootPageNum, (level == 1) ? LATCH_EXCLUSIVE : LATCH_SHARED);
+	headerPage.release();
+
+	// equal keys go right of each other, so follow the child right of every key equal to the new one
+	while (level > 1) {
+		NL_T* node = (NL_T*) page.get();
+		PageId childPageNo = NonLeafLayout<NL_T>::childAt(node, NonLeafLayout<NL_T>::upperBound(node, entry.key));
+		page = readLatched(childPageNo, (level == 2) ? LATCH_EXCLUSIVE : LATCH_SHARED);
+		level--;
 	}
 
-	leafNode->ridArray[pos] = RIDPair.rid;
-	
-	if (attributeType == STRING) {
-		assign(leafNode->keyArray[pos], RIDPair.key);
-	}
-	else {
-		assignPrime( &(leafNode->keyArray[pos]), &(RIDPair.key) );
+	L_T* leafNode = (L_T*) page.get();
+	bool fits = LeafLayout<L_T>::fits(leafNode, entry.key);
+	if (fits) {
+		putEntryLeaf<T>(leafNode, entry);
+		page.markDirty();
 	}
-
+	return fits;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::putEntryNonLeaf
-// insert entry into non-leaf node
+// BTreeIndex::insertPessimistic
+// latch crabbing with exclusive latches; ancestors of a node that cannot split are released
 // ----------------------------------------------------------------------------
-template<class T, class NL_T,class P_T> void BTreeIndex::putEntryNonLeaf(NL_T* nonLeafNode, P_T pagePair){
-	
-	int pos = 0;
-	int pgno_pos = 0;
-	int key_pos = 0;
-	P_T itr;
-
-	while( pos < nodeOccupancy && nonLeafNode->pageNoArray[pos] != 0 ) {
-		itr.set(nonLeafNode->pageNoArray[pos], nonLeafNode->keyArray[pos]);
-		if( compare(itr.key, pagePair.key) >= 0) {
+template<class T> void BTreeIndex::insertPessimistic(RIDKeyPair<T> entry)
+{
+	typedef typename KeyTraits<T>::Leaf L_T;
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+	typedef PageKeyPair<T> P_T;
+
+	Page* headerPage;
+	Page* page;
+
+	// a root split changes the header, so keep it until the root is known not to split
+	readLatched(this->headerPageNum, headerPage, LATCH_EXCLUSIVE);
+	bool headerLatched = true;
+	PageId pageNo = this->rootPageNum;
+	int level = this->height;
+	readLatched(pageNo, page, LATCH_EXCLUSIVE);
+
+	// non-leaf nodes still latched, top-down, with the position of the child taken
+	std::vector<PathEntry> path;
+
+	while (true) {
+		bool safe;
+		if (level == 1) {
+			safe = LeafLayout<L_T>::fits((L_T*) page, entry.key);
+		}
+		else {
+			safe = NonLeafLayout<NL_T>::safe((NL_T*) page);
+		}
+		if (safe) {
+			// a split below stops at this node
+			for (size_t i = 0; i < path.size(); i++) {
+				releaseLatched(path[i].pageNo, LATCH_EXCLUSIVE, false);
+			}
+			path.clear();
+			if (headerLatched) {
+				releaseLatched(this->headerPageNum, LATCH_EXCLUSIVE, false);
+				headerLatched = false;
+			}
+		}
+		if (level == 1) {
 			break;
 		}
-		pos++;
+
+		NL_T* node = (NL_T*) page;
+		PathEntry parent;
+		parent.pageNo = pageNo;
+		parent.page = page;
+		parent.childPos = NonLeafLayout<NL_T>::upperBound(node, entry.key);
+		path.push_back(parent);
+
+		pageNo = NonLeafLayout<NL_T>::childAt(node, parent.childPos);
+		readLatched(pageNo, page, LATCH_EXCLUSIVE);
+		level--;
+	}
+
+	L_T* leafNode = (L_T*) page;
+	if (LeafLayout<L_T>::fits(leafNode, entry.key)) {
+		putEntryLeaf<T>(leafNode, entry);
+		releaseLatched(pageNo, LATCH_EXCLUSIVE, true);
+		return;
 	}
 
-	// else shift everything to the right, insert at pos
-	for(int i = nodeOccupancy-1; i > pos; i--){
-		if (attributeType == STRING) {
-			assign(nonLeafNode->keyArray[i], nonLeafNode->keyArray[i-1] );
+	// separators handed up point into this buffer, never into pages that are let go of
+	char splitKey[STRINGSIZE];
+	P_T newChild;
+	bool rootLevel = (this->height == 1);
+	splitLeaf<T>(pageNo, leafNode, entry, newChild, splitKey);
+	releaseLatched(pageNo, LATCH_EXCLUSIVE, true);
+
+	bool split = true;
+	while (split && !path.empty()) {
+		PathEntry parent = path.back();
+		path.pop_back();
+		NL_T* node = (NL_T*) parent.page;
+
+		if (NonLeafLayout<NL_T>::fits(node, newChild.key)) {
+			putEntryNonLeaf<T>(node, parent.childPos, newChild);
+			split = false;
 		}
 		else {
-			assignPrime( &(nonLeafNode->keyArray[i]), &(nonLeafNode->keyArray[i-1]) );
+			P_T rightHalf;
+			splitNonLeaf<T>(node, parent.childPos, newChild, rightHalf, splitKey);
+			newChild = rightHalf;
 		}
-		nonLeafNode->pageNoArray[i+1] = nonLeafNode->pageNoArray[i];	
+		releaseLatched(parent.pageNo, LATCH_EXCLUSIVE, true);
 	}
 
-	if (nonLeafNode->pageNoArray[pos] == 0) {
-		key_pos = pos-1;
-		pgno_pos = pos;
+	// every node up to the root was split, the header is still latched
+	if (split) {
+		createNewRoot<T>(this->rootPageNum, newChild, rootLevel, (IndexMetaInfo*) headerPage);
+		releaseLatched(this->headerPageNum, LATCH_EXCLUSIVE, true);
+		return;
 	}
-	else {
-		key_pos = pos;
-		pgno_pos = pos+1;
+
+	// a node kept as unsafe may still have taken the separator, a short string key
+	// fits where safe reserved room for the longest; the nodes above it are unchanged
+	for (size_t i = 0; i < path.size(); i++) {
+		releaseLatched(path[i].pageNo, LATCH_EXCLUSIVE, false);
+	}
+	if (headerLatched) {
+		releaseLatched(this->headerPageNum, LATCH_EXCLUSIVE, false);
 	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::putEntryLeaf
+// insert entry into leaf when leaf is not null
+// ----------------------------------------------------------------------------
+template<class T> void BTreeIndex::putEntryLeaf(typename KeyTraits<T>::Leaf* leafNode, RIDKeyPair<T> RIDPair){
+	typedef typename KeyTraits<T>::Leaf L_T;
 	
-	nonLeafNode->pageNoArray[pgno_pos] = pagePair.pageNo;
+	int entryCount = leafNode->count;
+	int pos;
 
-	if (attributeType == STRING) {
-		assign(nonLeafNode->keyArray[key_pos], pagePair.key);
+	// appending in key order is the common case, skip the search for it.
+	// An equal key goes after the ones already there.
+	if (entryCount == 0 || LeafLayout<L_T>::compareAt(leafNode, entryCount - 1, RIDPair.key) <= 0) {
+		pos = entryCount;
 	}
 	else {
-		assignPrime( &(nonLeafNode->keyArray[key_pos]), &(pagePair.key) );
+		pos = LeafLayout<L_T>::upperBound(leafNode, RIDPair.key);
 	}
+	LeafLayout<L_T>::insertAt(leafNode, pos, RIDPair.key, RIDPair.rid);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::putEntryNonLeaf
+// insert entry into non-leaf node
+// ----------------------------------------------------------------------------
+template<class T> void BTreeIndex::putEntryNonLeaf(typename KeyTraits<T>::NonLeaf* nonLeafNode, int pos, PageKeyPair<T> pagePair){
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
 
+	// the new child goes right of the new key
+	NonLeafLayout<NL_T>::insertAt(nonLeafNode, pos, pagePair.key, pagePair.pageNo);
 }
 
 
@@ -816,39 +1729,48 @@ template<class T, class NL_T,class P_T> void BTreeIndex::putEntryNonLeaf(NL_T* n
 // BTreeIndex::splitLeaf
 // split a leaf node into 2, return the new page number
 // ----------------------------------------------------------------------------
-template<class T, class L_T,class P_T,class RID_T> void BTreeIndex::splitLeaf(L_T* leafNode, RID_T RIDPair, P_T& rightFirst) {
+template<class T> void BTreeIndex::splitLeaf(PageId leafPageNo, typename KeyTraits<T>::Leaf* leafNode, RIDKeyPair<T> RIDPair, PageKeyPair<T>& rightFirst, char* splitKey) {
+	typedef typename KeyTraits<T>::Leaf L_T;
+
 	PageId newPageNo;
 	Page* newPage;
 	L_T* newLeafNode;
-	int mid = leafOccupancy/2+1;
+
+	int pos = LeafLayout<L_T>::upperBound(leafNode, RIDPair.key);
+	bool toLeft;
+	int mid = LeafLayout<L_T>::splitPoint(leafNode, pos, RIDPair.key, toLeft);
 
 	this->bufMgr->allocPage(this->file, newPageNo, newPage); // allocate a new page
 	newLeafNode = (L_T*)newPage; // create new leaf node
-
-	for (int i = mid; i < leafOccupancy; i++) {
-		newLeafNode->ridArray[i-mid] = leafNode->ridArray[i];
-		leafNode->ridArray[i].page_number = 0;
-
-		if (attributeType == STRING) {
-			assign(newLeafNode->keyArray[i-mid], leafNode->keyArray[i] );
-		}
-		else {
-			assignPrime( &(newLeafNode->keyArray[i-mid]), &(leafNode->keyArray[i]) );
-		}
-	}
+	LeafLayout<L_T>::moveTail(leafNode, mid, newLeafNode);
 
 	newLeafNode->rightSibPageNo = leafNode->rightSibPageNo;
+	newLeafNode->leftSibPageNo = leafPageNo;
 	leafNode->rightSibPageNo = newPageNo;
 
-	rightFirst.set(newPageNo, newLeafNode->keyArray[0]);
+	// latches go left to right, so the right sibling can be latched while holding this leaf
+	if (newLeafNode->rightSibPageNo != 0) {
+		Page* rightPage;
+		readLatched(newLeafNode->rightSibPageNo, rightPage, LATCH_EXCLUSIVE);
+		((L_T*) rightPage)->leftSibPageNo = newPageNo;
+		releaseLatched(newLeafNode->rightSibPageNo, LATCH_EXCLUSIVE, true);
+	}
 
-	if ( compare(RIDPair.key, rightFirst.key) < 0 ){
-		putEntryLeaf<T, L_T,RID_T>(leafNode,RIDPair);
+	if (toLeft) {
+		putEntryLeaf<T>(leafNode,RIDPair);
 	}
 	else {
-		putEntryLeaf<T, L_T,RID_T>(newLeafNode,RIDPair);
+		putEntryLeaf<T>(newLeafNode,RIDPair);
 	}
 
+	// the separator is copied up by the caller, keep it away from the pages
+	char lastLeft[STRINGSIZE];
+	char firstRight[STRINGSIZE];
+	LeafLayout<L_T>::keyBytesAt(leafNode, leafNode->count - 1, lastLeft);
+	LeafLayout<L_T>::keyBytesAt(newLeafNode, 0, firstRight);
+	LeafLayout<L_T>::separator(KeyTraits<T>::fromBytes(lastLeft), KeyTraits<T>::fromBytes(firstRight), splitKey);
+	rightFirst.set(newPageNo, KeyTraits<T>::fromBytes(splitKey));
+
 	bufMgr->unPinPage(file, newPageNo, true);
 
 }
@@ -858,40 +1780,51 @@ template<class T, class L_T,class P_T,class RID_T> void BTreeIndex::splitLeaf(L_
 // BTreeIndex::splitNonLeaf
 // split a non-leaf node into 2, return the new page number
 // ----------------------------------------------------------------------------
-template<class T, class NL_T,class P_T> void BTreeIndex::splitNonLeaf(NL_T* nonLeafNode, P_T pagePair2insert, P_T& rightFirstEntry) {
+template<class T> void BTreeIndex::splitNonLeaf(typename KeyTraits<T>::NonLeaf* nonLeafNode, int pos, PageKeyPair<T> pagePair2insert, PageKeyPair<T>& rightFirstEntry, char* splitKey) {
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+
 	PageId newPageNo;
 	Page* newPage;
 	NL_T* newNonLeafNode;
-	int mid = nodeOccupancy/2+1;
+	const size_t keySize = KeyTraits<T>::bytesSize();
+	int keyCount = nonLeafNode->count;
+
+	// lay out the keys and children with the new entry in place, then cut them in two
+	std::vector<char> keyBytes((keyCount + 1) * keySize);
+	std::vector<T> keys(keyCount + 1);
+	std::vector<PageId> children(keyCount + 2);
+	for (int i = 0; i <= keyCount; i++) {
+		char* bytes = &keyBytes[i * keySize];
+		if (i == pos) {
+			KeyTraits<T>::toBytes(bytes, pagePair2insert.key);
+		}
+		else {
+			NonLeafLayout<NL_T>::keyBytesAt(nonLeafNode, (i < pos) ? i : i - 1, bytes);
+		}
+		keys[i] = KeyTraits<T>::fromBytes(bytes);
+	}
+	for (int i = 0; i <= keyCount + 1; i++) {
+		if (i == pos + 1) {
+			children[i] = pagePair2insert.pageNo;
+		}
+		else {
+			children[i] = NonLeafLayout<NL_T>::childAt(nonLeafNode, (i <= pos) ? i : i - 1);
+		}
+	}
+
+	// key mid moves up, the keys right of it and their children go to the new node
+	int mid = NonLeafLayout<NL_T>::splitPoint(&keys[0], keyCount + 1);
+	int rightCount = keyCount - mid;
 
 	this->bufMgr->allocPage(file, newPageNo, newPage);
 	newNonLeafNode = (NL_T*)newPage;
 
 	// new node has same level with spliteed node
-	newNonLeafNode->level = nonLeafNode->level; 
-
-	for (int i = mid; i < nodeOccupancy; i++) {
-		newNonLeafNode->pageNoArray[i-mid] = nonLeafNode->pageNoArray[i];
-		if (i != mid) 
-			nonLeafNode->pageNoArray[i] = 0;
-		if (attributeType == STRING) {
-			assign(newNonLeafNode->keyArray[i-mid], nonLeafNode->keyArray[i] );
-		}
-		else {
-			assignPrime( &(newNonLeafNode->keyArray[i-mid]), &(nonLeafNode->keyArray[i]) );
-		}
-	}
-	newNonLeafNode->pageNoArray[nodeOccupancy-mid] = nonLeafNode->pageNoArray[nodeOccupancy];
-	nonLeafNode->pageNoArray[nodeOccupancy] = 0;
+	NonLeafLayout<NL_T>::build(nonLeafNode, nonLeafNode->level, &keys[0], &children[0], mid);
+	NonLeafLayout<NL_T>::build(newNonLeafNode, nonLeafNode->level, &keys[mid + 1], &children[mid + 1], rightCount);
 
-	rightFirstEntry.set(newPageNo,newNonLeafNode->keyArray[0]);
-	
-	if (pagePair2insert.key<rightFirstEntry.key){
-		putEntryNonLeaf <T, NL_T,P_T> (nonLeafNode, pagePair2insert);
-	}
-	else{
-		putEntryNonLeaf <T, NL_T,P_T> (newNonLeafNode, pagePair2insert);
-	}
+	memcpy(splitKey, &keyBytes[mid * keySize], keySize);
+	rightFirstEntry.set(newPageNo, KeyTraits<T>::fromBytes(splitKey));
 
 	bufMgr->unPinPage(file, newPageNo, true);
 
@@ -902,136 +1835,25 @@ template<class T, class NL_T,class P_T> void BTreeIndex::splitNonLeaf(NL_T* nonL
 // BTreeIndex::createNewRoot
 // create a new root node (non-leaf)
 // ----------------------------------------------------------------------------
-template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::createNewRoot(PageId left, P_T rightFirst, bool isLeaf){
+template<class T> void BTreeIndex::createNewRoot(PageId left, PageKeyPair<T> rightFirst, bool isLeaf, IndexMetaInfo* meta){
+	typedef typename KeyTraits<T>::NonLeaf NL_T;
+
 	Page* newRootPage;
 	PageId newRootPageNo;
-	Page* headerPage;
 	NL_T* newRootNode;
-	IndexMetaInfo * meta;
 
 	this->bufMgr->allocPage(file, newRootPageNo, newRootPage); // allocate a new page
 	// insert new values
 	newRootNode = (NL_T*)newRootPage;
-	newRootNode->pageNoArray[0] = left;
-	newRootNode->pageNoArray[1] = rightFirst.pageNo;
-
-	if (attributeType == STRING) {
-		assign(newRootNode->keyArray[0], rightFirst.key);
-	}
-	else {
-		assignPrime( &(newRootNode->keyArray[0]), &(rightFirst.key) );
-	}
-
-	if (isLeaf) {
-		newRootNode->level = 1;
-	}
-	else {
-		newRootNode->level = 0;
-	}
-	this->rootPageNum = newRootPageNo;
-	this->rootIsLeaf = false;
+	T keys[1] = { rightFirst.key };
+	PageId children[2] = { left, rightFirst.pageNo };
+	NonLeafLayout<NL_T>::build(newRootNode, isLeaf ? 1 : 0, keys, children, 1);
 	this->bufMgr->unPinPage(file, newRootPageNo, true);
 
-	this->bufMgr->readPage(file, headerPageNum, headerPage);
-	meta = (IndexMetaInfo*) headerPage;
+	this->rootPageNum = newRootPageNo;
+	this->height++;
 	meta->rootPageNo = this->rootPageNum;
-	// write back
-	this->bufMgr->unPinPage(file, headerPageNum, true);
-
-}
-
-// -----------------------------------------------------------------------------
-// BTreeIndex::traverse
-// -----------------------------------------------------------------------------
-template<class T, class L_T,class NL_T,class P_T,class RID_T> void BTreeIndex::traverse(PageId currPageNo, P_T& newPagePair, RID_T RIDPair2insert) 
-{
-	Page* rightPage;
-	int pos = 0;
-	PageId childPageNo;
-	Page* childPage;
-	L_T* childLeafNode;
-	NL_T* childNonLeafNode;
-
-	Page* currPage;
-	NL_T* currNode;
-
-	P_T itr;
-	P_T rightFirstEntry;
-	P_T pagePair2insert;
-
-
-	this->bufMgr->readPage(file, currPageNo, currPage);
-	currNode = (NL_T*) currPage;
-
-	while (pos < nodeOccupancy && currNode->pageNoArray[pos] != 0) {
-		itr.set( currNode->pageNoArray[pos], currNode->keyArray[pos]);
-		if( compare(itr.key, RIDPair2insert.key) >= 0 ){
-			break;
-		} 
-		pos++;
-	}
-	   
-	if (currNode->pageNoArray[pos] == 0 && pos > 0) pos--;
-
-	childPageNo = currNode->pageNoArray[pos]; 
-
-	// check level, if currNode is at level 1 just insert entry into leaf node
-	if (currNode->level == 1) {
-		// check if leaf node is full, if it is need to split leaf node
-		this->bufMgr->readPage(file, childPageNo, childPage);
-		L_T* childLeafNode = (L_T*) childPage;
-
-		if ( (childLeafNode->ridArray[leafOccupancy-1]).page_number == 0) {
-			putEntryLeaf<T, L_T,RID_T>(childLeafNode, RIDPair2insert);
-		}
-		else {
-			splitLeaf<T, L_T,P_T,RID_T>(childLeafNode, RIDPair2insert, pagePair2insert);
-
-		  if (currNode->pageNoArray[nodeOccupancy] == 0) {
-		  	putEntryNonLeaf<T, NL_T,P_T>(currNode,pagePair2insert);
-		  }
-		  // if current non-leaf node is full, split the leaf and insert into right node
-		  else {	
-		  	splitNonLeaf<T, NL_T,P_T>(currNode, pagePair2insert, rightFirstEntry);
-		  	newPagePair = rightFirstEntry;
-		  }
-		}
-		this->bufMgr->unPinPage(file,childPageNo,true); 
-		this->bufMgr->unPinPage(file,currPageNo,true);
-		return;
-	}
-
-	P_T newChildPagePair;
-	Page* newChildPage;
-	NL_T* newChildNode;
-	T dummykey;
-
-	newChildPagePair.set(0,dummykey);
-
-	// if currNode is at level 0
-	this->bufMgr->unPinPage(file,currPageNo,false); 
-  traverse<T, L_T, NL_T, P_T, RID_T> (childPageNo, newChildPagePair, RIDPair2insert);
-
-  Page* newReadCurr;
-  this->bufMgr->readPage(file,currPageNo,newReadCurr);
-
-  if (newChildPagePair.pageNo != 0) {
-  	pagePair2insert.set(newChildPagePair.pageNo, newChildPagePair.key);
-
-  	if (currNode->pageNoArray[nodeOccupancy]==0) {
-  		// if currNode is not full
-  		putEntryNonLeaf<T, NL_T,P_T>(currNode,pagePair2insert);
-  	}
-  	else {
-  		// if currNode is full
-  		splitNonLeaf<T, NL_T,P_T>(currNode, pagePair2insert, rightFirstEntry);
-			newPagePair = rightFirstEntry;
-  	}
-  }
-  this->bufMgr->unPinPage(file, currPageNo, (newChildPagePair.pageNo !=0) ); 
-
+	meta->height = this->height;
 }
 
 } // end namespace badgerdb
-
-
@@ -12,12 +12,17 @@
 #include "string.h"
 #include <sstream>
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
 
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "buffer_pools.h"
+#include "node_search.h"
 
 namespace badgerdb
 {
@@ -44,27 +49,67 @@ enum Operator
 };
 
 /**
- * @brief Size of String key.
+ * @brief Order in which a scan returns the entries of its range.
  */
-const  int STRINGSIZE = 10;
+enum ScanOrder
+{
+  ASCENDING,   /* From the low bound up, following right sibling links */
+  DESCENDING   /* From the high bound down, following left sibling links */
+};
+
+/**
+ * @brief Size of a String key buffer, including the terminating NUL. Longer keys are truncated
+ * to STRINGSIZE - 1 bytes.
+ */
+const  int STRINGSIZE = 256;
+
+/**
+ * @brief Size of a String key in the fixed-width string nodes of format 1 to 3.
+ */
+const  int STRINGSIZEFORMAT3 = 10;
+
+/**
+ * @brief Version of the on-disk index format written by this code.
+ * Version 2 stores the number of keys in every node and the tree height in the meta page.
+ * Version 3 links every leaf to its left sibling as well.
+ * Version 4 keeps String keys of any length up to STRINGSIZE - 1 in slotted nodes.
+ * Files of an older format (format 1 has no version) are upgraded when they are opened.
+ */
+const  int INDEXFORMATVERSION = 4;
+
+/**
+ * @brief Default fraction of the key slots of each node filled when an index is bulk loaded.
+ */
+const  double DEFAULTFILLFACTOR = 0.9;
+
+/**
+ * @brief Default number of leaves a scan keeps prefetched ahead of the one it is on.
+ */
+const  int DEFAULTREADAHEAD = 8;
 
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+//                                                  sibling ptrs                         count             key               rid
+const  int INTARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - sizeof( int ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+
+/**
+ * @brief Number of key slots in a format 1 or 2 B+Tree leaf for INTEGER key, which had no left sibling link.
+ */
+//                                                          sibling ptr             key               rid
+const  int INTARRAYLEAFSIZEFORMAT2 = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
 
 /**
  * @brief Number of key slots in B+Tree leaf for DOUBLE key.
  */
-//                                                     sibling ptr               key               rid
-const  int DOUBLEARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( double ) + sizeof( RecordId ) );
+//                                                     sibling ptrs                         count               key               rid
+const  int DOUBLEARRAYLEAFSIZE = ( Page::SIZE - 2 * sizeof( PageId ) - sizeof( int ) ) / ( sizeof( double ) + sizeof( RecordId ) );
 
 /**
- * @brief Number of key slots in B+Tree leaf for STRING key.
+ * @brief Number of key slots in a format 1 to 3 B+Tree leaf for STRING key.
  */
-//                                                    sibling ptr           key                      rid
-const  int STRINGARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( 10 * sizeof(char) + sizeof( RecordId ) );
+//                                                           sibling ptrs                         count           key                                    rid
+const  int STRINGARRAYLEAFSIZEFORMAT3 = ( Page::SIZE - 2 * sizeof( PageId ) - sizeof( int ) ) / ( STRINGSIZEFORMAT3 * sizeof(char) + sizeof( RecordId ) );
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
@@ -79,10 +124,15 @@ const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId )
 const  int DOUBLEARRAYNONLEAFSIZE = (( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( double ) + sizeof( PageId ) )) - 1;
 
 /**
- * @brief Number of key slots in B+Tree leaf for STRING key.
+ * @brief Number of key slots in a format 1 to 3 B+Tree non-leaf for STRING key.
  */
-//                                                        level        extra pageNo             key                   pageNo
-const  int STRINGARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( 10 * sizeof(char) + sizeof( PageId ) );
+//                                                               level        extra pageNo             key                                 pageNo
+const  int STRINGARRAYNONLEAFSIZEFORMAT3 = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( STRINGSIZEFORMAT3 * sizeof(char) + sizeof( PageId ) );
+
+/**
+ * @brief Bytes at the start of a STRING node taken by its fixed fields, ahead of the slot array.
+ */
+const  int STRINGNODEHEADERSIZE = 16;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -165,6 +215,16 @@ struct IndexMetaInfo{
    * Page number of root page of the B+ Tree inside the file index file.
    */
   PageId rootPageNo;
+
+  /**
+   * Version of the index format. 0 in files written before versioning (format 1).
+   */
+  int version;
+
+  /**
+   * Number of levels in the tree, 1 when the root is a leaf.
+   */
+  int height;
 };
 
 /*
@@ -172,6 +232,13 @@ Each node is a page, so once we read the page in we just cast the pointer to the
 These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
 node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
 at this level are just above the leaf nodes. Otherwise set to 0.
+Format 1 nodes had no count. Non-leaf nodes now keep it in the upper half of the word format 1
+used for the level (always 0 there), leaf nodes keep it in the slack at the end of the page, so
+the array layout of format 1 nodes is unchanged.
+Format 3 leaves add the left sibling link after the count. Double and string leaves had room
+for it, integer leaves give up one key slot (see LeafNodeIntFormat2).
+Format 4 string nodes are slotted pages (see LeafNodeString); the fixed-width string nodes of
+format 1 to 3 are kept as LeafNodeStringFormat3 and NonLeafNodeStringFormat3.
 */
 
 /**
@@ -181,7 +248,12 @@ struct NonLeafNodeInt{
   /**
    * Level of the node in the tree.
    */
-  int level;
+  std::int16_t level;
+
+  /**
+   * Number of keys in the node. The node has count+1 children.
+   */
+  std::uint16_t count;
 
   /**
    * Stores keys.
@@ -201,7 +273,12 @@ struct NonLeafNodeDouble{
   /**
    * Level of the node in the tree.
    */
-  int level;
+  std::int16_t level;
+
+  /**
+   * Number of keys in the node. The node has count+1 children.
+   */
+  std::uint16_t count;
 
   /**
    * Stores keys.
@@ -216,24 +293,44 @@ struct NonLeafNodeDouble{
 
 /**
  * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ * A slotted page: the slot array grows from the front, the key heap from the back of the
+ * page. Slot i holds the offset, from the start of the node, of the entry of key i: the
+ * length of the key suffix (2 bytes), the page number of the child right of the key, then
+ * the suffix. The prefix every key of the node shares is kept once, in the last prefixLen
+ * bytes of the page. Keys are kept in order and compared byte by byte, like strcmp.
 */
 struct NonLeafNodeString{
   /**
    * Level of the node in the tree.
    */
-  int level;
+  std::int16_t level;
 
   /**
-   * Stores keys.
+   * Number of keys in the node. The node has count+1 children.
    */
-  char keyArray[ STRINGARRAYNONLEAFSIZE ][ STRINGSIZE ];
-  // not allowed
-  //std::string keyArray[ STRINGARRAYNONLEAFSIZE ];
+  std::uint16_t count;
 
   /**
-   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   * Page number of the child left of every key.
+   */
+  PageId firstChild;
+
+  /**
+   * Length of the prefix shared by every key of the node.
+   */
+  std::uint16_t prefixLen;
+
+  /**
+   * Offset of the first byte of the key heap from the start of the node.
    */
-  PageId pageNoArray[ STRINGARRAYNONLEAFSIZE + 1 ];
+  std::uint16_t heapStart;
+
+  std::uint32_t unused;
+
+  /**
+   * Slot array, sharing its space with the key heap.
+   */
+  std::uint16_t slotArray[ ( Page::SIZE - STRINGNODEHEADERSIZE ) / sizeof( std::uint16_t ) ];
 };
 
 /**
@@ -255,6 +352,17 @@ struct LeafNodeInt{
    * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
    */
   PageId rightSibPageNo;
+
+  /**
+   * Number of (key, rid) entries in the node.
+   */
+  int count;
+
+  /**
+   * Page number of the leaf on the left side, 0 for the leftmost leaf.
+   * Lets descending scans move from one leaf to the previous one.
+   */
+  PageId leftSibPageNo;
 };
 
 /**
@@ -276,132 +384,322 @@ struct LeafNodeDouble{
    * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
    */
   PageId rightSibPageNo;
+
+  /**
+   * Number of (key, rid) entries in the node.
+   */
+  int count;
+
+  /**
+   * Page number of the leaf on the left side, 0 for the leftmost leaf.
+   * Lets descending scans move from one leaf to the previous one.
+   */
+  PageId leftSibPageNo;
 };
 
 /**
  * @brief Structure for all leaf nodes when the key is of STRING type.
+ * A slotted page laid out as NonLeafNodeString, with the record id of each key in its
+ * entry in place of a child page number.
 */
 struct LeafNodeString{
   /**
-   * Stores keys.
+   * Page number of the leaf on the right side.
+   * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
    */
-  char keyArray[ STRINGARRAYLEAFSIZE ][ STRINGSIZE ];
-  // not allowed
-  //std::string keyArray[ STRINGARRAYNONLEAFSIZE ];
+  PageId rightSibPageNo;
 
   /**
-   * Stores RecordIds.
+   * Page number of the leaf on the left side, 0 for the leftmost leaf.
+   * Lets descending scans move from one leaf to the previous one.
    */
-  RecordId ridArray[ STRINGARRAYLEAFSIZE ];
+  PageId leftSibPageNo;
 
   /**
-   * Page number of the leaf on the right side.
-   * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   * Number of (key, rid) entries in the node.
+   */
+  std::uint16_t count;
+
+  /**
+   * Length of the prefix shared by every key of the node.
+   */
+  std::uint16_t prefixLen;
+
+  /**
+   * Offset of the first byte of the key heap from the start of the node.
    */
+  std::uint16_t heapStart;
+
+  std::uint16_t unused;
+
+  /**
+   * Slot array, sharing its space with the key heap.
+   */
+  std::uint16_t slotArray[ ( Page::SIZE - STRINGNODEHEADERSIZE ) / sizeof( std::uint16_t ) ];
+};
+
+/**
+ * @brief Leaf node for INTEGER keys as written by format 1 and 2, before leaves had a left
+ * sibling link. Only read when such a file is upgraded.
+*/
+struct LeafNodeIntFormat2{
+  int keyArray[ INTARRAYLEAFSIZEFORMAT2 ];
+  RecordId ridArray[ INTARRAYLEAFSIZEFORMAT2 ];
   PageId rightSibPageNo;
+  int count;
 };
 
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
+ * @brief Non-leaf node for STRING keys as written by format 1 to 3, with keys of
+ * STRINGSIZEFORMAT3 bytes. Only read when such a file is upgraded.
 */
-class BTreeIndex {
+struct NonLeafNodeStringFormat3{
+  std::int16_t level;
+  std::uint16_t count;
+  char keyArray[ STRINGARRAYNONLEAFSIZEFORMAT3 ][ STRINGSIZEFORMAT3 ];
+  PageId pageNoArray[ STRINGARRAYNONLEAFSIZEFORMAT3 + 1 ];
+};
 
- private:
+/**
+ * @brief Leaf node for STRING keys as written by format 1 to 3. Only read when such a file
+ * is upgraded.
+*/
+struct LeafNodeStringFormat3{
+  char keyArray[ STRINGARRAYLEAFSIZEFORMAT3 ][ STRINGSIZEFORMAT3 ];
+  RecordId ridArray[ STRINGARRAYLEAFSIZEFORMAT3 ];
+  PageId rightSibPageNo;
+  int count;
+  PageId leftSibPageNo;
+};
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE, "NonLeafNodeInt must fit in a page");
+static_assert(sizeof(NonLeafNodeDouble) <= Page::SIZE, "NonLeafNodeDouble must fit in a page");
+static_assert(sizeof(NonLeafNodeString) == Page::SIZE, "NonLeafNodeString must fill a page");
+static_assert(sizeof(LeafNodeInt) <= Page::SIZE, "LeafNodeInt must fit in a page");
+static_assert(sizeof(LeafNodeDouble) <= Page::SIZE, "LeafNodeDouble must fit in a page");
+static_assert(sizeof(LeafNodeString) == Page::SIZE, "LeafNodeString must fill a page");
+static_assert(sizeof(LeafNodeIntFormat2) <= Page::SIZE, "LeafNodeIntFormat2 must fit in a page");
+static_assert(sizeof(NonLeafNodeStringFormat3) <= Page::SIZE, "NonLeafNodeStringFormat3 must fit in a page");
+static_assert(sizeof(LeafNodeStringFormat3) <= Page::SIZE, "LeafNodeStringFormat3 must fit in a page");
+
+/**
+ * @brief What the tree code needs to know about a key type T: the nodes keys of type T are
+ * kept in, how two keys compare, and how a key is copied in and out of a raw key buffer of
+ * bytesSize() bytes. The tree code is templated on T alone and looks everything up here,
+ * so attributeType is only looked at where a call comes into the index.
+ * Specialized for int, double and char* (NUL-terminated string keys).
+*/
+template<class T> struct KeyTraits;
+
+/**
+ * @brief KeyTraits of a key type compared with < and copied byte for byte.
+*/
+template<class T, class L_T, class NL_T> struct ScalarKeyTraits {
+  typedef L_T Leaf;
+  typedef NL_T NonLeaf;
 
   /**
-   * File object for the index file.
+   * Compare two keys, like strcmp.
    */
-  File    *file;
+  static int compare(T k1, T k2)
+  {
+    return (k1 > k2) - (k1 < k2);
+  }
 
   /**
-   * Buffer Manager Instance.
+   * Size of the raw key buffer a key is copied into.
    */
-  BufMgr  *bufMgr;
+  static size_t bytesSize()
+  {
+    return sizeof(T);
+  }
 
   /**
-   * Page number of meta page.
+   * Key stored in a raw key buffer.
    */
-  PageId  headerPageNum;
+  static T fromBytes(const char* bytes)
+  {
+    T key;
+    memcpy(&key, bytes, sizeof(T));
+    return key;
+  }
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Copy a key into a raw key buffer.
    */
-  PageId  rootPageNum;
+  static void toBytes(char* bytes, T key)
+  {
+    memcpy(bytes, &key, sizeof(T));
+  }
 
   /**
-   * Datatype of attribute over which index is built.
+   * Key passed to the public interface of the index, through a buffer of STRINGSIZE bytes.
    */
-  Datatype  attributeType;
+  static T fromParam(const void* key, char* bytes)
+  {
+    return fromBytes((const char*) key);
+  }
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Copy the key of a record field of avail bytes into a raw key buffer.
+   *
+   * @return  bytes of the buffer the key takes
    */
-  int     attrByteOffset;
+  static size_t recordToBytes(char* bytes, const char* field, size_t avail)
+  {
+    memcpy(bytes, field, sizeof(T));
+    return sizeof(T);
+  }
+};
+
+template<> struct KeyTraits<int> : ScalarKeyTraits<int, LeafNodeInt, NonLeafNodeInt> {};
+template<> struct KeyTraits<double> : ScalarKeyTraits<double, LeafNodeDouble, NonLeafNodeDouble> {};
+
+/**
+ * @brief KeyTraits of STRING keys. A key points at its bytes, which a raw key buffer holds
+ * NUL-terminated; keys longer than STRINGSIZE - 1 bytes are cut short.
+*/
+template<> struct KeyTraits<char*> {
+  typedef LeafNodeString Leaf;
+  typedef NonLeafNodeString NonLeaf;
+
+  static int compare(const char* k1, const char* k2)
+  {
+    return strcmp(k1, k2);
+  }
+
+  static size_t bytesSize()
+  {
+    return STRINGSIZE;
+  }
+
+  static char* fromBytes(char* bytes)
+  {
+    return bytes;
+  }
+
+  static void toBytes(char* bytes, const char* key)
+  {
+    memmove(bytes, key, strlen(key) + 1);
+  }
+
+  static char* fromParam(const void* key, char* bytes)
+  {
+    snprintf(bytes, STRINGSIZE, "%s", (const char*) key);
+    return bytes;
+  }
+
+  static size_t recordToBytes(char* bytes, const char* field, size_t avail)
+  {
+    size_t len = strnlen(field, std::min((size_t) STRINGSIZE - 1, avail));
+    memcpy(bytes, field, len);
+    bytes[len] = '\0';
+    return len + 1;
+  }
+};
+
+/**
+ * @brief Access to the entries of a leaf node of type L_T, whatever its layout. Integer and
+ * double leaves keep sorted key and rid arrays, string leaves are slotted pages.
+ * Every specialization has the same static functions: init, lowerBound, upperBound,
+ * compareAt, keyBytesAt, ridAt, copyRids, fits, insertAt, splitPoint, moveTail,
+ * separator and fill. Keys are copied out in the layout of KeyTraits::toBytes.
+*/
+template<class L_T> struct LeafLayout;
+
+/**
+ * @brief Access to the keys and children of a non-leaf node of type NL_T, whatever its
+ * layout. Every specialization has the same static functions: lowerBound, upperBound,
+ * compareAt, keyBytesAt, childAt, fits, safe, insertAt, build, splitPoint and fill.
+*/
+template<class NL_T> struct NonLeafLayout;
+
+class BTreeIndex;
+
+/**
+ * @brief Position of one range scan over a BTreeIndex.
+ * A cursor is returned by BTreeIndex::openScan and owns its range, its position and the
+ * leaf page it is on, which stays pinned until the cursor moves past it or is deleted.
+ * The leaf is latched only while a call on the cursor runs, so inserts into it can go
+ * ahead between calls. Any number of cursors can be open on one index at the same time,
+ * from any number of threads, but one cursor must not be used by two threads at once.
+ * Cursors must be deleted before the index they scan.
+ * A descending cursor returns entries with equal keys in the reverse of the order an
+ * ascending one does.
+*/
+class ScanCursor {
+  friend class BTreeIndex;
+
+ private:
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Index being scanned.
    */
-  int     leafOccupancy;
+  BTreeIndex  *index;
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Order the entries are returned in.
    */
-  int     nodeOccupancy;
-
+  ScanOrder order;
 
-  // MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   * -1 when a descending scan is past the first entry of the leaf.
+   */
+  int     nextEntry;
 
   /**
-   * True if an index scan has been started.
+   * Current page being scanned, empty once the scan is completed.
+   * Latched shared only while a call on the cursor runs.
    */
-  bool    scanExecuting;
+  PageHandle currentPage;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Version of the current page when its latch was last released. A different version
+   * when the latch is taken again means the leaf changed in between.
    */
-  int     nextEntry;
+  std::uint64_t pageVersion;
 
   /**
-   * Page number of current page being scanned.
+   * Key of the last entry returned, in the layout of the key arrays.
    */
-  PageId  currentPageNum;
+  char    lastKey[STRINGSIZE];
 
   /**
-   * Current Page being scanned.
+   * Record id of the last entry returned.
    */
-  Page    *currentPageData;
+  RecordId lastRid;
 
   /**
-   * Low INTEGER value for scan.
+   * Number of entries returned with a key equal to lastKey.
    */
-  int     lowValInt;
+  int     lastKeyDups;
 
   /**
-   * Low DOUBLE value for scan.
+   * True once an entry has been returned.
    */
-  double  lowValDouble;
+  bool    hasLastKey;
 
   /**
-   * Low STRING value for scan.
+   * Does the scan have a low bound? If not the low value and operator are unused.
    */
-  std::string lowValString;
+  bool    hasLowVal;
 
   /**
-   * High INTEGER value for scan.
+   * Does the scan have a high bound? If not the high value and operator are unused.
    */
-  int     highValInt;
+  bool    hasHighVal;
 
   /**
-   * High DOUBLE value for scan.
+   * Low value for scan, in the layout of KeyTraits::toBytes.
    */
-  double  highValDouble;
+  char    lowVal[STRINGSIZE];
 
   /**
-   * High STRING value for scan.
+   * High value for scan, in the layout of KeyTraits::toBytes.
    */
-  std::string highValString;
-  
+  char    highVal[STRINGSIZE];
+
   /**
    * Low Operator. Can only be GT(>) or GTE(>=).
    */
@@ -412,19 +710,300 @@ class BTreeIndex {
    */
   Operator  highOp;
 
+  /**
+   * Number of leaves kept prefetched ahead of the current one, 0 for none.
+   */
+  int     readAheadWindow;
+
+  /**
+   * Leaves after the current one in scan order, as far as they are known from the
+   * parent of a leaf and lie within the range.
+   */
+  std::vector<PageId> upcomingLeaves;
+
+  /**
+   * First of upcomingLeaves the scan has not reached yet.
+   */
+  size_t  upcomingPos;
+
+  /**
+   * upcomingLeaves before this one have been prefetched.
+   */
+  size_t  prefetchedUpTo;
+
+  /**
+   * True if upcomingLeaves reaches the end of the range, so no more are to be learnt.
+   */
+  bool    upcomingComplete;
+
+  /**
+   * True once the scan has moved past upcomingLeaves; the next ones are learnt from the
+   * parent of the current leaf at the end of the call.
+   */
+  bool    needsUpcoming;
+
+  /**
+   * Key of the current leaf the parent is found with when needsUpcoming is set.
+   */
+  char    upcomingKey[STRINGSIZE];
+
+  /**
+   * Cursors are created by BTreeIndex::openScan.
+   *
+   * @param index       index to scan
+   */
+  ScanCursor(BTreeIndex *index);
+
+  ScanCursor(const ScanCursor&) = delete;
+  ScanCursor& operator=(const ScanCursor&) = delete;
+
+  /**
+   * Low (high is false) or high (high is true) value of the scan.
+   */
+  template<class T> T bound(bool high);
+
+  /**
+   * Find the first entry of the scan from the root: at the low bound of an ascending scan,
+   * at the high bound of a descending one, or at the first or last entry of the index
+   * when there is no such bound.
+   */
+  template<class T> void seekStart();
+
+  /**
+   * Move to the next leaf in scan order while the cursor is past the end of its leaf.
+   * Unpins the leaf and marks the scan completed when there is no such leaf.
+   * Called with the current leaf latched. A right sibling is latched before the leaf is
+   * let go of. Latches are only ever waited for left to right, so a left sibling is
+   * latched after the leaf is let go of, and the position is found again from the root
+   * if the left sibling was split in between.
+   */
+  template<class T> void skipExhaustedLeaves();
+
+  /**
+   * Take the leaves after childPos in scan order from the parent of the current leaf,
+   * stopping at the first one wholly outside the range, and prefetch the first of them.
+   *
+   * @param parent      non-leaf node at level 1, latched by the caller
+   * @param childPos    position of the current leaf in parent
+   */
+  template<class T> void learnUpcoming(typename KeyTraits<T>::NonLeaf* parent, int childPos);
+
+  /**
+   * Note that the scan moved to a leaf and prefetch the leaves that came into the window.
+   *
+   * @param pageNo      page number of the leaf
+   * @param leaf        the leaf, latched
+   */
+  template<class T> void enterLeaf(PageId pageNo, typename KeyTraits<T>::Leaf* leaf);
+
+  /**
+   * Hand the upcoming leaves within the window that were not prefetched yet to the buffer manager.
+   */
+  void prefetchUpcoming();
+
+  /**
+   * Learn the next leaves from the parent of the current one if the scan has moved past
+   * upcomingLeaves. Called with no page latched.
+   */
+  template<class T> void refillUpcoming();
+
+  /**
+   * Find the position after the last entry returned from the root, or the first entry
+   * of the scan if none was returned yet.
+   */
+  template<class T> void reposition();
+
+  /**
+   * Latch the current leaf again at the start of a call. If the leaf changed since the
+   * last call, reposition the cursor.
+   *
+   * @return  false if the scan is completed
+   */
+  template<class T> bool resume();
+
+  /**
+   * Release the latch on the current leaf at the end of a call. The leaf stays pinned.
+   */
+  void suspend();
+
+  /**
+   * Remember the last of a run of entries of a leaf being returned.
+   *
+   * @param leaf        leaf the entries are on
+   * @param first       first entry of the run returned
+   * @param last        last entry of the run returned, right of first in an ascending scan
+   *                    and left of it in a descending one
+   */
+  template<class T> void rememberLast(typename KeyTraits<T>::Leaf* leaf, int first, int last);
+
+  /**
+   * Is the entry under the cursor within the bound the scan ends at?
+   */
+  template<class T> bool inRange();
+
+  /**
+   * Fetch the next record id and move past it.
+   *
+   * @param outRid      record id of the entry under the cursor
+   */
+  template<class T> void next(RecordId& outRid);
+
+  /**
+   * Copy the record ids of up to maxRids matching entries and move past them.
+   *
+   * @param outRids     array the record ids are copied to
+   * @param maxRids     size of outRids
+   * @return  number of record ids copied
+   */
+  template<class T> size_t nextBatch(RecordId* outRids, size_t maxRids);
+
+  /**
+   * Unlatch and unpin the current leaf and mark the scan completed.
+   */
+  void release();
+
+ public:
+
+  /**
+   * Unpin the leaf the cursor is on, if any.
+   */
+  ~ScanCursor();
+
+  /**
+   * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid  RecordId of next record found that satisfies the scan criteria returned in this
+   * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+  **/
+  const void scanNext(RecordId& outRid);
+
+  /**
+   * Fetch the record ids of the next index entries that match the scan, a run of a leaf at a time.
+   * Unlike scanNext, the end of the scan is reported through the return value.
+   * @param outRids  Array the record ids are copied to, in scan order
+   * @param maxRids  Size of outRids
+   * @return  Number of record ids copied. Less than maxRids only once the scan is completed, 0 after that.
+  **/
+  size_t scanNextBatch(RecordId* outRids, size_t maxRids);
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. Any number of scans can run through cursors from openScan; startScan,
+ * scanNext and endScan drive one more scan kept by the index itself.
+ *
+ * insertEntry and cursors from openScan may be used by many threads at once. They latch
+ * pages top-down through the buffer manager, with the meta page latch guarding the root
+ * page number and the height. startScan, scanNext and endScan are for one thread only.
+*/
+class BTreeIndex {
+  friend class ScanCursor;
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+  File    *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr  *bufMgr;
+
+  /**
+   * Buffer Manager the relation is scanned through when the index is bulk loaded.
+   */
+  BufMgr  *relationBufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId  headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+  PageId  rootPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype  attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+  int     attrByteOffset;
+
+  /**
+   * Fraction of the key slots (the bytes of a STRING node) of each node filled when the
+   * index is bulk loaded.
+   */
+  double  fillFactor;
+
+  /**
+   * Number of leaves scans opened from now on keep prefetched ahead of the one they are on.
+   */
+  int     readAheadLeaves;
+
+
+  // MEMBERS SPECIFIC TO SCANNING
+
+  /**
+   * Scan driven by startScan, scanNext and endScan. NULL if no such scan is executing.
+   */
+  ScanCursor *currentScan;
+
   ///////////////////////
   // Custom Variables //
   /////////////////////
 
-  bool rootIsLeaf; // if the root node is a LeafNode
+  /**
+   * Number of levels in the tree, 1 when the root is a leaf.
+   * Read and changed, with rootPageNum, under the latch of the meta page.
+   */
+  int height;
+
+  /**
+   * Pages of an old tree the nodes of a bulk load are put in before new pages are allocated,
+   * the one to take first at the back.
+   */
+  std::vector<PageId> reusablePages;
+
+  /**
+   * Non-leaf node latched by an insert on its way down.
+   */
+  struct PathEntry {
+    PageId pageNo;
+    Page* page;
+    int childPos; // position of the child followed
+  };
 
   ///////////////////////
   // Custom Functions //
   /////////////////////
 
+  /**
+   * Name of the index file of a relation and attribute, "relationName.attrByteOffset".
+   */
+  static std::string indexFileName(const std::string & relationName, const int attrByteOffset);
+
+  /**
+   * Open the index file if it exists, create and bulk load it otherwise. Called by the
+   * constructors once bufMgr and relationBufMgr are set.
+   *
+   * @param relationName      Name of relation file.
+   * @param indexName         Name of index file.
+   * @param attrByteOffset    Offset of the attribute to build the index
+   * @param attrType          Datatype of attribute over which index is built
+   * @param fillFactor        Fraction of each node filled by a bulk load
+   */
+  void open(const std::string & relationName, const std::string & indexName,
+            const int attrByteOffset, const Datatype attrType, const double fillFactor);
+
   /**
    * Open an existing index file. Save the member attributes (attrByteOffset, 
-   * attributeType, rootPageNum, rootIsLeaf). Throw BadIndexInfoException() 
+   * attributeType, rootPageNum, height). Throw BadIndexInfoException() 
    * when the info does not match.
    *
    * @param relationName      Name of relation file.
@@ -436,7 +1015,7 @@ class BTreeIndex {
   
   /**
    * Create a new index file (when not already exist). Construct metaInfoPage. 
-   * Scan relational file
+   * Scan relational file, collect every (key, rid) pair and bulk load them.
    *
    * @param relationName      Name of relation file.
    * @param attrByteOffset    Offset of the attribute to build the index
@@ -444,112 +1023,239 @@ class BTreeIndex {
    */
   const void createIndexFile(const std::string & relationName, const int attrByteOffset, const Datatype attrType);
 
+  /**
+   * Set up the root leaf of a new index, scan the relation file for every (key, rid) pair
+   * and bulk load them.
+   *
+   * @param relationName      Name of relation file.
+   * @param rootPage          the root page, pinned; unpinned here
+   */
+  template<class T> void loadRelation(const std::string & relationName, Page* rootPage);
+
   
   
   /**
-   * Insert an entry to root leaf node. 
-   * If the root is not full, call putEntryLeaf()
-   * If the root is full, call splitLeaf() then createNewRoot()
+   * Build the tree bottom-up from the (key, rid) pairs of the relation.
+   * Sort the pairs, pack them into leaves (starting with the root leaf page) filled
+   * up to fillFactor, then build each non-leaf level over the level below
+   * until a single root remains. A leaf is told from the one before it by the shortest
+   * separator LeafLayout::separator finds between them.
    *
-   * @param RIDPair     the entry pair (key, rid) to insert
+   * @param entries     all (key, rid) pairs of the relation, sorted in place
    */
-  template<class T, class L_T,class NL_T,class P_T, class RID_T> void insertRootLeaf(RID_T RIDPair);
+  template<class T> void bulkLoad(std::vector<RIDKeyPair<T> >& entries);
 
   /**
-   * Put an entry on a leaf node.
-   * Find the index of insertion pos. Shift (key,rid) after pos 1 slot to the right.
+   * Build one non-leaf level over the nodes of the level below.
+   *
+   * @param children    (separator, pageNo) of every node on the level below, replaced
+   *                    by the (separator, pageNo) of every node on the new level; the
+   *                    separator of the first node is not used
+   * @param level       level value of the new nodes (1 if the children are leaves)
+   */
+  template<class T> void buildNonLeafLevel(std::vector<PageKeyPair<T> >& children, int level);
+
+  /**
+   * Allocate a page for a node being bulk loaded, taking one of reusablePages if there is any.
+   *
+   * @param pageNo      page number, returned
+   * @param page        the page, pinned, returned
+   * @param strategy    how the buffer manager is to keep the page
+   */
+  void allocNodePage(PageId& pageNo, Page*& page, const AccessStrategy strategy = ACCESS_NORMAL);
+
+  /**
+   * Pin and latch a page of the index.
+   *
+   * @param pageNo      page number
+   * @param page        the page, returned
+   * @param mode        latch mode
+   */
+  void readLatched(PageId pageNo, Page*& page, LatchMode mode);
+
+  /**
+   * Pin and latch a page of the index through a handle, which releases both.
+   *
+   * @param pageNo      page number
+   * @param mode        latch mode
+   * @return            handle on the page
+   */
+  PageHandle readLatched(PageId pageNo, LatchMode mode);
+
+  /**
+   * Unlatch and unpin a page latched with readLatched.
+   *
+   * @param pageNo      page number
+   * @param mode        latch mode the page was latched in
+   * @param dirty       was the page changed?
+   */
+  void releaseLatched(PageId pageNo, LatchMode mode, bool dirty);
+
+  /**
+   * insertEntry for keys of type T.
+   *
+   * @param key         key as passed to insertEntry
+   * @param rid         record id of the entry
+   */
+  template<class T> void insertEntryAs(const void* key, const RecordId rid);
+
+  /**
+   * openScan for keys of type T, once the operators are checked.
+   */
+  template<class T> ScanCursor* openScanAs(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+                                           const ScanOrder order);
+
+  /**
+   * Insert an entry, first with insertOptimistic and with insertPessimistic if that
+   * finds the leaf full.
+   *
+   * @param entry       the entry pair (key, rid) to insert
+   */
+  template<class T> void insert(RIDKeyPair<T> entry);
+
+  /**
+   * Descend with shared latches, latch the leaf exclusive and insert the entry if it fits.
+   *
+   * @param entry       the entry pair (key, rid) to insert
+   * @return  false if the leaf is full and nothing was changed
+   */
+  template<class T> bool insertOptimistic(RIDKeyPair<T> entry);
+
+  /**
+   * Descend with exclusive latches, releasing the latches above every node that has room
+   * for one more entry, then insert the entry and split nodes bottom-up as far as needed.
+   * The root is split, and the meta page changed, while the meta page is still latched.
+   *
+   * @param entry       the entry pair (key, rid) to insert
+   */
+  template<class T> void insertPessimistic(RIDKeyPair<T> entry);
+
+  /**
+   * Put an entry on a leaf node that is not full.
+   * Find the index of insertion pos, after any equal keys. Shift (key,rid) after pos 1 slot to the right.
    * Then insert the entry at pos.
    *
    * @param leafNode    the leaf node to insert on
    * @param RIDPair     the entry pair (key, rid) to insert
    */
-  template<class T, class L_T,class RID_T> void putEntryLeaf(L_T* leafNode, RID_T RIDPair);
+  template<class T> void putEntryLeaf(typename KeyTraits<T>::Leaf* leafNode, RIDKeyPair<T> RIDPair);
 
   /**
-   * Put an entry on a non-leaf node.
-   * Find the index of insertion pos. Shift (key,pageNo) after pos 1 slot to the right.
-   * Then insert the entry at pos.
+   * Put an entry on a non-leaf node that is not full.
+   * Shift keys from pos and the children right of them 1 slot to the right.
+   * Then insert the key at pos and the page right of it.
    *
-   * @param leafNode    the leaf node to insert on
+   * @param nonLeafNode the non-leaf node to insert on
+   * @param pos         position of the child that was split
    * @param PagePair    the entry pair (key,pageNo) to insert
    */
-  template<class T, class NL_T,class P_T> void putEntryNonLeaf(NL_T* nonLeafNode, P_T PagePair);
+  template<class T> void putEntryNonLeaf(typename KeyTraits<T>::NonLeaf* nonLeafNode, int pos, PageKeyPair<T> PagePair);
 
   /**
-   * Split a leaf node when it will be full after the current insertion.
+   * Split a full leaf node in two and insert the entry into one of them.
+   * The left sibling link of the leaf right of the new one is updated under its own latch.
    *
+   * @param leafPageNo  page number of the leaf node
    * @param leafNode    the leaf node to split
    * @param RIDPair     the entry pair (key,rid) to insert
    * @param rightFirst  the (key,pageNo) pair return to the parent non-leaf node
+   * @param splitKey    buffer of STRINGSIZE bytes the key of rightFirst is kept in
    */
-  template<class T, class L_T,class P_T,class RID_T> void splitLeaf(L_T* leafNode, RID_T RIDPair, P_T& rightFirst);
+  template<class T> void splitLeaf(PageId leafPageNo, typename KeyTraits<T>::Leaf* leafNode, RIDKeyPair<T> RIDPair, PageKeyPair<T>& rightFirst, char* splitKey);
 
   /**
-   * Split a non-leaf node when it will be full after the current insertion.
+   * Split a full non-leaf node in two and insert the entry into one of them.
+   * The middle key moves up to the parent.
    *
-   * @param leafNode            the node to split
+   * @param nonLeafNode         the node to split
+   * @param pos                 position of the child that was split
    * @param pagePair2insert     the entry pair (key,pageNo) to insert
    * @param rightFirstPage      the (key,pageNo) pair return to the parent non-leaf node
+   * @param splitKey            buffer the key of rightFirstPage is kept in, may hold the key of pagePair2insert
    */ 
-  template<class T, class NL_T,class P_T> void splitNonLeaf(NL_T* leafNode, P_T pagePair2insert, P_T& rightFirstPage);
+  template<class T> void splitNonLeaf(typename KeyTraits<T>::NonLeaf* nonLeafNode, int pos, PageKeyPair<T> pagePair2insert, PageKeyPair<T>& rightFirstPage, char* splitKey);
 
   /**
-   * Create a new root node (non-leaf).
+   * Create a new root node (non-leaf). Called with the meta page latched exclusive.
    *
    * @param left        the pageNo of the node to be inserted at [0]
    * @param rightFirst  the (key,pageNo) of the node to be inserted at [1] 
    * @param isLeaf      indicates the child level is leaf (if so we should set level to 1)
+   * @param meta        the meta page
    */ 
-  template<class T, class L_T,class NL_T,class P_T,class RID_T> void createNewRoot(PageId left, P_T rightFirst, bool isLeaf);
+  template<class T> void createNewRoot(PageId left, PageKeyPair<T> rightFirst, bool isLeaf, IndexMetaInfo* meta);
 
   /**
-   * Traverse down to the leaf level of the BTree.
+   * Position a cursor on the first entry greater than (GT) or not less than (GTE) a key,
+   * or on the last entry less than (LT) or not greater than (LTE) it, crabbing down with
+   * shared latches. Leaves the leaf holding that entry pinned and latched, or the cursor
+   * completed if there is none.
    *
-   * @param currPageNo       current page number
-   * @param newPagePair      new page pair to return to upper level if split happens 
-   * @param RIDPair2insert   the (key,rid) pair to insert
-   */ 
-  template<class T, class L_T,class NL_T,class P_T,class RID_T> void traverse(PageId currPageNo, P_T& newPagePair, RID_T RIDPair2insert);
+   * @param cursor      cursor with its range set
+   * @param key         key to seek, NULL for the first (GT, GTE) or last (LT, LTE) entry
+   * @param op          GT, GTE, LT or LTE
+   */
+  template<class T> void seek(ScanCursor* cursor, const T* key, Operator op);
 
   /**
-   * Helper function template to assign char* value.
+   * Crab down with shared latches to the parent of the leaf a key leads to, and let a
+   * cursor learn the leaves that follow it. Nothing is done if the root is a leaf.
    *
-   * @param a  destination
-   * @param b  source
-   */ 
-  template<class T> void assign (T a, T b);
+   * @param cursor      cursor to learn the leaves
+   * @param key         key in the leaf
+   * @param op          GTE to take the leftmost leaf the key may be in, LTE the rightmost
+   */
+  template<class T> void findUpcomingLeaves(ScanCursor* cursor, T key, Operator op);
 
   /**
-   * Helper function to assign int and double value.
+   * Upgrade an index file of an older format to the current format.
+   * Format 1 nodes have no count, so it is recovered from the first empty rid/page slot
+   * of every node, and the root is a leaf exactly when it is page 2.
+   * Leaves of format 1 and 2 get their left sibling links; an entry that no longer fits
+   * its leaf is handed back to be inserted again once the index is open.
    *
-   * @param des  destination
-   * @param src  source
+   * @param meta        the meta page (pinned by the caller)
+   * @param rids        record ids of the entries to insert again, returned
+   * @param keys        keys of those entries, one key array slot each, returned
    */
-  void assignPrime (void* des, void* src);
+  template<class L_T,class OLD_L_T,class NL_T> void upgradeIndexFile(IndexMetaInfo* meta, std::vector<RecordId>& rids, std::vector<char>& keys);
 
   /**
-   * Find position of the desired node when scanning.
+   * Upgrade a STRING index file of an older format to the current format. Counts are
+   * recovered as for upgradeIndexFile, then the tree is built again in slotted nodes.
    *
-   * @param leaf        is the node we are scanning a leaf?
-   * @param nonleaf     is the node we are scanning a non-leaf?
-   * @param tmpPageNo   
-   * @param lowVal
+   * @param meta        the meta page (pinned by the caller)
    */
-  template<class T, class L_T,class NL_T,class P_T,class RID_T> int findPos(bool leaf, bool nonleaf, PageId tmpPageNo, T lowVal);
+  void upgradeStringIndexFile(IndexMetaInfo* meta);
 
   /**
-   * Scan.
+   * Build a tree of fixed-width string nodes again in slotted nodes, reusing the pages of
+   * the old tree. The old nodes only kept the first STRINGSIZEFORMAT3 bytes of each key,
+   * so the entries are loaded from the relation named in the meta page instead.
    *
-   * @param
+   * @param meta        the meta page (pinned by the caller)
    */
-  template<class T, class L_T,class NL_T,class P_T,class RID_T> void scan(T type);
+  void rebuildStringIndex(IndexMetaInfo* meta);
 
   /**
-   * Comparators
+   * Store the count of a format 1 node and of every node below it.
+   *
+   * @param pageNo      page number of the node
+   * @param isLeaf      is the node a leaf?
+   * @return  height of the subtree rooted at the node
    */
-  int compareKey(void* k1, void* k2);
+  template<class L_T,class NL_T> int upgradeNode(PageId pageNo, bool isLeaf);
+
+  /**
+   * Rewrite every format 2 leaf, left to right, in the current leaf layout and link it
+   * to its left sibling.
+   *
+   * @param meta        the meta page (pinned by the caller)
+   * @param rids        record ids of the entries that no longer fit their leaf, returned
+   * @param keys        keys of those entries, one key array slot each, returned
+   */
+  template<class L_T,class OLD_L_T,class NL_T> void linkLeaves(IndexMetaInfo* meta, std::vector<RecordId>& rids, std::vector<char>& keys);
 
-  template<class T> int compare(T k1, T k2);
 
 
  public:
@@ -557,17 +1263,36 @@ class BTreeIndex {
   /**
    * BTreeIndex Constructor. 
    * Check to see if the corresponding index file exists. If so, open the file.
-   * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+   * If not, create it and bulk load the entries of every tuple in the base relation using FileScan class.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn            Buffer Manager Instance
    * @param attrByteOffset      Offset of attribute, over which index is to be built, in the record
    * @param attrType            Datatype of attribute over which index is built
+   * @param fillFactor          Fraction of each node filled when a new index is bulk loaded (0 < fillFactor <= 1)
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
    */
   BTreeIndex(const std::string & relationName, std::string & outIndexName,
-            BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType);
+            BufMgr *bufMgrIn, const int attrByteOffset, const Datatype attrType,
+            const double fillFactor = DEFAULTFILLFACTOR);
+
+  /**
+   * BTreeIndex Constructor taking its buffer pools from a pool set: the pages of the index
+   * file go to the pool its name is routed to, and the relation is scanned for a bulk load
+   * through the pool the relation is routed to. Otherwise like the constructor above.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param pools               Pool set with at least one pool
+   * @param attrByteOffset      Offset of attribute, over which index is to be built, in the record
+   * @param attrType            Datatype of attribute over which index is built
+   * @param fillFactor          Fraction of each node filled when a new index is bulk loaded (0 < fillFactor <= 1)
+   * @throws  BadIndexInfoException     If the pool set has no pools, or if the index file already exists for the corresponding attribute, but values in metapage do not match with values received through constructor parameters.
+   */
+  BTreeIndex(const std::string & relationName, std::string & outIndexName,
+            BufferPools *pools, const int attrByteOffset, const Datatype attrType,
+            const double fillFactor = DEFAULTFILLFACTOR);
   
 
   /**
@@ -591,6 +1316,24 @@ class BTreeIndex {
   const void insertEntry(const void* key, const RecordId rid);
 
 
+  /**
+   * Open a new scan of the index, independent of any other scan.
+   * The range is given as for startScan. The cursor starts on the first entry that satisfies
+   * the scan in its order and keeps the leaf of that entry pinned. The caller deletes the cursor.
+   * @param lowVal  Low value of range, pointer to integer / double / char string, NULL for no low bound
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, pointer to integer / double / char string, NULL for no high bound
+   * @param highOp  High operator (LT/LTE)
+   * @param order   ASCENDING to start at the low bound, DESCENDING to start at the high bound
+   * @return  the new cursor
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+  **/
+  ScanCursor* openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+                       const ScanOrder order = ASCENDING);
+
+
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called 
    * using ("a",GT,"d",LTE) then we should seek all entries with a value 
@@ -598,20 +1341,23 @@ class BTreeIndex {
    * If another scan is already executing, that needs to be ended here.
    * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
    * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
-   * @param lowVal  Low value of range, pointer to integer / double / char string
+   * Either value may be NULL for a range open at that end; its operator is then ignored.
+   * @param lowVal  Low value of range, pointer to integer / double / char string, NULL for no low bound
    * @param lowOp   Low operator (GT/GTE)
-   * @param highVal High value of range, pointer to integer / double / char string
+   * @param highVal High value of range, pointer to integer / double / char string, NULL for no high bound
    * @param highOp  High operator (LT/LTE)
+   * @param order   ASCENDING to scan from the low bound up, DESCENDING from the high bound down
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
    * @throws  BadScanrangeException If lowVal > highval
    * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
   **/
-  const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+  const void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+                       const ScanOrder order = ASCENDING);
 
 
   /**
    * Fetch the record id of the next index entry that matches the scan.
-   * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
+   * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page (left sibling for a descending scan), if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
    * @param outRid  RecordId of next record found that satisfies the scan criteria returned in this
    * @throws ScanNotInitializedException If no scan has been initialized.
    * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
@@ -619,6 +1365,25 @@ class BTreeIndex {
   const void scanNext(RecordId& outRid);  // returned record id
 
 
+  /**
+   * Fetch the record ids of the next index entries that match the scan.
+   * @see ScanCursor::scanNextBatch
+   * @param outRids  Array the record ids are copied to, in scan order
+   * @param maxRids  Size of outRids
+   * @return  Number of record ids copied. Less than maxRids only once the scan is completed, 0 after that.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+  **/
+  size_t scanNextBatch(RecordId* outRids, size_t maxRids);
+
+
+  /**
+   * Set the number of leaves scans opened from now on keep prefetched from disk ahead of
+   * the leaf they are on. The page numbers are taken from the parents of the leaves.
+   * @param leaves  Number of leaves, 0 to read leaves only when a scan gets to them
+  **/
+  void setReadAhead(int leaves);
+
+
   /**
    * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
    * @throws ScanNotInitializedException If no scan has been initialized.
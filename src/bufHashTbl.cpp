@@ -7,108 +7,135 @@
 
 #include <memory>
 #include <iostream>
+#include <utility>
 #include "buffer.h"
 #include "bufHashTbl.h"
-#include "exceptions/hash_already_present_exception.h"
-#include "exceptions/hash_not_found_exception.h"
-#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint32_t BufHashTbl::hash(const File* file, const PageId pageNo) const
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // mix both halves of the key into every bit (the finalizer of MurmurHash3), since
+  // file objects are aligned and page numbers of a file are dense
+  std::uint64_t value = (std::uint64_t) (std::uintptr_t) file * 0x9e3779b97f4a7c15ULL + pageNo;
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return (std::uint32_t) value & (capacity - 1);
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+BufHashTbl::BufHashTbl(const std::uint32_t entries)
+	: capacity(0), maxEntries(0), numEntries(0), slots(NULL)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  resize(entries);
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  delete [] slots;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+std::uint32_t BufHashTbl::find(const File* file, const PageId pageNo) const
 {
-  int index = hash(file, pageNo);
+  std::uint32_t index = hash(file, pageNo);
+
+  // an entry closer to its home slot than the key would be means the key is not there
+  for (std::uint32_t distance = 0; slots[index].file != NULL && slots[index].distance >= distance; distance++)
+  {
+    if (slots[index].file == file && slots[index].pageNo == pageNo)
+      return index;
+    index = (index + 1) & (capacity - 1);
+  }
+  return capacity;
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+bool BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  if (numEntries == maxEntries || find(file, pageNo) != capacity)
+  	return false;
+
+  Slot entry;
+  entry.file = file;
+  entry.pageNo = pageNo;
+  entry.frameNo = frameNo;
+  entry.distance = 0;
+
+  // take the place of any entry closer to its home slot, and carry that one on
+  std::uint32_t index = hash(file, pageNo);
+  while (slots[index].file != NULL)
+  {
+    if (slots[index].distance < entry.distance)
+      std::swap(slots[index], entry);
+    index = (index + 1) & (capacity - 1);
+    entry.distance++;
   }
+  slots[index] = entry;
+  numEntries++;
+  return true;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+bool BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) const
+{
+  std::uint32_t index = find(file, pageNo);
+  if (index == capacity)
+    return false;
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  frameNo = slots[index].frameNo; // return frameNo by reference
+  return true;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
-{
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+bool BufHashTbl::remove(const File* file, const PageId pageNo) {
+
+  std::uint32_t index = find(file, pageNo);
+  if (index == capacity)
+    return false;
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  // shift the entries after it back until one is in its home slot
+  std::uint32_t next = (index + 1) & (capacity - 1);
+  while (slots[next].file != NULL && slots[next].distance > 0)
+  {
+    slots[index] = slots[next];
+    slots[index].distance--;
+    index = next;
+    next = (next + 1) & (capacity - 1);
+  }
+  slots[index].file = NULL;
+  slots[index].distance = 0;
+  numEntries--;
+  return true;
 }
 
-void BufHashTbl::remove(const File* file, const PageId pageNo) {
-
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
+bool BufHashTbl::resize(const std::uint32_t entries)
+{
+  if (numEntries > entries)
+    return false;
+
+  Slot* oldSlots = slots;
+  const std::uint32_t oldCapacity = capacity;
+
+  // at most half full, so probe sequences stay short and always end at an empty slot
+  capacity = 2;
+  while (capacity < 2 * entries)
+    capacity *= 2;
+
+  slots = new Slot[capacity];
+  for (std::uint32_t i = 0; i < capacity; i++)
+  {
+    slots[i].file = NULL;
+    slots[i].distance = 0;
   }
+  maxEntries = entries;
+  numEntries = 0;
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  for (std::uint32_t i = 0; i < oldCapacity; i++)
+  {
+    if (oldSlots[i].file != NULL)
+      insert(oldSlots[i].file, oldSlots[i].pageNo, oldSlots[i].frameNo);
+  }
+  delete [] oldSlots;
+  return true;
 }
 
 }
@@ -7,72 +7,103 @@
 
 #pragma once
 
+#include <cstdint>
 #include "file.h"
 
 namespace badgerdb {
 
 /**
-* @brief Declarations for buffer pool hash table
+* @brief Hash table class to keep track of pages in the buffer pool
+*
+* Open addressing with robin hood probing: an entry displaces entries that are closer to
+* their home slot than it is to its own, which keeps probe sequences short and lets a
+* lookup stop as soon as it meets an entry closer to home than the key would be. Removal
+* shifts the entries behind back by one instead of leaving tombstones. The slots are
+* allocated at twice the number of entries the table is built for rounded up to a power
+* of two, and nothing is allocated after that until the table is resized. Nothing is thrown:
+* a page missing from the table is the common case of a buffer pool miss, so every
+* operation reports it through its return value. A failed insert is a bug in the pool,
+* which BufMgr reports as HashAlreadyPresentException or HashTableException.
+*
+* @warning This class is not threadsafe. BufMgr serializes all access to its table.
 */
-struct hashBucket {
+class BufHashTbl
+{
+ private:
 	/**
-	 * pointer a file object (more on this below)
+	 * Slot of the table
 	 */
-	File *file;
+  struct Slot {
+	  /**
+	   * File of the page; NULL if the slot is empty
+	   */
+    const File* file;
 
-	/**
-	 * page number within a file
-	 */
-	PageId pageNo;
+	  /**
+	   * Page number within the file
+	   */
+    PageId pageNo;
+
+	  /**
+	   * Frame number of page in the buffer pool
+	   */
+    FrameId frameNo;
+
+	  /**
+	   * Number of slots the entry is past its home slot
+	   */
+    std::uint32_t distance;
+  };
 
 	/**
-	 * frame number of page in the buffer pool
+	 * Number of slots, a power of two
 	 */
-	FrameId frameNo;
+  std::uint32_t capacity;
 
 	/**
-	 * Next node in the hash table
+	 * Most entries the table holds
 	 */
-	hashBucket*   next;
-};
-
+  std::uint32_t maxEntries;
 
-/**
-* @brief Hash table class to keep track of pages in the buffer pool
-*
-* @warning This class is not threadsafe.
-*/
-class BufHashTbl
-{
- private:
 	/**
-	 *	Size of Hash Table
+	 * Number of entries in the table
 	 */
-  int HTSIZE;
+  std::uint32_t numEntries;
+
 	/**
-	 * Actual Hash table object
+	 * The slots
 	 */
-  hashBucket**  ht;
+  Slot* slots;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns home slot between 0 and capacity-1 computed using file and pageNo
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::uint32_t hash(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Returns the slot of (file, pageNo), capacity if it is not in the table.
+	 */
+  std::uint32_t find(const File* file, const PageId pageNo) const;
 
  public:
 	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param entries	Most entries the table is to hold, the number of frames of the pool
 	 */
-	BufHashTbl(const int htSize);  // constructor
+	BufHashTbl(const std::uint32_t entries);  // constructor
 
 	/**
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
+
+	BufHashTbl(const BufHashTbl&) = delete;
+	BufHashTbl& operator=(const BufHashTbl&) = delete;
 	
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
@@ -80,10 +111,10 @@ class BufHashTbl
 	 * @param file   	File object
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
-   * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+	 * @return  False if the page is already in the table, or the table already holds as many
+	 *          entries as it was built for; the table is left as it was
 	 */
-  void insert(const File* file, const PageId pageNo, const FrameId frameNo);
+  bool insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
 	/**
    * Check if (file, pageNo) is currently in the buffer pool (ie. in
@@ -91,19 +122,27 @@ class BufHashTbl
 	 *
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
-	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+	 * @param frameNo Frame number reference, set if the page is found
+	 * @return  False if the page entry is not found in the hash table
 	 */
-  void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
+  bool lookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
 
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+	 * @return  False if the page entry is not found in the hash table
+	 */
+  bool remove(const File* file, const PageId pageNo);  
+
+	/**
+   * Rebuilds the table for a new number of entries, rehashing the entries it holds.
+	 *
+	 * @param entries	Most entries the table is to hold, the number of frames of the pool
+	 * @return  False if the table holds more entries than that; the table is left as it was
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  bool resize(const std::uint32_t entries);
 };
 
 }
@@ -7,12 +7,16 @@
 
 #include <memory>
 #include <iostream>
+#include <algorithm>
 #include "buffer.h"
+#include "exceptions/badgerdb_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_table_exception.h"
 
 namespace badgerdb { 
 
@@ -20,145 +24,623 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
-	bufDescTable = new BufDesc[bufs];
+BufMgr::BufMgr(std::uint32_t bufs, IoEngine* engine, const ReplacementPolicyKind policyKind)
+	: numBufs(bufs), numDirty(0), policy(ReplacementPolicy::create(policyKind, bufs)), evictedLimit(0), stopPrefetch(false),
+	  ioEngine(engine != NULL ? engine : IoEngine::create(IOQUEUEDEPTH)), stopWriter(false) {
+	bufDescTable.resize(bufs);
+  initFrames(0);
 
-  for (FrameId i = 0; i < bufs; i++) 
+  bufPool.resize(bufs);
+
+  hashTable = new BufHashTbl (bufs);  // allocate the buffer hash table, one entry per frame
+
+  sizeRings();
+}
+
+void BufMgr::initFrames(const FrameId from)
+{
+  for (FrameId i = from; i < numBufs; i++) 
   {
   	bufDescTable[i].frameNo = i;
-  	bufDescTable[i].valid = false;
+  	bufDescTable[i].fileFrames = &fileFrames;
+  	bufDescTable[i].Clear();
+  }
+}
+
+void BufMgr::sizeRings()
+{
+  // a scan needs few frames to keep its reads going; a bulk load some more to batch write-backs
+  rings[ACCESS_SEQUENTIAL].size = std::max<std::uint32_t>(2, std::min<std::uint32_t>(16, numBufs / 8));
+  rings[ACCESS_BULKWRITE].size = std::max<std::uint32_t>(2, std::min<std::uint32_t>(32, numBufs / 4));
+  for (int i = 0; i < 3; i++)
+  {
+    std::vector<FrameId>& frames = rings[i].frames;
+    frames.erase(std::remove_if(frames.begin(), frames.end(), [this](FrameId f) { return f >= numBufs; }),
+                 frames.end());
+    if (frames.size() > rings[i].size) frames.resize(rings[i].size);
+    rings[i].next = 0;
   }
+}
+
+void BufMgr::resize(const std::uint32_t newFrames)
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+  const std::uint32_t frames = std::max<std::uint32_t>(newFrames, 1);
+
+  if (frames > numBufs)
+  {
+    // the segments of the frames kept stay where they are, so pinned pages do not move
+    const FrameId from = numBufs;
+    bufDescTable.resize(frames);
+    bufPool.resize(frames);
+    numBufs = frames;
+    initFrames(from);
+    hashTable->resize(frames);
+    policy->resize(frames);
+    sizeRings();
+    return;
+  }
+
+  // the frames to be dropped are let go of like victims of the policy; none may be pinned.
+  // Their dirty pages are written first with the mutex let go of, as in writeVictim, and
+  // the frames are looked at again afterwards since the pool may have changed meanwhile
+  while (true)
+  {
+    bool busy = true;
+    while (busy)
+    {
+      busy = false;
+      for (FrameId i = frames; i < numBufs && !busy; i++)
+      {
+        busy = bufDescTable[i].loading || bufDescTable[i].writing;
+      }
+      if (busy) ioDone.wait(lock);
+    }
+    for (FrameId i = frames; i < numBufs; i++)
+    {
+      if (bufDescTable[i].valid && bufDescTable[i].pinCnt > 0)
+      {
+        throw PagePinnedException(bufDescTable[i].file->filename(), bufDescTable[i].pageNo, i);
+      }
+    }
+
+    std::vector<IoRequest> writes;
+    std::vector<FrameId> written;
+    for (FrameId i = frames; i < numBufs; i++)
+    {
+      BufDesc* tmpbuf = &bufDescTable[i];
+      if (tmpbuf->valid && tmpbuf->dirty)
+      {
+        tmpbuf->writing = true;
+        tmpbuf->evicting = true;
+        IoRequest request = {IoRequest::WRITE, tmpbuf->file, tmpbuf->pageNo, &bufPool[i], std::exception_ptr(), NULL, 1};
+        writes.push_back(request);
+        written.push_back(i);
+      }
+    }
+    if (writes.empty()) break;
 
-  bufPool = new Page[bufs];
+    lock.unlock();
+    ioEngine->run(&writes[0], writes.size());
+    lock.lock();
 
-  int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+    std::exception_ptr error;
+    for (std::size_t k = 0; k < writes.size(); k++)
+    {
+      BufDesc* tmpbuf = &bufDescTable[written[k]];
+      tmpbuf->writing = false;
+      tmpbuf->evicting = false;
+      if (writes[k].error)
+      {
+        if (!error) error = writes[k].error;
+      }
+      else
+      {
+        bufStats.diskwrites++;
+        setDirty(written[k], false);
+      }
+    }
+    ioDone.notify_all();
+    // the shrink is given up, the pages that could not be written stay dirty in their frames
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
 
-  clockHand = bufs - 1;
+  for (FrameId i = frames; i < numBufs; i++)
+  {
+    BufDesc* tmpbuf = &bufDescTable[i];
+    if (tmpbuf->valid)
+    {
+      bufStats.evictions++;
+      hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+    }
+    tmpbuf->Clear();
+    policy->removed(i);
+  }
+
+  numBufs = frames;
+  policy->resize(frames);
+  hashTable->resize(frames);
+  sizeRings();
+  bufDescTable.resize(frames);
+  bufPool.resize(frames);
 }
 
 
 BufMgr::~BufMgr() {
+  if (writer.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      stopWriter = true;
+    }
+    writerWanted.notify_all();
+    writer.join();
+  }
+
+  if (prefetcher.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      stopPrefetch = true;
+    }
+    prefetchWanted.notify_all();
+    prefetcher.join();
+  }
+
   //Flush out all unwritten pages
+  std::vector<IoRequest> writes;
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
   	BufDesc* tmpbuf = &bufDescTable[i];
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			IoRequest request = {IoRequest::WRITE, tmpbuf->file, tmpbuf->pageNo, &bufPool[i], std::exception_ptr(), NULL, 1};
+			writes.push_back(request);
   	}
   }
+  // nothing can be thrown from here; a page deleted from its file meanwhile is dropped
+  if (!writes.empty()) ioEngine->run(&writes[0], writes.size());
 
-  delete [] bufDescTable;
-  delete [] bufPool;
+  delete ioEngine;
+  delete policy;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+bool BufMgr::allocBuf(FrameId & frame, std::unique_lock<std::mutex>& lock, const AccessStrategy strategy) 
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
-
-  while (numScanned < 2*numBufs)	//Need to scn twice
+  if (strategy != ACCESS_NORMAL && takeRingFrame(strategy, frame, lock))
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    return true;
+  }
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
-    {
-      break;
-    }
+  // Caller holds poolMutex
+  if (!policy->evict([this](FrameId f) { return bufDescTable[f].pinCnt == 0 && !bufDescTable[f].loading &&
+                                                 !bufDescTable[f].writing; },
+                     frame))
+  {
+    return false;
+  }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+  BufDesc* tmpbuf = &bufDescTable[frame];
+  if (tmpbuf->valid)
+  {
+    // flush any existing changes to disk if necessary; the policy has let go of the frame,
+    // so it is ours while the page is written
+    if (tmpbuf->dirty)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      // the background writer, if any, is falling behind
+      writerWanted.notify_one();
+      std::exception_ptr error = writeVictim(frame, lock);
+      if (error)
       {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+        // the page stays in the pool, dirty, for a later write to succeed
+        policy->loaded(frame, tmpbuf->file, tmpbuf->pageNo, tmpbuf->strategy != ACCESS_NORMAL);
+        std::rethrow_exception(error);
       }
     }
-    else
-    {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
-    }
+
+    bufStats.evictions++;
+    hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+    if (tmpbuf->strategy == ACCESS_NORMAL) rememberEvicted(tmpbuf->file, tmpbuf->pageNo);
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+
+	//Reset all the BufDesc entry for the frame before returning the frame
+  tmpbuf->Clear();
+
+  // the frame joins the ring, in place of the one the ring could not take
+  if (strategy != ACCESS_NORMAL)
   {
-    throw BufferExceededException();
+    BufferRing& ring = rings[strategy];
+    if (ring.frames.size() < ring.size) ring.frames.push_back(frame);
+    else ring.frames[ring.next] = frame;
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+  return true;
+} // end allocBuf
+
+bool BufMgr::takeRingFrame(const AccessStrategy strategy, FrameId & frame, std::unique_lock<std::mutex>& lock)
+{
+  BufferRing& ring = rings[strategy];
+  if (ring.frames.size() < ring.size)
   {
-    bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    ring.next = ring.frames.size();
+    return false;
   }
 
-	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  ring.next = (ring.next + 1) % ring.size;
+  BufDesc* tmpbuf = &bufDescTable[ring.frames[ring.next]];
+  // taken out of the ring by a normal access or by the policy, or still in use
+  if (tmpbuf->strategy != strategy || tmpbuf->pinCnt > 0 || tmpbuf->loading || tmpbuf->writing)
+  {
+    return false;
+  }
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+  // the frame keeps its page until it is written, and is not replaced meanwhile as it is
+  // writing; a failed write leaves the page dirty in the ring
+  if (tmpbuf->valid && tmpbuf->dirty)
+  {
+    std::exception_ptr error = writeVictim(tmpbuf->frameNo, lock);
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+  hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+  policy->removed(tmpbuf->frameNo);
+  tmpbuf->Clear();
+  bufStats.ringreuses++;
+  frame = tmpbuf->frameNo;
+  return true;
+}
+
+std::exception_ptr BufMgr::writeVictim(const FrameId frame, std::unique_lock<std::mutex>& lock)
+{
+  BufDesc* tmpbuf = &bufDescTable[frame];
+  tmpbuf->writing = true;
+  tmpbuf->evicting = true;
+  IoRequest request = {IoRequest::WRITE, tmpbuf->file, tmpbuf->pageNo, &bufPool[frame], std::exception_ptr(), NULL, 1};
+
+  // unpinned and not to be pinned, so nobody changes the page while it is written
+  lock.unlock();
+  ioEngine->run(&request, 1);
+  lock.lock();
+
+  tmpbuf->writing = false;
+  tmpbuf->evicting = false;
+  ioDone.notify_all();
+  if (!request.error)
+  {
+    bufStats.diskwrites++;
+    setDirty(frame, false);
+  }
+  return request.error;
+}
 
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, const AccessStrategy strategy)
 {
+  page = &bufPool[pinPage(file, pageNo, strategy)];
+}
+
+PageHandle BufMgr::readPage(File* file, const PageId pageNo, const AccessStrategy strategy)
+{
+  FrameId frameNo = pinPage(file, pageNo, strategy);
+  return PageHandle(this, file, pageNo, frameNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::pinPage(File* file, const PageId pageNo, const AccessStrategy strategy)
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+  bufStats.accesses++;
+
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  while (true)
+  {
+    bool found = hashTable->lookup(file, pageNo, frameNo);
+
+    // a prefetch is reading the page, wait for it rather than read the page twice; a failed
+    // prefetch leaves the page to be read here
+    while (found && (bufDescTable[frameNo].loading || bufDescTable[frameNo].evicting))
+    {
+      ioDone.wait(lock);
+      found = hashTable->lookup(file, pageNo, frameNo);
+    }
+
+    if (found)
+    {
+      pinResident(frameNo, strategy);
+      return frameNo;
+    }
+
+    // not in the buffer pool, must allocate a new page; a miss on a page let go of lately
+    // is counted before the frame for it lets go of another page
+    countGhostHit(file, pageNo, strategy);
+
+    // alloc a new frame
+    if (!allocBuf(frameNo, lock, strategy))
+    {
+      throw BufferExceededException();
+    }
+
+    // the page may have been read in while allocBuf wrote out a dirty page
+    FrameId resident = 0;
+    if (!hashTable->lookup(file, pageNo, resident))
+    {
+      break;
+    }
+    policy->removed(frameNo);
+  }
 
-    // set the referenced bit
+  // the frame stays loading while the page is read without the pool mutex
+  startLoad(frameNo, file, pageNo, strategy);
+  lock.unlock();
+
+  // read the page into the new frame
+  //status = file->readPage(pageNo, &bufPool[frameNo]);
+  IoRequest request = {IoRequest::READ, file, pageNo, &bufPool[frameNo], std::exception_ptr(), NULL, 1};
+  ioEngine->run(&request, 1);
+
+  lock.lock();
+  bufDescTable[frameNo].loading = false;
+  ioDone.notify_all();
+  if (request.error)
+  {
+    abandonLoad(frameNo);
+    std::rethrow_exception(request.error);
+  }
+  bufStats.diskreads++;
+  return frameNo;
+}
+
+void BufMgr::pinResident(const FrameId frameNo, const AccessStrategy strategy)
+{
+  // tell the policy of the use, unless a page read once is read once more; a normal
+  // access takes the frame out of its ring
+  bufStats.hits++;
+  if (strategy == ACCESS_NORMAL) bufDescTable[frameNo].strategy = ACCESS_NORMAL;
+  if (bufDescTable[frameNo].strategy == ACCESS_NORMAL)
+  {
     bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+    policy->accessed(frameNo);
+  }
+  bufDescTable[frameNo].pinCnt++;
+}
+
+void BufMgr::startLoad(const FrameId frameNo, File* file, const PageId pageNo, const AccessStrategy strategy)
+{
+  // set up the entry properly, and insert it in the hash table
+  bufDescTable[frameNo].Set(file, pageNo);
+  bufDescTable[frameNo].strategy = strategy;
+  bufDescTable[frameNo].refbit = (strategy == ACCESS_NORMAL);
+  bufDescTable[frameNo].loading = true;
+  policy->loaded(frameNo, file, pageNo, strategy != ACCESS_NORMAL);
+  insertFrame(frameNo, file, pageNo);
+}
+
+void BufMgr::insertFrame(const FrameId frameNo, File* file, const PageId pageNo)
+{
+  if (hashTable->insert(file, pageNo, frameNo)) return;
+
+  FrameId present;
+  const bool found = hashTable->lookup(file, pageNo, present);
+  policy->removed(frameNo);
+  bufDescTable[frameNo].Clear();
+  if (found)
+  {
+    throw HashAlreadyPresentException(file->filename(), pageNo, present);
   }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+  throw HashTableException();
+}
+
+void BufMgr::countGhostHit(const File* file, const PageId pageNo, const AccessStrategy strategy)
+{
+  // a page read once more by a scan would not have been kept by more frames either
+  if (strategy != ACCESS_NORMAL || evictedPages.empty()) return;
+  std::map<EvictedPage, std::list<EvictedPage>::iterator>::iterator it =
+      evictedPages.find(EvictedPage(file, pageNo));
+  if (it != evictedPages.end())
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    bufStats.ghosthits++;
+    evictedOrder.erase(it->second);
+    evictedPages.erase(it);
+  }
+}
+
+void BufMgr::rememberEvicted(const File* file, const PageId pageNo)
+{
+  if (evictedLimit == 0) return;
+  const EvictedPage page(file, pageNo);
+  std::map<EvictedPage, std::list<EvictedPage>::iterator>::iterator it = evictedPages.find(page);
+  if (it != evictedPages.end())
+  {
+    evictedOrder.erase(it->second);
+    evictedPages.erase(it);
+  }
+  evictedPages[page] = evictedOrder.insert(evictedOrder.end(), page);
+  while (evictedOrder.size() > evictedLimit)
+  {
+    evictedPages.erase(evictedOrder.front());
+    evictedOrder.pop_front();
+  }
+}
+
+void BufMgr::trackEvictions(const std::uint32_t pages)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  evictedLimit = pages;
+  while (evictedOrder.size() > evictedLimit)
+  {
+    evictedPages.erase(evictedOrder.front());
+    evictedOrder.pop_front();
+  }
+}
+
+void BufMgr::abandonLoad(const FrameId frameNo)
+{
+  hashTable->remove(bufDescTable[frameNo].file, bufDescTable[frameNo].pageNo);
+  bufDescTable[frameNo].Clear();
+  policy->removed(frameNo);
+}
+
+void BufMgr::readPages(File* file, const PageId first, const std::size_t count, Page** pages,
+                       const AccessStrategy strategy)
+{
+  if (count == 0) return;
+  std::vector<FrameId> frames(count);
+  pinPages(file, first, count, &frames[0], strategy);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    pages[i] = &bufPool[frames[i]];
+  }
+}
+
+void BufMgr::readPages(File* file, const PageId first, const std::size_t count, std::vector<PageHandle>& pages,
+                       const AccessStrategy strategy)
+{
+  pages.clear();
+  if (count == 0) return;
+  std::vector<FrameId> frames(count);
+  pinPages(file, first, count, &frames[0], strategy);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    pages.push_back(PageHandle(this, file, first + i, frames[i], &bufPool[frames[i]]));
+  }
+}
+
+void BufMgr::pinPages(File* file, const PageId first, const std::size_t count, FrameId* frames,
+                      const AccessStrategy strategy)
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+
+  // Pages in the pool are pinned and the others get frames, all in one pass. Pages
+  // someone else is reading are left to pinPage once the reads here are done.
+  std::vector<std::size_t> pinned;
+  std::vector<std::size_t> misses;
+  std::vector<std::size_t> later;
+  try
+  {
+    for (std::size_t i = 0; i < count; i++)
+    {
+      if (hashTable->lookup(file, first + i, frames[i]))
+      {
+        if (bufDescTable[frames[i]].loading || bufDescTable[frames[i]].evicting)
+        {
+          later.push_back(i);
+          continue;
+        }
+        pinResident(frames[i], strategy);
+        pinned.push_back(i);
+      }
+      else
+      {
+        countGhostHit(file, first + i, strategy);
+        if (!allocBuf(frames[i], lock, strategy))
+        {
+          throw BufferExceededException();
+        }
+        // read in meanwhile, while allocBuf wrote out a dirty page: the page is looked at again
+        FrameId resident = 0;
+        if (hashTable->lookup(file, first + i, resident))
+        {
+          policy->removed(frames[i]);
+          i--;
+          continue;
+        }
+        startLoad(frames[i], file, first + i, strategy);
+        misses.push_back(i);
+      }
+    }
+  }
+  catch(BadgerDbException e)
+  {
+    for (std::size_t i = 0; i < pinned.size(); i++)
+    {
+      bufDescTable[frames[pinned[i]]].pinCnt--;
+    }
+    for (std::size_t i = 0; i < misses.size(); i++)
+    {
+      abandonLoad(frames[misses[i]]);
+    }
+    ioDone.notify_all();
+    throw;
+  }
+  bufStats.accesses += count - later.size();
+
+  // one request per run of consecutive missing pages, all of them as one batch
+  std::vector<std::vector<Page*> > runs;
+  for (std::size_t i = 0; i < misses.size(); i++)
+  {
+    if (i > 0 && misses[i] == misses[i - 1] + 1) runs.back().push_back(&bufPool[frames[misses[i]]]);
+    else runs.push_back(std::vector<Page*>(1, &bufPool[frames[misses[i]]]));
+  }
+  std::vector<IoRequest> reads;
+  for (std::size_t i = 0, run = 0; run < runs.size(); i += runs[run].size(), run++)
+  {
+    IoRequest request = {IoRequest::READ, file, static_cast<PageId>(first + misses[i]), runs[run][0], std::exception_ptr(),
+                         runs[run].size() > 1 ? &runs[run][0] : NULL, runs[run].size()};
+    reads.push_back(request);
+  }
+  if (!reads.empty())
+  {
+    lock.unlock();
+    ioEngine->run(&reads[0], reads.size());
+    lock.lock();
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  std::exception_ptr error;
+  for (std::size_t i = 0, run = 0; run < reads.size(); run++)
+  {
+    for (std::size_t j = 0; j < runs[run].size(); i++, j++)
+    {
+      bufDescTable[frames[misses[i]]].loading = false;
+      if (reads[run].error) abandonLoad(frames[misses[i]]);
+      else pinned.push_back(misses[i]);
+    }
+    if (reads[run].error && !error) error = reads[run].error;
+    else if (!reads[run].error) bufStats.diskreads += runs[run].size();
+  }
+  ioDone.notify_all();
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  if (!error)
+  {
+    lock.unlock();
+    try
+    {
+      for (std::size_t i = 0; i < later.size(); i++)
+      {
+        frames[later[i]] = pinPage(file, first + later[i], strategy);
+        pinned.push_back(later[i]);
+      }
+      return;
+    }
+    catch(BadgerDbException e)
+    {
+      error = std::current_exception();
+    }
+    lock.lock();
+  }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+  // the pages read stay in the pool, unpinned
+  for (std::size_t i = 0; i < pinned.size(); i++)
+  {
+    bufDescTable[frames[pinned[i]]].pinCnt--;
   }
+  std::rethrow_exception(error);
 }
 
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, 
 			     const bool dirty) 
 {
+  std::lock_guard<std::mutex> lock(poolMutex);
+
   // lookup in hashtable
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  FrameId frameNo = frameOf(file, pageNo);
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true) setDirty(frameNo, true);
 
   // make sure the page is actually pinned
   if (bufDescTable[frameNo].pinCnt == 0)
@@ -168,40 +650,391 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
   else bufDescTable[frameNo].pinCnt--;
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::unPinFrame(const FrameId frameNo, const bool dirty)
 {
-  for (std::uint32_t i = 0; i < numBufs; i++)
-	{
-  	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->valid == true && tmpbuf->file == file)
-		{
-	    if (tmpbuf->pinCnt > 0)
-  			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
-
-	    if (tmpbuf->dirty == true)
-			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
-    	}
-
-    	hashTable->remove(file,tmpbuf->pageNo);
-    	tmpbuf->Clear();
+  std::lock_guard<std::mutex> lock(poolMutex);
+
+  // a handle holds a pin, so the frame still has its page
+  if (dirty == true) setDirty(frameNo, true);
+  if (bufDescTable[frameNo].pinCnt == 0)
+  {
+  	throw PageNotPinnedException(bufDescTable[frameNo].file->filename(), bufDescTable[frameNo].pageNo, frameNo);
+  }
+  else bufDescTable[frameNo].pinCnt--;
+}
+
+void BufMgr::prefetchPages(File* file, const PageId* pageNos, const std::size_t count)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+
+  // keep read ahead from taking over the pool
+  const std::size_t maxQueued = std::max<std::size_t>(1, numBufs / 4);
+  for (std::size_t i = 0; i < count && prefetchQueue.size() < maxQueued; i++)
+  {
+    PrefetchRequest request = {file, pageNos[i]};
+    prefetchQueue.push_back(request);
+  }
+
+  if (!prefetcher.joinable())
+  {
+    prefetcher = std::thread(&BufMgr::prefetchLoop, this);
+  }
+  prefetchWanted.notify_one();
+}
+
+void BufMgr::prefetchLoop()
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+  while (true)
+  {
+    while (!stopPrefetch && prefetchQueue.empty())
+    {
+      prefetchWanted.wait(lock);
+    }
+    if (stopPrefetch)
+    {
+      return;
+    }
+
+    // take up to a queue depth of requests and read them as one batch
+    std::vector<IoRequest> reads;
+    std::vector<FrameId> frames;
+    while (!prefetchQueue.empty() && reads.size() < IOQUEUEDEPTH)
+    {
+      PrefetchRequest request = prefetchQueue.front();
+      FrameId frameNo = 0;
+      if (hashTable->lookup(request.file, request.pageNo, frameNo))
+      {
+        prefetchQueue.pop_front();
+        continue; // already in the pool
+      }
+
+      // the request stays queued while allocBuf may write out a dirty page, so that
+      // flushFile can still drop it
+      bool allocated = false;
+      try
+      {
+        allocated = allocBuf(frameNo, lock);
+      }
+      catch(BadgerDbException e)
+      {
+        // the page that could not be written is left for readPage or flushFile to report
+      }
+      const bool queued = !prefetchQueue.empty() && prefetchQueue.front().file == request.file &&
+                          prefetchQueue.front().pageNo == request.pageNo;
+      if (queued)
+      {
+        prefetchQueue.pop_front();
+      }
+      if (!allocated)
+      {
+        continue; // every frame is pinned, the page is read when it is needed
+      }
+      FrameId resident = 0;
+      if (!queued || hashTable->lookup(request.file, request.pageNo, resident))
+      {
+        // dropped by flushFile, or read in, while the dirty page was written
+        policy->removed(frameNo);
+        continue;
+      }
+
+      // the frame is in the hash table while the page is read, unpinned but not replaceable
+      bufDescTable[frameNo].Set(request.file, request.pageNo);
+      bufDescTable[frameNo].pinCnt = 0;
+      bufDescTable[frameNo].loading = true;
+      policy->loaded(frameNo, request.file, request.pageNo, false);
+      insertFrame(frameNo, request.file, request.pageNo);
+
+      IoRequest read = {IoRequest::READ, request.file, request.pageNo, &bufPool[frameNo], std::exception_ptr(), NULL, 1};
+      reads.push_back(read);
+      frames.push_back(frameNo);
+    }
+    if (reads.empty())
+    {
+      continue;
+    }
+
+    lock.unlock();
+    ioEngine->run(&reads[0], reads.size());
+    lock.lock();
+
+    for (std::size_t i = 0; i < reads.size(); i++)
+    {
+      bufDescTable[frames[i]].loading = false;
+      if (!reads[i].error)
+      {
+        bufStats.diskreads++;
+        bufStats.prefetchreads++;
+      }
+      else
+      {
+        // e.g. a page deleted since it was requested
+        hashTable->remove(reads[i].file, reads[i].pageNo);
+        bufDescTable[frames[i]].Clear();
+        policy->removed(frames[i]);
+      }
+    }
+    ioDone.notify_all();
+  }
+}
+
+void BufMgr::startBackgroundWriter(const WriterSettings& settings)
+{
+  std::lock_guard<std::mutex> lock(poolMutex);
+  writerSettings = settings;
+  if (!writer.joinable())
+  {
+    writer = std::thread(&BufMgr::writerLoop, this);
+  }
+  writerWanted.notify_one();
+}
+
+void BufMgr::writerLoop()
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+  while (!stopWriter)
+  {
+    std::size_t written = 0;
+    if (numDirty > writerSettings.lowWatermark * numBufs)
+    {
+      written = writeAhead(lock);
+    }
+    // above the high watermark the next round follows at once, unless every dirty page is in use
+    if (written == 0 || numDirty <= writerSettings.highWatermark * numBufs)
+    {
+      writerWanted.wait_for(lock, std::chrono::milliseconds(writerSettings.roundMillis));
+    }
+  }
+}
+
+std::size_t BufMgr::writeAhead(std::unique_lock<std::mutex>& lock)
+{
+  std::vector<FrameId> order;
+  policy->upcoming(order);
+
+  std::vector<IoRequest> writes;
+  std::vector<FrameId> frames;
+  for (std::size_t i = 0; i < order.size() && writes.size() < writerSettings.pagesPerRound; i++)
+  {
+    BufDesc* tmpbuf = &bufDescTable[order[i]];
+    if (!tmpbuf->valid || !tmpbuf->dirty || tmpbuf->pinCnt > 0 || tmpbuf->loading || tmpbuf->writing)
+    {
+      continue;
+    }
+
+    // Latches are only held under a pin, so this does not wait. Holding it keeps latched
+    // updates out of the page while it is written; the page may be pinned meanwhile, and
+    // is dirty again if it is changed.
+    tmpbuf->latch.lockShared();
+    tmpbuf->writing = true;
+    setDirty(order[i], false);
+    IoRequest request = {IoRequest::WRITE, tmpbuf->file, tmpbuf->pageNo, &bufPool[order[i]], std::exception_ptr(), NULL, 1};
+    writes.push_back(request);
+    frames.push_back(order[i]);
+  }
+  if (writes.empty())
+  {
+    return 0;
+  }
+
+  lock.unlock();
+  ioEngine->run(&writes[0], writes.size());
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    bufDescTable[frames[i]].latch.unlockShared();
+  }
+  lock.lock();
+
+  std::size_t written = 0;
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    bufDescTable[frames[i]].writing = false;
+    if (writes[i].error)
+    {
+      // left for allocBuf or flushFile to write, and to report
+      setDirty(frames[i], true);
+    }
+    else
+    {
+      bufStats.diskwrites++;
+      bufStats.bgwrites++;
+      written++;
+    }
+  }
+  ioDone.notify_all();
+  return written;
+}
+
+void BufMgr::setDirty(const FrameId frameNo, const bool dirty)
+{
+  if (bufDescTable[frameNo].dirty != dirty)
+  {
+    if (dirty) numDirty++;
+    else numDirty--;
+    bufDescTable[frameNo].dirty = dirty;
+  }
+}
+
+FrameId BufMgr::frameOf(const File* file, const PageId pageNo) const
+{
+  FrameId frameNo = 0;
+  if (!hashTable->lookup(file, pageNo, frameNo))
+  {
+    throw HashNotFoundException(file->filename(), pageNo);
+  }
+  return frameNo;
+}
+
+void BufMgr::waitForIo(const File* file, const PageId pageNo, std::unique_lock<std::mutex>& lock)
+{
+  bool loading = true;
+  while (loading)
+  {
+    loading = false;
+    for (std::uint32_t i = 0; i < numBufs && !loading; i++)
+    {
+      loading = (bufDescTable[i].loading || bufDescTable[i].writing) && bufDescTable[i].file == file &&
+          (pageNo == Page::INVALID_NUMBER || bufDescTable[i].pageNo == pageNo);
+    }
+    if (loading)
+    {
+      ioDone.wait(lock);
+    }
+  }
+}
+
+void BufMgr::writeBack(std::vector<IoRequest>& requests)
+{
+  if (requests.empty()) return;
+
+  ioEngine->run(&requests[0], requests.size());
+  std::exception_ptr error;
+  for (std::size_t i = 0; i < requests.size() && !error; i++)
+  {
+    error = requests[i].error;
+  }
+  requests.clear();
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void BufMgr::flushFile(File* file) 
+{
+  std::unique_lock<std::mutex> lock(poolMutex);
+
+  // the file may be closed once this returns, so nothing of it may be left to prefetch
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin(); it != prefetchQueue.end(); )
+  {
+    if (it->file == file) it = prefetchQueue.erase(it);
+    else ++it;
+  }
+  waitForIo(file, Page::INVALID_NUMBER, lock);
+
+  FileFrameIndex::iterator entry = fileFrames.find(file);
+  if (entry == fileFrames.end())
+  {
+    file->sync();
+    return;
+  }
+  // copied, as clearing the frames takes them out of the index
+  const std::map<PageId, FrameId> frames = entry->second;
+  for (std::map<PageId, FrameId>::const_iterator it = frames.begin(); it != frames.end(); ++it)
+  {
+  	BufDesc* tmpbuf = &(bufDescTable[it->second]);
+  	if (tmpbuf->pinCnt > 0)
+  	{
+  		throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
   	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
+  	if (tmpbuf->valid == false)
+  	{
   		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+  	}
+  }
+
+  // Dirty pages are gathered into runs of consecutive page numbers, each written as one
+  // request, and the runs as one batch. Frames are only emptied once their page is on
+  // its way to disk, so a failed write leaves its pages in the pool, dirty.
+  std::vector<PageId> runStarts;
+  std::vector<std::vector<Page*> > runs;
+  std::vector<std::vector<FrameId> > runFrames;
+  for (std::map<PageId, FrameId>::const_iterator it = frames.begin(); it != frames.end(); ++it)
+  {
+  	if (bufDescTable[it->second].dirty == true)
+  	{
+  		if (!runs.empty() && runStarts.back() + runs.back().size() == it->first &&
+  		    runs.back().size() < IOQUEUEDEPTH)
+  		{
+  			runs.back().push_back(&bufPool[it->second]);
+  			runFrames.back().push_back(it->second);
+  		}
+  		else
+  		{
+  			runStarts.push_back(it->first);
+  			runs.push_back(std::vector<Page*>(1, &bufPool[it->second]));
+  			runFrames.push_back(std::vector<FrameId>(1, it->second));
+  		}
+  	}
+  }
+
+  std::vector<IoRequest> writes;
+  for (std::size_t i = 0; i < runs.size(); i++)
+  {
+  	IoRequest request = {IoRequest::WRITE, file, runStarts[i], runs[i][0], std::exception_ptr(),
+  	                     runs[i].size() > 1 ? &runs[i][0] : NULL, runs[i].size()};
+  	writes.push_back(request);
+  }
+  if (!writes.empty())
+  {
+  	ioEngine->run(&writes[0], writes.size());
+  }
+
+  std::exception_ptr error;
+  for (std::size_t i = 0; i < writes.size(); i++)
+  {
+  	if (writes[i].error)
+  	{
+  		if (!error) error = writes[i].error;
+  		continue;
+  	}
+  	for (std::size_t j = 0; j < runFrames[i].size(); j++)
+  	{
+  		setDirty(runFrames[i][j], false);
+  	}
+  }
+  for (std::map<PageId, FrameId>::const_iterator it = frames.begin(); it != frames.end(); ++it)
+  {
+  	BufDesc* tmpbuf = &(bufDescTable[it->second]);
+  	if (tmpbuf->dirty == false)
+  	{
+  		hashTable->remove(file, tmpbuf->pageNo);
+  		tmpbuf->Clear();
+  		policy->removed(it->second);
+  	}
+  }
+  if (error)
+  {
+  	std::rethrow_exception(error);
   }
+
+  file->sync();
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) 
 {
+  std::unique_lock<std::mutex> lock(poolMutex);
+
+  waitForIo(file, pageNo, lock);
+
 	//Deallocate from file altogether
   //See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  FrameId frameNo = frameOf(file, pageNo);
 
 	// clear the page
+	setDirty(frameNo, false);
 	bufDescTable[frameNo].Clear();
+	policy->removed(frameNo);
 
 	hashTable->remove(file, pageNo);
 
@@ -210,23 +1043,102 @@ void BufMgr::disposePage(File* file, const PageId pageNo)
 }
 
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page, const AccessStrategy strategy) 
+{
+  page = &bufPool[pinNewPage(file, pageNo, strategy)];
+}
+
+PageHandle BufMgr::allocPage(File* file, PageId &pageNo, const AccessStrategy strategy)
+{
+  FrameId frameNo = pinNewPage(file, pageNo, strategy);
+  return PageHandle(this, file, pageNo, frameNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::pinNewPage(File* file, PageId &pageNo, const AccessStrategy strategy)
 {
+  std::unique_lock<std::mutex> lock(poolMutex);
+  bufStats.accesses++;
   FrameId frameNo;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  if (!allocBuf(frameNo, lock, strategy))
+  {
+    throw BufferExceededException();
+  }
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+  try
+  {
+    file->allocatePage(pageNo, bufPool[frameNo]);
+  }
+  catch(BadgerDbException e)
+  {
+    policy->removed(frameNo);
+    throw;
+  }
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
+  bufDescTable[frameNo].strategy = strategy;
+  bufDescTable[frameNo].refbit = (strategy == ACCESS_NORMAL);
+  policy->loaded(frameNo, file, pageNo, strategy != ACCESS_NORMAL);
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  insertFrame(frameNo, file, pageNo);
+  return frameNo;
+}
+
+void BufMgr::latchPage(File* file, const PageId pageNo, const LatchMode mode)
+{
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    frameNo = frameOf(file, pageNo);
+
+    // a pinned frame keeps its page, so the latch can be waited for without the pool mutex
+    if (bufDescTable[frameNo].pinCnt == 0)
+    {
+      throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+    }
+  }
+  latchFrame(frameNo, mode);
+}
+
+void BufMgr::latchFrame(const FrameId frameNo, const LatchMode mode)
+{
+  if (mode == LATCH_EXCLUSIVE) bufDescTable[frameNo].latch.lockExclusive();
+  else bufDescTable[frameNo].latch.lockShared();
+}
+
+void BufMgr::unlatchPage(File* file, const PageId pageNo, const LatchMode mode)
+{
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    frameNo = frameOf(file, pageNo);
+  }
+  unlatchFrame(frameNo, mode);
+}
+
+void BufMgr::unlatchFrame(const FrameId frameNo, const LatchMode mode)
+{
+  if (mode == LATCH_EXCLUSIVE)
+  {
+    bufDescTable[frameNo].version++;
+    bufDescTable[frameNo].latch.unlockExclusive();
+  }
+  else bufDescTable[frameNo].latch.unlockShared();
+}
+
+std::uint64_t BufMgr::getPageVersion(File* file, const PageId pageNo)
+{
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    frameNo = frameOf(file, pageNo);
+  }
+  return bufDescTable[frameNo].version;
 }
 
 void BufMgr::printSelf(void) 
@@ -247,4 +1159,72 @@ void BufMgr::printSelf(void)
 	std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
 }
 
+//----------------------------------------
+// PageHandle
+//----------------------------------------
+
+PageHandle::PageHandle(PageHandle&& other)
+  : bufMgr(other.bufMgr), file(other.file), pageNo(other.pageNo), frameNo(other.frameNo),
+    page(other.page), dirty(other.dirty), latched(other.latched), latchMode(other.latchMode)
+{
+  other.page = NULL;
+  other.latched = false;
+}
+
+PageHandle& PageHandle::operator=(PageHandle&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    file = other.file;
+    pageNo = other.pageNo;
+    frameNo = other.frameNo;
+    page = other.page;
+    dirty = other.dirty;
+    latched = other.latched;
+    latchMode = other.latchMode;
+    other.page = NULL;
+    other.latched = false;
+  }
+  return *this;
+}
+
+PageHandle::~PageHandle()
+{
+  release();
+}
+
+void PageHandle::latch(const LatchMode mode)
+{
+  bufMgr->latchFrame(frameNo, mode);
+  latched = true;
+  latchMode = mode;
+}
+
+void PageHandle::unlatch(const LatchMode mode)
+{
+  latched = false;
+  bufMgr->unlatchFrame(frameNo, mode);
+}
+
+std::uint64_t PageHandle::version() const
+{
+  return bufMgr->frameVersion(frameNo);
+}
+
+void PageHandle::release()
+{
+  if (page != NULL)
+  {
+    if (latched)
+    {
+      unlatch(latchMode);
+    }
+    page = NULL;
+    bufMgr->unPinFrame(frameNo, dirty);
+    dirty = false;
+  }
+}
+
 }
@@ -9,21 +9,207 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "io_engine.h"
+#include "replacement_policy.h"
 #include <iostream>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
 
 namespace badgerdb {
 
+/**
+* @brief Number of requests the buffer manager's I/O engine keeps in flight, and the most
+* pages the prefetch thread reads as one batch.
+*/
+const std::uint32_t IOQUEUEDEPTH = 32;
+
 /**
 * forward declaration of BufMgr class 
 */
 class BufMgr;
 
+/**
+* @brief Mode a page latch is taken in
+*/
+enum LatchMode
+{
+	LATCH_SHARED,
+	LATCH_EXCLUSIVE
+};
+
+/**
+* @brief How pages are about to be used, so that pages used once do not push the working
+* set out of the pool. Pages read by a sequential scan and pages written by a bulk load
+* cycle through a small ring of frames of their own, and leave the rest of the pool alone.
+*/
+enum AccessStrategy
+{
+	ACCESS_NORMAL,
+	ACCESS_SEQUENTIAL,
+	ACCESS_BULKWRITE
+};
+
+/**
+* @brief Reader/writer latch protecting the contents of one buffer pool frame.
+* Waiting writers hold off new readers so that a stream of scans cannot starve inserts.
+*/
+class RWLatch {
+
+ private:
+	std::mutex mutex;
+	std::condition_variable released;
+
+	/**
+	 * Number of threads holding the latch shared
+	 */
+	int readers;
+
+	/**
+	 * Number of threads waiting for the latch exclusive
+	 */
+	int writersWaiting;
+
+	/**
+	 * True if a thread holds the latch exclusive
+	 */
+	bool writer;
+
+ public:
+	RWLatch() : readers(0), writersWaiting(0), writer(false) {}
+
+	RWLatch(const RWLatch&) = delete;
+	RWLatch& operator=(const RWLatch&) = delete;
+
+	void lockShared()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (writer || writersWaiting > 0)
+			released.wait(lock);
+		readers++;
+	}
+
+	void unlockShared()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--readers == 0)
+			released.notify_all();
+	}
+
+	void lockExclusive()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		writersWaiting++;
+		while (writer || readers > 0)
+			released.wait(lock);
+		writersWaiting--;
+		writer = true;
+	}
+
+	void unlockExclusive()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		writer = false;
+		released.notify_all();
+	}
+};
+
+/**
+* @brief Array of frames or frame descriptors that can grow and shrink while its elements
+* are in use.
+*
+* Elements live in segments that never move. A directory of the segments is looked up
+* for every access, and is replaced rather than changed when segments come or go, so that
+* an element may be accessed without the lock the resizing thread holds. Directories
+* replaced are kept until the array goes away.
+*/
+template <class T>
+class FrameArray {
+ public:
+	/**
+   * Number of elements of a segment
+	 */
+  static const std::uint32_t SEGMENT_SIZE = 16;
+
+  FrameArray() : size_(0), directory(new std::vector<T*>()) {}
+
+  FrameArray(const FrameArray&) = delete;
+  FrameArray& operator=(const FrameArray&) = delete;
+
+  ~FrameArray()
+  {
+		resize(0);
+		delete directory.load();
+		for (std::size_t i = 0; i < retired.size(); i++)
+		{
+			delete retired[i];
+		}
+  }
+
+  T& operator[](const std::uint32_t index) const
+  {
+		const std::vector<T*>& segments = *directory.load(std::memory_order_acquire);
+		return segments[index / SEGMENT_SIZE][index % SEGMENT_SIZE];
+  }
+
+	/**
+   * Number of elements
+	 */
+  std::uint32_t size() const { return size_; }
+
+	/**
+   * Adds elements at the end, or drops elements from the end. Elements added are default
+   * constructed unless their segment was kept, in which case they are as they were left.
+   * Nobody may be using the elements dropped. Not thread safe with other calls of resize.
+	 *
+	 * @param size  New number of elements
+	 */
+  void resize(const std::uint32_t size)
+  {
+		const std::vector<T*>& current = *directory.load();
+		const std::size_t numSegments = (size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+		if (numSegments != current.size())
+		{
+			std::vector<T*>* segments = new std::vector<T*>(current.begin(),
+			    current.begin() + std::min(numSegments, current.size()));
+			while (segments->size() < numSegments)
+			{
+				segments->push_back(new T[SEGMENT_SIZE]);
+			}
+			for (std::size_t i = numSegments; i < current.size(); i++)
+			{
+				delete [] current[i];
+			}
+			retired.push_back(directory.exchange(segments, std::memory_order_release));
+		}
+		size_ = size;
+  }
+
+ private:
+  std::uint32_t size_;
+  std::atomic<std::vector<T*>*> directory;
+  std::vector<std::vector<T*>*> retired;
+};
+
+/**
+* @brief Frames holding pages of each file, by page number
+*/
+typedef std::map<const File*, std::map<PageId, FrameId> > FileFrameIndex;
+
 /**
 * @brief Class for maintaining information about buffer pool frames
 */
 class BufDesc {
 
 	friend class BufMgr;
+	template <class T> friend class FrameArray;
 
  private:
 	/**
@@ -57,21 +243,73 @@ class BufDesc {
   bool valid;
 
 	/**
-   * Has this buffer frame been reference recently
+   * True if the page has been used other than by a scan or bulk load since it was read in.
+   * Only kept for printing; the replacement policy keeps its own account of use.
 	 */
   bool refbit;
 
+	/**
+   * True while the page is being read into the frame, by a miss in readPage or by a
+   * prefetch. The frame is neither handed out nor replaced until the read is done.
+	 */
+  bool loading;
+
+	/**
+   * True while the background writer writes the page out. The frame is not replaced
+   * until the write is done.
+	 */
+  bool writing;
+
+	/**
+   * True while allocBuf writes the page out before handing the frame out. The page stays
+   * in the hash table meanwhile, so that readers wait for the write rather than read the
+   * old copy from disk; writing is set as well.
+	 */
+  bool evicting;
+
+	/**
+   * Strategy whose ring the frame is in, ACCESS_NORMAL if it is in none. A normal access
+   * to the page takes the frame out of its ring.
+	 */
+  AccessStrategy strategy;
+
+	/**
+   * Latch on the contents of the frame. Only taken while the frame is pinned.
+	 */
+  RWLatch latch;
+
+	/**
+   * Number of times the latch has been released exclusive. Lets a reader that let go
+   * of the latch tell whether the page may have changed since.
+	 */
+  std::uint64_t version;
+
+	/**
+   * Index of the buffer manager that Set and Clear keep the frame in, NULL for none
+	 */
+  FileFrameIndex* fileFrames;
+
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
+		if (file != NULL && fileFrames != NULL)
+		{
+			FileFrameIndex::iterator entry = fileFrames->find(file);
+			entry->second.erase(pageNo);
+			if (entry->second.empty()) fileFrames->erase(entry);
+		}
     pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
     refbit = false;
 		valid = false;
+		loading = false;
+		writing = false;
+		evicting = false;
+		strategy = ACCESS_NORMAL;
   };
 
 	/**
@@ -89,6 +327,8 @@ class BufDesc {
     dirty = false;
     valid = true;
     refbit = true;
+    strategy = ACCESS_NORMAL;
+		if (fileFrames != NULL) (*fileFrames)[file][pageNo] = frameNo;
   }
 
   void Print()
@@ -104,7 +344,10 @@ class BufDesc {
 		std::cout << "valid:" << valid << " ";
 		std::cout << "pinCnt:" << pinCnt << " ";
 		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "refbit:" << refbit << " ";
+		std::cout << "loading:" << loading << " ";
+		std::cout << "writing:" << writing << " ";
+		std::cout << "evicting:" << evicting << "\n";
   }
 
 	/**
@@ -112,6 +355,9 @@ class BufDesc {
 	 */
   BufDesc()
 	{
+		version = 0;
+		file = NULL;
+		fileFrames = NULL;
   	Clear();
   }
 };
@@ -123,10 +369,20 @@ class BufDesc {
 struct BufStats
 {
 	/**
-   * Total number of accesses to buffer pool
+   * Total number of accesses to buffer pool (readPage and allocPage calls)
 	 */
   int accesses;
 
+	/**
+   * Number of readPage calls that found the page in the pool
+	 */
+  int hits;
+
+	/**
+   * Number of pages the replacement policy let go of to make room for others
+	 */
+  int evictions;
+
 	/**
    * Number of pages read from disk (including allocs)
 	 */
@@ -137,12 +393,41 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of pages written back by the background writer (also counted in diskwrites)
+	 */
+  int bgwrites;
+
+	/**
+   * Number of pages read from disk by prefetchPages (also counted in diskreads)
+	 */
+  int prefetchreads;
+
+	/**
+   * Number of frames handed out again by the ring of an access strategy
+	 */
+  int ringreuses;
+
+	/**
+   * Number of pages read from disk soon after the policy let go of them, while among the
+   * pages kept by trackEvictions: the hits as many more frames would have had
+	 */
+  int ghosthits;
+
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = hits = evictions = diskreads = diskwrites = bgwrites = prefetchreads = ringreuses = ghosthits = 0;
+  }
+
+	/**
+   * Fraction of accesses that found the page in the pool
+	 */
+  double hitRate() const
+  {
+		return accesses > 0 ? (double) hits / accesses : 0;
   }
       
 	/**
@@ -155,21 +440,152 @@ struct BufStats
 };
 
 
+/**
+* @brief Settings of the background writer, see BufMgr::startBackgroundWriter
+*/
+struct WriterSettings
+{
+	/**
+   * Most pages written in one round, as one batch
+	 */
+  std::uint32_t pagesPerRound;
+
+	/**
+   * Milliseconds the writer waits between rounds
+	 */
+  std::uint32_t roundMillis;
+
+	/**
+   * Fraction of the frames that may be dirty before the writer starts writing
+	 */
+  double lowWatermark;
+
+	/**
+   * Fraction of the frames dirty above which the writer does not wait between rounds
+	 */
+  double highWatermark;
+
+	/**
+   * Constructor of WriterSettings class, with settings for a pool under steady updates
+	 */
+  WriterSettings()
+    : pagesPerRound(IOQUEUEDEPTH), roundMillis(10), lowWatermark(0.1), highWatermark(0.5) {}
+};
+
+
+/**
+* @brief Pin on a page in the buffer pool, released when the handle goes away.
+*
+* The handle remembers the frame of the page, so unpinning and latching through it need
+* no hash table lookup. A latch taken through the handle is released with the pin, also
+* when an exception unwinds past it. Handles can be moved but not copied; an empty handle
+* holds no pin.
+*/
+class PageHandle {
+
+	friend class BufMgr;
+
+ public:
+	/**
+   * Empty handle
+	 */
+  PageHandle()
+    : bufMgr(NULL), file(NULL), pageNo(Page::INVALID_NUMBER), frameNo(0), page(NULL), dirty(false),
+      latched(false), latchMode(LATCH_SHARED) {}
+
+  PageHandle(PageHandle&& other);
+  PageHandle& operator=(PageHandle&& other);
+  PageHandle(const PageHandle&) = delete;
+  PageHandle& operator=(const PageHandle&) = delete;
+
+	/**
+   * Unpins the page, dirty if markDirty was called, and releases its latch if held
+	 */
+  ~PageHandle();
+
+	/**
+   * True if the handle holds a pin
+	 */
+  explicit operator bool() const { return page != NULL; }
+
+	/**
+   * The page in its frame
+	 */
+  Page* get() const { return page; }
+  Page* operator->() const { return page; }
+
+	/**
+   * Number of the page in its file
+	 */
+  PageId pageNumber() const { return pageNo; }
+
+	/**
+   * Has the page written back before its frame is reused
+	 */
+  void markDirty() { dirty = true; }
+
+	/**
+   * Latch the page, see BufMgr::latchPage
+	 *
+	 * @param mode		Shared or exclusive
+	 */
+  void latch(const LatchMode mode);
+
+	/**
+   * Release a latch taken by latch. The page stays pinned.
+	 *
+	 * @param mode		Mode the latch was taken in
+	 */
+  void unlatch(const LatchMode mode);
+
+	/**
+   * Version of the page, see BufMgr::getPageVersion
+	 */
+  std::uint64_t version() const;
+
+	/**
+   * Releases the latch if held, unpins the page now and empties the handle. Does nothing
+   * for an empty handle.
+	 */
+  void release();
+
+ private:
+  PageHandle(BufMgr* bufMgr, File* file, const PageId pageNo, const FrameId frameNo, Page* page)
+    : bufMgr(bufMgr), file(file), pageNo(pageNo), frameNo(frameNo), page(page), dirty(false),
+      latched(false), latchMode(LATCH_SHARED) {}
+
+  BufMgr* bufMgr;
+  File* file;
+  PageId pageNo;
+  FrameId frameNo;
+  Page* page;
+  bool dirty;
+
+  /**
+   * True while the page is latched through the handle, in latchMode
+   */
+  bool latched;
+  LatchMode latchMode;
+};
+
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
 */
 class BufMgr 
 {
+	friend class PageHandle;
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+   * Number of frames in the buffer pool
 	 */
-  FrameId clockHand;
+  std::uint32_t numBufs;
 
 	/**
-   * Number of frames in the buffer pool
+   * Number of frames holding a dirty page, kept in step by setDirty
 	 */
-  std::uint32_t numBufs;
+  std::uint32_t numDirty;
 	
 	/**
    * Hash table mapping (File, page) to frame
@@ -179,7 +595,7 @@ class BufMgr
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
 	 */
-  BufDesc *bufDescTable;
+  FrameArray<BufDesc> bufDescTable;
 
 	/**
    * Maintains Buffer pool usage statistics 
@@ -187,32 +603,318 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-	 * Allocate a free frame.  
+   * Frames of each file, kept by the frame descriptors, so that flushing a file does
+   * not look at every frame.
+	 */
+  FileFrameIndex fileFrames;
+
+	/**
+   * Decides which page leaves the pool when a frame is needed.
+	 */
+  ReplacementPolicy* policy;
+
+	/**
+   * Serializes all changes to the hash table, the frame descriptors and the policy.
+   * Never held while waiting for a page latch.
+	 */
+  std::mutex poolMutex;
+
+	/**
+   * Pages the policy let go of last, oldest first, up to evictedLimit of them, to count
+   * misses on pages a few more frames would have kept. Empty unless trackEvictions was called.
+	 */
+  typedef std::pair<const File*, PageId> EvictedPage;
+  std::list<EvictedPage> evictedOrder;
+  std::map<EvictedPage, std::list<EvictedPage>::iterator> evictedPages;
+  std::uint32_t evictedLimit;
+
+	/**
+   * Page waiting to be read by the prefetch thread.
+	 */
+  struct PrefetchRequest {
+    File* file;
+    PageId pageNo;
+  };
+
+	/**
+   * Pages waiting to be read ahead, oldest first.
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * Reads the pages of prefetchQueue. Started by the first call to prefetchPages.
+	 */
+  std::thread prefetcher;
+
+	/**
+   * Signalled when requests are queued or the prefetch thread is to stop.
+	 */
+  std::condition_variable prefetchWanted;
+
+	/**
+   * Signalled when pages being read into frames have arrived, and when the background
+   * writer is done writing from frames.
+	 */
+  std::condition_variable ioDone;
+
+	/**
+   * Set by the destructor to stop the prefetch thread.
+	 */
+  bool stopPrefetch;
+
+	/**
+   * Carries out the page reads and writes of the pool.
+	 */
+  IoEngine* ioEngine;
+
+	/**
+   * Body of the prefetch thread.
+	 */
+  void prefetchLoop();
+
+	/**
+   * Writes dirty pages the replacement policy is about to let go of, so that allocBuf
+   * seldom has to. Started by startBackgroundWriter.
+	 */
+  std::thread writer;
+
+	/**
+   * Signalled when allocBuf had to write a page itself, or the writer is to stop.
+	 */
+  std::condition_variable writerWanted;
+
+	/**
+   * Set by the destructor to stop the background writer.
+	 */
+  bool stopWriter;
+
+	/**
+   * Settings of the background writer.
+	 */
+  WriterSettings writerSettings;
+
+	/**
+   * Body of the background writer.
+	 */
+  void writerLoop();
+
+	/**
+   * Writes out up to a round of the dirty, unused pages the policy lets go of next.
+   * Called with poolMutex held through lock, which is let go of during the writes.
 	 *
-	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
-	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 * @param lock    Lock holding poolMutex
+	 * @return  Number of pages written
+	 */
+  std::size_t writeAhead(std::unique_lock<std::mutex>& lock);
+
+	/**
+   * Sets or clears the dirty flag of a frame and counts it in numDirty. Every change of
+   * the flag of a valid frame goes through here. Called with poolMutex held.
+	 *
+	 * @param frameNo  Frame number
+	 * @param dirty    Whether the page in the frame is dirty
+	 */
+  void setDirty(const FrameId frameNo, const bool dirty);
+
+	/**
+   * Pins a page, reading it into a frame if it is not in the pool.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param strategy  How the page is about to be used
+	 * @return  Frame of the page
+	 */
+  FrameId pinPage(File* file, const PageId pageNo, const AccessStrategy strategy);
+
+	/**
+   * Pins pages of consecutive numbers, reading those not in the pool into frames found
+   * in one pass, runs of consecutive pages with one request each.
+	 *
+	 * @param file   	File object
+	 * @param first   Number of the first page
+	 * @param count   Number of pages
+	 * @param frames  Frames of the pages, returned in order
+	 * @param strategy  How the pages are about to be used
+	 */
+  void pinPages(File* file, const PageId first, const std::size_t count, FrameId* frames,
+                const AccessStrategy strategy);
+
+	/**
+   * Pins a page found in the pool, and tells the policy of the use. Called with poolMutex held.
+	 */
+  void pinResident(const FrameId frameNo, const AccessStrategy strategy);
+
+	/**
+   * Enters the page set in a frame into the hash table. The caller has looked the page up
+   * under poolMutex and is holding it still, so a failed insert is a bug in the pool; the
+   * frame is given back to the policy empty. Called with poolMutex held.
+   *
+   * @throws  HashAlreadyPresentException If the page is already in the table
+   * @throws  HashTableException If the table is full
+	 */
+  void insertFrame(const FrameId frameNo, File* file, const PageId pageNo);
+
+	/**
+   * Places a page about to be read in a frame allocBuf handed out, pinned and loading.
+   * Called with poolMutex held.
+	 */
+  void startLoad(const FrameId frameNo, File* file, const PageId pageNo, const AccessStrategy strategy);
+
+	/**
+   * Empties the frame of a page whose read failed. Called with poolMutex held.
+	 */
+  void abandonLoad(const FrameId frameNo);
+
+	/**
+   * Allocates a page in the file and pins it in a frame.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Number of the new page, returned
+	 * @param strategy  How the page is about to be used
+	 * @return  Frame of the page
+	 */
+  FrameId pinNewPage(File* file, PageId& pageNo, const AccessStrategy strategy);
+
+	/**
+   * Unpins the page in a frame, see unPinPage.
+	 */
+  void unPinFrame(const FrameId frameNo, const bool dirty);
+
+	/**
+   * Latches the page in a pinned frame, see latchPage.
 	 */
-  void allocBuf(FrameId & frame);
+  void latchFrame(const FrameId frameNo, const LatchMode mode);
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Releases the latch of the page in a pinned frame, see unlatchPage.
 	 */
-  void advanceClock()
+  void unlatchFrame(const FrameId frameNo, const LatchMode mode);
+
+	/**
+   * Version of the page in a pinned frame, see getPageVersion.
+	 */
+  std::uint64_t frameVersion(const FrameId frameNo) const
   {
-		clockHand = (clockHand + 1) % numBufs;
+		return bufDescTable[frameNo].version;
   }
 
+	/**
+   * Returns the frame of a page in the pool. Called with poolMutex held.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+   * @throws  HashNotFoundException If the page is not in the pool
+	 */
+  FrameId frameOf(const File* file, const PageId pageNo) const;
+
+	/**
+   * Waits until no page of the file is being read into a frame or written from one by
+   * the background writer. Called with poolMutex held through lock.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page to wait for, Page::INVALID_NUMBER for every page of the file
+	 * @param lock    Lock holding poolMutex
+	 */
+  void waitForIo(const File* file, const PageId pageNo, std::unique_lock<std::mutex>& lock);
+
+	/**
+   * Writes pages out as one batch. Called with poolMutex held.
+	 *
+	 * @param requests  Write requests, emptied when they are done
+   * @throws  The first exception writePage threw
+	 */
+  void writeBack(std::vector<IoRequest>& requests);
+
+	/**
+   * Frames an access strategy cycles through, reused in the order they were added.
+	 */
+  struct BufferRing {
+    std::vector<FrameId> frames;
+    std::size_t size;
+    std::size_t next;
+  };
+
+	/**
+   * Rings indexed by AccessStrategy; the one of ACCESS_NORMAL is not used.
+	 */
+  BufferRing rings[3];
+
+	/**
+	 * Allocate a free frame. Called with poolMutex held through lock, which is let go of
+	 * while a dirty page is written out of the frame.
+	 *
+	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param lock    	Lock holding poolMutex
+	 * @param strategy  Strategy the frame is for. Other than for ACCESS_NORMAL, the ring of the
+	 *                  strategy is tried first, and a frame found by the policy joins the ring.
+	 * @return  False if no such buffer is found which can be allocated, as every frame is pinned
+	 */
+  bool allocBuf(FrameId & frame, std::unique_lock<std::mutex>& lock,
+                const AccessStrategy strategy = ACCESS_NORMAL);
+
+	/**
+	 * Takes the next frame of a ring, if it is still in the ring and nobody uses it.
+	 * Called with poolMutex held through lock, like allocBuf.
+	 *
+	 * @param strategy  Strategy of the ring
+	 * @param frame   	Frame ID of the frame returned via this variable
+	 * @param lock    	Lock holding poolMutex
+	 * @return  True if a frame was taken; false if the ring is not full yet, or the frame
+	 *          has to be replaced by one the policy finds
+	 */
+  bool takeRingFrame(const AccessStrategy strategy, FrameId & frame, std::unique_lock<std::mutex>& lock);
+
+	/**
+	 * Writes the dirty page of a frame about to be handed out, with poolMutex let go of.
+	 * Nobody may pin, replace or write the frame meanwhile. On success the page is clean.
+	 * Called with poolMutex held through lock.
+	 *
+	 * @param frame   	Frame of the page
+	 * @param lock    	Lock holding poolMutex
+	 * @return  Exception of the write, empty if it succeeded
+	 */
+  std::exception_ptr writeVictim(const FrameId frame, std::unique_lock<std::mutex>& lock);
+
+	/**
+	 * Sizes the rings of the access strategies for the number of frames, dropping frames
+	 * past the end. Called with poolMutex held.
+	 */
+  void sizeRings();
+
+	/**
+	 * Sets up descriptors of frames added to the pool. Called with poolMutex held.
+	 *
+	 * @param from  First frame added
+	 */
+  void initFrames(const FrameId from);
+
+	/**
+   * Remembers a page the policy let go of, for trackEvictions. Called with poolMutex held.
+	 */
+  void rememberEvicted(const File* file, const PageId pageNo);
+
+	/**
+   * Counts a miss on a page the policy let go of lately in BufStats::ghosthits. Called
+   * with poolMutex held, before a frame is found for the page.
+	 */
+  void countGhostHit(const File* file, const PageId pageNo, const AccessStrategy strategy);
+
 
  public:
 	/**
    * Actual buffer pool from which frames are allocated
 	 */
-  Page* bufPool;
+  FrameArray<Page> bufPool;
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs    Number of frames
+	 * @param engine  I/O engine to use, owned by the buffer manager from here on. NULL for
+	 *                the one IoEngine::create picks.
+	 * @param policyKind  Replacement policy to use
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, IoEngine* engine = NULL, const ReplacementPolicyKind policyKind = REPLACE_CLOCK);
 	
 	/**
    * Destructor of BufMgr class
@@ -227,8 +929,100 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param strategy  How the page is about to be used. ACCESS_SEQUENTIAL for pages a scan reads once.
+	 */
+  void readPage(File* file, const PageId PageNo, Page*& page, const AccessStrategy strategy = ACCESS_NORMAL);
+
+	/**
+	 * Reads the given page like readPage above, and returns a handle that unpins it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number in the file to be read
+	 * @param strategy  How the page is about to be used
+	 * @return  Handle holding the pin on the page
+	 */
+  PageHandle readPage(File* file, const PageId PageNo, const AccessStrategy strategy = ACCESS_NORMAL);
+
+	/**
+	 * Reads pages of consecutive numbers from the file into frames and pins them, like
+	 * readPage for each page. Frames for the pages not in the pool are found in one pass,
+	 * and each run of them is read with one vectored read. Either every page is pinned,
+	 * or none is and the exception is passed on.
+	 *
+	 * @param file   	File object
+	 * @param first   Number of the first page to be read
+	 * @param count   Number of pages
+	 * @param pages   Array of count page pointers, set to the pages in order
+	 * @param strategy  How the pages are about to be used
+   * @throws  BufferExceededException If the pool has too few frames not pinned
+	 */
+  void readPages(File* file, const PageId first, const std::size_t count, Page** pages,
+                 const AccessStrategy strategy = ACCESS_NORMAL);
+
+	/**
+	 * Reads pages like readPages above, and returns handles that unpin them.
+	 *
+	 * @param file   	File object
+	 * @param first   Number of the first page to be read
+	 * @param count   Number of pages
+	 * @param pages   Filled with a handle for each page, in order
+	 * @param strategy  How the pages are about to be used
+	 */
+  void readPages(File* file, const PageId first, const std::size_t count, std::vector<PageHandle>& pages,
+                 const AccessStrategy strategy = ACCESS_NORMAL);
+
+	/**
+	 * Start reading pages the caller expects to read soon into the buffer pool, in the
+	 * background. Pages already in the pool are skipped, and requests are dropped when
+	 * too many are outstanding, so this is only a hint. Nothing is pinned: a later
+	 * readPage finds the page in the pool, or waits for a read still in progress.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers in the file, in the order they should be read
+	 * @param count   Number of page numbers
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void prefetchPages(File* file, const PageId* pageNos, const std::size_t count);
+
+	/**
+	 * Grows or shrinks the pool while it is in use. Frames are added empty. Frames
+	 * dropped from the end have their pages written out if dirty before they go, after
+	 * reads into them and background writes from them are done; the pool keeps its size
+	 * if any of them is pinned or any of the writes fails, and a page that could not be
+	 * written stays dirty in its frame. Pages and pins in the frames kept stay where
+	 * they are.
+	 *
+	 * @param newFrames  New number of frames, at least one
+   * @throws  PagePinnedException If a page in a frame to be dropped is pinned
+   * @throws  The first exception writePage threw for a dirty page to be dropped
+	 */
+  void resize(const std::uint32_t newFrames);
+
+	/**
+	 * Number of frames of the pool
+	 */
+  std::uint32_t numFrames()
+  {
+		std::lock_guard<std::mutex> lock(poolMutex);
+		return numBufs;
+  }
+
+	/**
+	 * Keep the last pages the replacement policy let go of, and count in
+	 * BufStats::ghosthits the reads of pages still among them. The count tells how many
+	 * more hits the pool would have had with that many more frames.
+	 *
+	 * @param pages  Number of pages kept, 0 to stop counting
+	 */
+  void trackEvictions(const std::uint32_t pages);
+
+	/**
+	 * Start the background writer, or change its settings if it runs. Dirty pages that
+	 * nobody has pinned are written out ahead of the replacement policy, and are left in
+	 * the pool clean, so that readPage and allocPage rarely wait for a page to be written.
+	 *
+	 * @param settings  Rate and watermarks of the writer
+	 */
+  void startBackgroundWriter(const WriterSettings& settings = WriterSettings());
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -247,19 +1041,64 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
 	 * @param page  	Reference to page pointer. The newly allocated in-memory Page object is returned via this reference.
+	 * @param strategy  How the page is about to be used. ACCESS_BULKWRITE for pages a bulk load writes once.
+	 */
+  void allocPage(File* file, PageId &PageNo, Page*& page, const AccessStrategy strategy = ACCESS_NORMAL); 
+
+	/**
+	 * Allocates a new page like allocPage above, and returns a handle that unpins it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @param strategy  How the page is about to be used
+	 * @return  Handle holding the pin on the page
 	 */
-  void allocPage(File* file, PageId &PageNo, Page*& page); 
+  PageHandle allocPage(File* file, PageId &PageNo, const AccessStrategy strategy = ACCESS_NORMAL);
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Latch a page pinned by the caller. Shared latches may be held by many threads at once,
+	 * an exclusive latch by one thread only. Page latches are taken in tree order (parent
+	 * before child, left leaf before right leaf) by their users to stay free of deadlocks.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param mode		Shared or exclusive
+   * @throws  PageNotPinnedException If the page is not pinned
+	 */
+  void latchPage(File* file, const PageId PageNo, const LatchMode mode);
+
+	/**
+	 * Release a latch taken by latchPage. The page stays pinned.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @param mode		Mode the latch was taken in
+	 */
+  void unlatchPage(File* file, const PageId PageNo, const LatchMode mode);
+
+	/**
+	 * Number of times the latch of a pinned page has been released exclusive.
+	 * Read it while holding the latch; an unchanged value later means the page is unchanged.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number
+	 * @return  			Version of the page in its frame
+	 */
+  std::uint64_t getPageVersion(File* file, const PageId PageNo);
+
+	/**
+	 * Writes out all dirty pages of the file to disk, and waits until the file is on disk.
+	 * Pages are written in page order, runs of consecutive pages as one vectored write.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
-	 * Otherwise Error returned.
+	 * Otherwise Error returned. Pending prefetches of the file are dropped.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
    * @throws BadBufferException If any frame allocated to the file is found to be invalid
+   * @throws  BadgerDbException The exception of the first failed write. Pages written are
+   *          dropped from the pool, pages that were not stay in it, dirty.
 	 */
-  void flushFile(const File* file);
+  void flushFile(File* file);
 
 	/**
 	 * Delete page from file and also from buffer pool if present.
@@ -283,6 +1122,14 @@ class BufMgr
 		return bufStats;
   }
 
+	/**
+   * Name of the replacement policy, for printing
+	 */
+  const char* getPolicyName() const
+  {
+		return policy->name();
+  }
+
 	/**
    * Clear buffer pool usage statistics
 	 */
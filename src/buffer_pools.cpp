@@ -0,0 +1,182 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <chrono>
+#include <new>
+#include "buffer_pools.h"
+#include "exceptions/page_pinned_exception.h"
+
+namespace badgerdb {
+
+BufferPools::BufferPools(const RebalanceSettings& settings)
+  : settings(settings), stopController(false)
+{
+}
+
+BufferPools::~BufferPools()
+{
+  {
+    std::lock_guard<std::mutex> lock(poolsMutex);
+    stopController = true;
+  }
+  controllerWanted.notify_one();
+  if (controller.joinable())
+  {
+    controller.join();
+  }
+
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    delete pools[i].bufMgr;
+  }
+}
+
+BufMgr* BufferPools::addPool(const std::string& name, const std::uint32_t frames,
+                             const ReplacementPolicyKind policyKind)
+{
+  std::lock_guard<std::mutex> lock(poolsMutex);
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].name == name) return pools[i].bufMgr;
+  }
+
+  Pool pool = {name, new BufMgr(frames, NULL, policyKind), 0};
+  pool.bufMgr->trackEvictions(settings.stepFrames);
+  pools.push_back(pool);
+  return pool.bufMgr;
+}
+
+BufMgr* BufferPools::pool(const std::string& name)
+{
+  std::lock_guard<std::mutex> lock(poolsMutex);
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].name == name) return pools[i].bufMgr;
+  }
+  return NULL;
+}
+
+void BufferPools::route(const std::string& fileName, const std::string& poolName)
+{
+  std::lock_guard<std::mutex> lock(poolsMutex);
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].name == poolName)
+    {
+      routes[fileName] = i;
+      return;
+    }
+  }
+}
+
+BufMgr* BufferPools::poolFor(const std::string& fileName)
+{
+  std::lock_guard<std::mutex> lock(poolsMutex);
+  if (pools.empty()) return NULL;
+  std::map<std::string, std::size_t>::const_iterator it = routes.find(fileName);
+  return pools[it != routes.end() ? it->second : 0].bufMgr;
+}
+
+std::uint32_t BufferPools::rebalance()
+{
+  std::lock_guard<std::mutex> lock(poolsMutex);
+
+  // hits more frames would have given each pool since the last round; cleared stats
+  // count from zero
+  std::vector<int> gains(pools.size());
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    const int ghostHits = pools[i].bufMgr->getBufStats().ghosthits;
+    gains[i] = ghostHits >= pools[i].lastGhostHits ? ghostHits - pools[i].lastGhostHits : ghostHits;
+    pools[i].lastGhostHits = ghostHits;
+  }
+
+  // the last frames of the donor are taken to be worth no more than the frames it would
+  // gain, as hit counts flatten out with more frames
+  std::size_t donor = pools.size();
+  std::size_t receiver = pools.size();
+  for (std::size_t i = 0; i < pools.size(); i++)
+  {
+    if (pools[i].bufMgr->numFrames() >= settings.minFrames + settings.stepFrames &&
+        (donor == pools.size() || gains[i] < gains[donor]))
+    {
+      donor = i;
+    }
+    if (receiver == pools.size() || gains[i] > gains[receiver])
+    {
+      receiver = i;
+    }
+  }
+  if (donor == pools.size() || donor == receiver || gains[receiver] <= gains[donor])
+  {
+    return 0;
+  }
+
+  // the donor lets go of its frames first, so the pools never hold more frames than
+  // before; if the receiver cannot take them, the donor gets them back
+  BufMgr* from = pools[donor].bufMgr;
+  BufMgr* to = pools[receiver].bufMgr;
+  const std::uint32_t donorFrames = from->numFrames();
+  try
+  {
+    from->resize(donorFrames - settings.stepFrames);
+  }
+  catch(PagePinnedException e)
+  {
+    // the frames are in use, another round will do
+    return 0;
+  }
+  catch(BadgerDbException e)
+  {
+    // a dirty page could not be written and stays in the donor, another round will do
+    return 0;
+  }
+  try
+  {
+    to->resize(to->numFrames() + settings.stepFrames);
+  }
+  catch(std::bad_alloc e)
+  {
+    from->resize(donorFrames);
+    throw;
+  }
+  return settings.stepFrames;
+}
+
+void BufferPools::startController()
+{
+  std::lock_guard<std::mutex> lock(poolsMutex);
+  if (!controller.joinable())
+  {
+    controller = std::thread(&BufferPools::controllerLoop, this);
+  }
+}
+
+void BufferPools::controllerLoop()
+{
+  std::unique_lock<std::mutex> lock(poolsMutex);
+  while (!stopController)
+  {
+    controllerWanted.wait_for(lock, std::chrono::milliseconds(settings.roundMillis));
+    if (stopController)
+    {
+      return;
+    }
+    lock.unlock();
+    try
+    {
+      rebalance();
+    }
+    catch(std::bad_alloc e)
+    {
+      // no memory for the frames of the receiver, the donor kept its own
+    }
+    lock.lock();
+  }
+}
+
+}
@@ -0,0 +1,180 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "buffer.h"
+
+namespace badgerdb {
+
+/**
+* @brief Settings of the frame split between pools, see BufferPools
+*/
+struct RebalanceSettings
+{
+	/**
+   * Frames moved from one pool to another in one round; each pool keeps as many of the
+   * pages its policy let go of last to measure what more frames would gain it
+	 */
+  std::uint32_t stepFrames;
+
+	/**
+   * Fewest frames a pool is left with
+	 */
+  std::uint32_t minFrames;
+
+	/**
+   * Milliseconds the controller waits between rounds
+	 */
+  std::uint32_t roundMillis;
+
+	/**
+   * Constructor of RebalanceSettings class
+	 */
+  RebalanceSettings()
+    : stepFrames(8), minFrames(16), roundMillis(100) {}
+};
+
+/**
+* @brief Buffer pools of their own for classes of work, e.g. index, heap and temp, so that
+* pages of one class do not push the pages of another out of memory.
+*
+* Each pool is a BufMgr with its own frames and replacement policy. Files are routed to a
+* pool by name; files not routed go to the first pool added. The total of frames stays the
+* same, but rebalance moves frames from the pool that gains least from its last frames to
+* the one that would gain most from more. The gain of a pool is measured by the misses on
+* pages its policy let go of lately (BufStats::ghosthits), i.e. the hits stepFrames more
+* frames would have given it since the last round.
+*/
+class BufferPools
+{
+ public:
+	/**
+   * Constructor of BufferPools class, with no pools
+	 *
+	 * @param settings  How frames are moved between pools
+	 */
+  explicit BufferPools(const RebalanceSettings& settings = RebalanceSettings());
+
+	/**
+   * Stops the controller and deletes the pools. The files of the pools need to be
+   * flushed beforehand.
+	 */
+  ~BufferPools();
+
+	/**
+	 * Adds a pool. The first pool added takes the files not routed elsewhere.
+	 *
+	 * @param name    Name of the pool
+	 * @param frames  Number of frames of the pool
+	 * @param policyKind  Replacement policy of the pool
+	 * @return  The pool, owned by the pool set; the pool of that name if there is one
+	 */
+  BufMgr* addPool(const std::string& name, const std::uint32_t frames,
+                  const ReplacementPolicyKind policyKind = REPLACE_CLOCK);
+
+	/**
+	 * Returns the pool of a name, NULL if there is none
+	 */
+  BufMgr* pool(const std::string& name);
+
+	/**
+	 * Sends the pages of a file to a pool from here on. Pages of the file already in
+	 * another pool need to be flushed from it first.
+	 *
+	 * @param fileName  Name of the file
+	 * @param poolName  Name of a pool added before
+	 */
+  void route(const std::string& fileName, const std::string& poolName);
+
+	/**
+	 * Returns the pool the pages of a file go to
+	 *
+	 * @param fileName  Name of the file
+	 * @return  The pool routed to, or the first pool added; NULL if there are no pools
+	 */
+  BufMgr* poolFor(const std::string& fileName);
+
+	/**
+	 * Returns the pool the pages of a file go to, see above
+	 */
+  BufMgr* poolFor(const File* file) { return poolFor(file->filename()); }
+
+	/**
+	 * Moves stepFrames frames from the pool whose misses on pages let go of lately were
+	 * fewest since the last round to the pool whose were most, if they differ. A pool
+	 * keeps at least minFrames frames. Nothing moves if the frames to be taken are pinned,
+	 * if a dirty page in them could not be written, or if the receiver cannot be given
+	 * memory for them.
+	 *
+	 * @return  Number of frames moved
+	 * @throws  std::bad_alloc    If the frames could not be added to the receiver
+	 */
+  std::uint32_t rebalance();
+
+	/**
+	 * Start a thread calling rebalance every roundMillis milliseconds. The thread carries on
+	 * past a round that throws.
+	 */
+  void startController();
+
+ private:
+	/**
+   * A pool and the count of ghost hits at the last round.
+	 */
+  struct Pool {
+    std::string name;
+    BufMgr* bufMgr;
+    int lastGhostHits;
+  };
+
+	/**
+   * Body of the controller thread.
+	 */
+  void controllerLoop();
+
+  RebalanceSettings settings;
+
+	/**
+   * Guards pools and routes. Held through a round of rebalance, so rounds do not overlap.
+	 */
+  std::mutex poolsMutex;
+
+	/**
+   * Pools in the order they were added.
+	 */
+  std::vector<Pool> pools;
+
+	/**
+   * Index in pools of the pool of each file routed.
+	 */
+  std::map<std::string, std::size_t> routes;
+
+	/**
+   * Calls rebalance. Started by startController.
+	 */
+  std::thread controller;
+
+	/**
+   * Signalled when the controller is to stop.
+	 */
+  std::condition_variable controllerWanted;
+
+	/**
+   * Set by the destructor to stop the controller.
+	 */
+  bool stopController;
+};
+
+}
@@ -0,0 +1,54 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when the operating system fails a read,
+ *        write or sync of a file, e.g. with EIO or ENOSPC.
+ */
+class FileIOException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file I/O exception for the given file.
+   *
+   * @param name       Name of file the operation failed on.
+   * @param operation  Operation that failed, e.g. "write".
+   * @param error      errno the operation failed with.
+   */
+  FileIOException(const std::string& name, const std::string& operation, const int error);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the errno the operation failed with.
+   */
+  virtual int error() const { return error_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.  A copy, as the file may be
+   * closed by the time the exception is caught.
+   */
+  const std::string filename_;
+
+  /**
+   * errno the operation failed with.
+   */
+  const int error_;
+};
+
+}
@@ -12,18 +12,27 @@
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cstddef>
+#include <cstring>
 #include <cassert>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "file_iterator.h"
 #include "page.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+File::HandleMap File::open_handles_;
 File::CountMap File::open_counts_;
 
 void File::remove(const std::string& filename) {
@@ -58,6 +67,22 @@ File::~File() {
   close();
 }
 
+File::Handle::~Handle() {
+  ::close(fd);
+}
+
+
+Page File::allocatePage(PageId &new_page_number) {
+  Page new_page;
+  allocatePage(new_page_number, new_page);
+  return new_page;
+}
+
+Page File::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
 
 PageId File::getFirstPageNo() {
   const FileHeader& header = readHeader();
@@ -70,7 +95,9 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         FILEHEADERMAGIC, FILEFORMATVERSION, 0 /* last_used_page */,
+                         0 /* first_map_page */};
     writeHeader(header);
   }
 }
@@ -78,54 +105,260 @@ File::File(const std::string& name, const bool create_new) : filename_(name) {
 void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    handle_ = open_handles_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
       if (already_exists) {
         throw FileExistsException(filename_);
       }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      // New files have to be created on open.
+      flags = flags | O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    const int fd = ::open(filename_.c_str(), flags, 0644);
+    if (fd < 0) {
+      throw FileNotFoundException(filename_);
+    }
+    handle_.reset(new Handle(fd));
+
+    // Files opened again share the descriptor, so only the first opener checks the
+    // version.  An upgrade replaces the file, and with it the descriptor.
+    if (!create_new) {
+      // a file without a version and without pages ends before the field, which reads as 0
+      std::uint32_t magic_and_version[2];
+      readBytes(magic_and_version, sizeof(magic_and_version), offsetof(FileHeader, magic));
+      if (magic_and_version[0] != FILEHEADERMAGIC) {
+        upgradeHeader(0);
+      } else if (magic_and_version[1] < FILEFORMATVERSION) {
+        upgradeHeader(magic_and_version[1]);
+      }
+    }
+    open_handles_[filename_] = handle_;
     open_counts_[filename_] = 1;
   }
 }
 
+void File::upgradeHeader(const std::uint32_t version) {
+  FileHeader header;
+  const off_t old_size = version == 0 ? offsetof(FileHeader, magic)
+                                     : offsetof(FileHeader, first_map_page);
+  readBytes(&header, old_size, 0 /* pos */);
+  if (version == 0) {
+    header.last_used_page = Page::INVALID_NUMBER;
+  }
+
+  // The upgraded file is put together beside the old one and renamed over it
+  // once it is on disk, so a crash leaves either the old file or the new one.
+  const std::string staged = filename_ + ".upgrade";
+  const int fd = ::open(staged.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw FileIOException(staged, "create", errno);
+  }
+  std::shared_ptr<Handle> original = handle_;
+  std::shared_ptr<Handle> upgraded(new Handle(fd));
+  try {
+    // Copy the pages back by the bytes the header grows by.
+    const off_t shift = sizeof(FileHeader) - old_size;
+    std::vector<char> buffer(Page::SIZE);
+    for (PageId page_number = 1; page_number < header.num_pages; ++page_number) {
+      handle_ = original;
+      readBytes(&buffer[0], Page::SIZE, pagePosition(page_number) - shift);
+      handle_ = upgraded;
+      writeBytes(&buffer[0], Page::SIZE, pagePosition(page_number));
+    }
+    handle_ = upgraded;
+
+    // Free pages were linked through their next page numbers, off the used list.
+    // Link them in at the tail of the used list and keep the free list in their data.
+    PageId free_page_number = header.first_free_page;
+    if (free_page_number != Page::INVALID_NUMBER &&
+        header.last_used_page == Page::INVALID_NUMBER) {
+      for (PageId page_number = header.first_used_page;
+           page_number != Page::INVALID_NUMBER;
+           page_number = readPageHeader(page_number).next_page_number) {
+        header.last_used_page = page_number;
+      }
+    }
+    while (free_page_number != Page::INVALID_NUMBER) {
+      PageHeader page_header = readPageHeader(free_page_number);
+      const PageId next_free_page_number = page_header.next_page_number;
+      page_header.next_page_number = Page::INVALID_NUMBER;
+      writeBytes(&page_header, sizeof(PageHeader), pagePosition(free_page_number));
+      writeBytes(&next_free_page_number, sizeof(PageId),
+                 pagePosition(free_page_number) + sizeof(PageHeader));
+
+      if (header.last_used_page == Page::INVALID_NUMBER) {
+        header.first_used_page = free_page_number;
+      } else {
+        PageHeader tail_header = readPageHeader(header.last_used_page);
+        tail_header.next_page_number = free_page_number;
+        writeBytes(&tail_header, sizeof(PageHeader), pagePosition(header.last_used_page));
+      }
+      header.last_used_page = free_page_number;
+      free_page_number = next_free_page_number;
+    }
+
+    header.magic = FILEHEADERMAGIC;
+    header.version = FILEFORMATVERSION;
+    header.first_map_page = Page::INVALID_NUMBER;
+    writeHeader(header);
+    sync();
+
+    if (::rename(staged.c_str(), filename_.c_str()) != 0) {
+      throw FileIOException(filename_, "replace", errno);
+    }
+  } catch (BadgerDbException e) {
+    handle_ = original;
+    ::unlink(staged.c_str());
+    throw;
+  }
+
+  // The rename is on disk once the directory is.
+  const std::string::size_type slash = filename_.rfind('/');
+  const std::string directory = slash == std::string::npos ? "." : filename_.substr(0, slash + 1);
+  const int dir_fd = ::open(directory.c_str(), O_RDONLY);
+  if (dir_fd >= 0) {
+    ::fsync(dir_fd);
+    ::close(dir_fd);
+  }
+}
+
+
+PageHeader File::readPageHeader(const PageId page_number) const {
+  PageHeader header;
+  readBytes(&header, sizeof(PageHeader), pagePosition(page_number));
+  return header;
+}
+
+void File::readBytes(void* buffer, const std::size_t size, const off_t position) const {
+  char* bytes = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t count = ::pread(handle_->fd, bytes + done, size - done, position + done);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      throw FileIOException(filename_, "read", errno);
+    }
+    if (count == 0) {
+      // past the end of the file
+      memset(bytes + done, 0, size - done);
+      break;
+    }
+    done += count;
+  }
+}
+
+void File::writeBytes(const void* buffer, const std::size_t size, const off_t position) {
+  const char* bytes = static_cast<const char*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t count = ::pwrite(handle_->fd, bytes + done, size - done, position + done);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      throw FileIOException(filename_, "write", count < 0 ? errno : ENOSPC);
+    }
+    done += count;
+  }
+}
+
+void File::readPages(const PageId first_page_number, Page* const* pages,
+                     const std::size_t count) const {
+  if (count == 0) {
+    return;
+  }
+  std::vector<iovec> vectors(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    vectors[i].iov_base = pages[i];
+    vectors[i].iov_len = Page::SIZE;
+  }
+  ssize_t read;
+  do {
+    read = ::preadv(handle_->fd, &vectors[0], count, pagePosition(first_page_number));
+  } while (read < 0 && errno == EINTR);
+
+  // Pages past a short or refused read, and pages readPage would refuse, are
+  // left to readPage.
+  const std::size_t whole = read > 0 ? read / Page::SIZE : 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (i >= whole || !isRawPageValid(*pages[i])) {
+      readPage(first_page_number + i, *pages[i]);
+    }
+  }
+}
+
+void File::writePages(const PageId first_page_number, const Page* const* pages,
+                      const std::size_t count) {
+  if (!hasRawPageWrites()) {
+    for (std::size_t i = 0; i < count; ++i) {
+      writePage(first_page_number + i, *pages[i]);
+    }
+    return;
+  }
+
+  if (count == 0) {
+    return;
+  }
+  std::vector<iovec> vectors(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    vectors[i].iov_base = const_cast<Page*>(pages[i]);
+    vectors[i].iov_len = Page::SIZE;
+  }
+  ssize_t written;
+  do {
+    written = ::pwritev(handle_->fd, &vectors[0], count, pagePosition(first_page_number));
+  } while (written < 0 && errno == EINTR);
+
+  // Whatever a short or refused write left is written page by page.
+  const std::size_t done = written > 0 ? written : 0;
+  for (std::size_t i = done / Page::SIZE; i < count; ++i) {
+    const std::size_t skip = (i == done / Page::SIZE) ? done % Page::SIZE : 0;
+    writeBytes(reinterpret_cast<const char*>(pages[i]) + skip, Page::SIZE - skip,
+               pagePosition(first_page_number + i) + skip);
+  }
+}
+
+void File::sync() const {
+  int result;
+  do {
+    result = ::fsync(handle_->fd);
+  } while (result != 0 && errno == EINTR);
+  if (result != 0) {
+    throw FileIOException(filename_, "sync", errno);
+  }
+}
+
 void File::close() {
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
+  handle_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_handles_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 FileHeader File::readHeader() const {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  readBytes(&header, sizeof(FileHeader), 0 /* pos */);
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  writeBytes(&header, sizeof(FileHeader), 0 /* pos */);
 }
 
 
@@ -162,102 +395,202 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   return *this;
 }
 
-Page PageFile::allocatePage(PageId &new_page_number) {
+void PageFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::recursive_mutex> latch(handle_->latch);
   FileHeader header = readHeader();
-  Page new_page;
   Page existing_page;
+  PageId existing_page_number = Page::INVALID_NUMBER;
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    // A free page is still in the used list; it keeps its place there, and the
+    // next free page is found in its data.
+    readPage(header.first_free_page, new_page, true /* allow_free */);
+		new_page_number = header.first_free_page;
+    const PageId next_page_number = new_page.next_page_number();
+    memcpy(&header.first_free_page, &new_page.data_[0], sizeof(PageId));
     --header.num_free_pages;
-
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
+    new_page.initialize();
+    new_page.set_page_number(new_page_number);
+    new_page.set_next_page_number(next_page_number);
 
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
+    new_page.initialize();
     new_page.set_page_number(header.num_pages);
 		new_page_number = new_page.page_number();
+    ++header.num_pages;
+    extendMap(header);
 
     if (header.first_used_page == Page::INVALID_NUMBER)
-		{
+    {
       header.first_used_page = new_page.page_number();
     }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+    else
+    {
+      // If we have pages used, we need to add the new page to the tail of the
+      // linked list.
+      if (header.last_used_page == Page::INVALID_NUMBER) {
+        header.last_used_page = findLastUsedPage(header);
       }
-      assert(existing_page.isUsed());
+      // The tail may be a free page, which has no number in its header.
+      existing_page_number = header.last_used_page;
+      readPage(existing_page_number, existing_page, true /* allow_free */);
+      assert(existing_page.next_page_number() == Page::INVALID_NUMBER);
       existing_page.set_next_page_number(new_page.page_number());
     }
-    ++header.num_pages;
+    header.last_used_page = new_page.page_number();
   }
+
   writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
+  if (existing_page_number != Page::INVALID_NUMBER) {
     // If we updated an existing page by inserting the new page into the
     // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+    writePage(existing_page_number, existing_page.header_, existing_page);
   }
+  setFreeSpace(new_page_number, new_page.getFreeSpace());
   writeHeader(header);
+}
 
-  return new_page;
+PageId PageFile::findLastUsedPage(const FileHeader& header) const {
+  PageId page_number = header.first_used_page;
+  PageId next_page_number = readPageHeader(page_number).next_page_number;
+  while (next_page_number != Page::INVALID_NUMBER) {
+    page_number = next_page_number;
+    next_page_number = readPageHeader(page_number).next_page_number;
+  }
+  return page_number;
+}
+
+void PageFile::loadMap() const {
+  if (handle_->map_loaded) {
+    return;
+  }
+  handle_->map_pages.clear();
+  handle_->map_entries.clear();
+  Page map_page;
+  for (PageId map_page_number = readHeader().first_map_page;
+       map_page_number != Page::INVALID_NUMBER;
+       map_page_number = map_page.next_page_number()) {
+    readPage(map_page_number, map_page, true /* allow_free */);
+    handle_->map_pages.push_back(map_page_number);
+    handle_->map_entries.insert(handle_->map_entries.end(), map_page.data_,
+                                map_page.data_ + Page::DATA_SIZE);
+  }
+  handle_->map_hints.assign(16, 1);
+  handle_->map_loaded = true;
 }
 
-Page PageFile::readPage(const PageId page_number) const {
+void PageFile::extendMap(FileHeader& header) {
+  loadMap();
+
+  // A map page is not used, so readPage refuses it; its entries start at 0.
+  while (handle_->map_pages.size() * MAP_ENTRIES < header.num_pages - 1) {
+    const PageId map_page_number = header.num_pages;
+    ++header.num_pages;
+    Page map_page;
+    writePage(map_page_number, map_page.header_, map_page);
+    if (handle_->map_pages.empty()) {
+      header.first_map_page = map_page_number;
+    } else {
+      writeBytes(&map_page_number, sizeof(PageId),
+                 pagePosition(handle_->map_pages.back()) +
+                     offsetof(PageHeader, next_page_number));
+    }
+    handle_->map_pages.push_back(map_page_number);
+    handle_->map_entries.resize(handle_->map_entries.size() + Page::DATA_SIZE, 0);
+  }
+}
+
+void PageFile::setFreeSpace(const PageId page_number, const std::size_t free_space) {
+  loadMap();
+  const std::size_t k = (page_number - 1) / MAP_ENTRIES;
+  if (k >= handle_->map_pages.size()) {
+    return;
+  }
+  std::uint8_t entry = free_space / MAP_UNIT;
+  if (entry > 15) {
+    entry = 15;
+  }
+
+  // Two entries a byte, the lower four bits for the page with the even index.
+  const std::size_t index = (page_number - 1) % MAP_ENTRIES;
+  std::uint8_t& byte = handle_->map_entries[(page_number - 1) / 2];
+  const std::uint8_t new_byte = (index % 2 == 0) ? (byte & 0xF0) | entry
+                                                 : (byte & 0x0F) | (entry << 4);
+  if (new_byte != byte) {
+    writeBytes(&new_byte, 1,
+               pagePosition(handle_->map_pages[k]) + sizeof(PageHeader) + index / 2);
+    byte = new_byte;
+  }
+  for (std::uint8_t e = 0; e <= entry; ++e) {
+    if (handle_->map_hints[e] > page_number) {
+      handle_->map_hints[e] = page_number;
+    }
+  }
+}
+
+RecordId PageFile::insertRecord(const std::string& record_data) {
+  std::lock_guard<std::recursive_mutex> latch(handle_->latch);
+  // Room for the record and a new slot, in whole steps of the map.
+  const std::size_t needed = record_data.length() + sizeof(PageSlot);
+  if (needed > Page::DATA_SIZE) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, record_data.length(),
+                                     Page::DATA_SIZE - sizeof(PageSlot));
+  }
+  const std::size_t needed_entry = (needed + MAP_UNIT - 1) / MAP_UNIT;
+
+  const FileHeader header = readHeader();
+  loadMap();
+  PageId page_number = Page::INVALID_NUMBER;
+  if (needed_entry <= 15) {
+    // Pages before the hint lack the room, and so do the ones passed over here.
+    const std::vector<std::uint8_t>& entries = handle_->map_entries;
+    PageId candidate = handle_->map_hints[needed_entry];
+    for (; candidate < header.num_pages &&
+             (candidate - 1) / 2 < entries.size(); ++candidate) {
+      const std::uint8_t byte = entries[(candidate - 1) / 2];
+      const std::size_t entry = ((candidate - 1) % 2 == 0) ? (byte & 0x0F) : (byte >> 4);
+      if (entry >= needed_entry) {
+        page_number = candidate;
+        break;
+      }
+    }
+    handle_->map_hints[needed_entry] = candidate;
+  }
+
+  Page page;
+  if (page_number == Page::INVALID_NUMBER) {
+    allocatePage(page_number, page);
+  } else {
+    readPage(page_number, page, false /* allow_free */);
+  }
+  const RecordId record_id = page.insertRecord(record_data);
+  writePage(page_number, page);
+  return record_id;
+}
+
+void PageFile::readPage(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPage(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+void PageFile::readPage(const PageId page_number, Page& page, const bool allow_free) const {
+  readBytes(&page.header_, sizeof(PageHeader), pagePosition(page_number));
+  readBytes(&page.data_[0], Page::DATA_SIZE, pagePosition(page_number) + sizeof(PageHeader));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
+	std::lock_guard<std::recursive_mutex> latch(handle_->latch);
 	PageHeader header = readPageHeader(new_page_number);
 	if (header.current_page_number == Page::INVALID_NUMBER)
 	{
@@ -271,36 +604,25 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
 	header = new_page.header_;
 	header.next_page_number = next_page_number;
 	writePage(new_page_number, header, new_page);
+	setFreeSpace(new_page_number, new_page.getFreeSpace());
 }
 
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> latch(handle_->latch);
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
-  } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
-  }
-  // Clear the page and add it to the head of the free list.
+  // The page stays in the used list, so nothing else has to change there.
+  // Clear it and add it to the head of the free list, which is kept in the
+  // data of the free pages.
+  const PageId next_page_number = existing_page.next_page_number();
   existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
+  existing_page.set_next_page_number(next_page_number);
+  memcpy(&existing_page.data_[0], &header.first_free_page, sizeof(PageId));
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
+  setFreeSpace(page_number, 0);
   writeHeader(header);
 }
 
@@ -315,19 +637,10 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  writeBytes(&header, sizeof(PageHeader), pagePosition(page_number));
+  writeBytes(&new_page.data_[0], Page::DATA_SIZE, pagePosition(page_number) + sizeof(PageHeader));
 }
 
-PageHeader PageFile::readPageHeader(PageId page_number) const {
-  PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
-  return header;
-}
 
 
 
@@ -361,35 +674,30 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   return *this;
 }
 
-Page BlobFile::allocatePage(PageId &new_page_number) {
+void BlobFile::allocatePage(PageId &new_page_number, Page& new_page) {
+  std::lock_guard<std::recursive_mutex> latch(handle_->latch);
   FileHeader header = readHeader();
-	Page new_page;
+	new_page.initialize();
 
 	new_page_number = header.num_pages;
 
 	if (header.first_used_page == Page::INVALID_NUMBER) {
 		header.first_used_page = header.num_pages;
 	}
+	header.last_used_page = header.num_pages;
 
 	++header.num_pages;
 
 	writePage(new_page_number, new_page);
 	writeHeader(header);
-
-	return new_page;
 }
 
-Page BlobFile::readPage(const PageId page_number) const {
-	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
-	return page;
+void BlobFile::readPage(const PageId page_number, Page& page) const {
+	readBytes(&page, Page::SIZE, pagePosition(page_number));
 }
 
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeBytes(&new_page, Page::SIZE, pagePosition(new_page_number));
 }
 
 //delePage should not be called for a blob_file, not supported
@@ -7,10 +7,13 @@
 
 #pragma once
 
-#include <fstream>
+#include <cstdint>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
 
 #include "page.h"
 
@@ -18,6 +21,20 @@ namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief Version of the file header written by this code.
+ * Version 1 adds the magic number, the version and the last used page to the header.
+ * Version 2 adds the free-space map and keeps free pages in the used list.
+ * Files of an older version are upgraded when they are opened.
+ */
+const std::uint32_t FILEFORMATVERSION = 2;
+
+/**
+ * @brief Marks a file header of version 1 or later. Its bytes are no printable characters
+ * and no page header, so a file without a version never has them where the field lies.
+ */
+const std::uint32_t FILEHEADERMAGIC = 0xB7D8F1E2;
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -39,9 +56,35 @@ struct FileHeader {
 
   /**
    * Page number of the first free (allocated but unused) page in the file.
+   * A free page stays in the used list where it was deleted; the number of the
+   * next free page is kept in the first bytes of its data.
    */
   PageId first_free_page;
 
+  /**
+   * FILEHEADERMAGIC. Files without a version have no header fields from here on.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Version of the file header.
+   */
+  std::uint32_t version;
+
+  /**
+   * Page number of the last used page in the file, the tail of the used list.
+   * Page::INVALID_NUMBER if there is no used page, or if the file was upgraded
+   * and the tail has not been looked for yet.
+   */
+  PageId last_used_page;
+
+  /**
+   * Page number of the first page of the free-space map, Page::INVALID_NUMBER
+   * if the file has no map yet.  Map pages are linked through their next page
+   * numbers and are not in the used list.
+   */
+  PageId first_map_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +95,11 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        magic == rhs.magic &&
+        version == rhs.version &&
+        last_used_page == rhs.last_used_page &&
+        first_map_page == rhs.first_map_page;
   }
 };
 
@@ -60,15 +107,19 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a descriptor of an underlying file on disk.  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_handles_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
+ *
+ * Pages are read and written at their position with pread and pwrite, so several
+ * threads may read and write pages of an open file at once.  Writes are handed to
+ * the operating system and are only known to be on disk once sync() returns.
  *
- * @warning This class is not threadsafe.
+ * @warning Opening and closing files is not threadsafe.
  */
 
 
@@ -122,7 +173,16 @@ class File {
    *
    * @return The new page.
    */
-  virtual Page allocatePage(PageId &new_page_number) = 0;
+  Page allocatePage(PageId &new_page_number);
+
+  /**
+   * Allocates a new page in the file and builds it in the given page, e.g. a
+   * frame of the buffer pool, rather than in a page that is copied there.
+   *
+   * @param new_page_number   Number of the new page, returned.
+   * @param new_page          Overwritten with the new page.
+   */
+  virtual void allocatePage(PageId &new_page_number, Page& new_page) = 0;
 
   /**
    * Reads an existing page from the file.
@@ -132,7 +192,32 @@ class File {
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
    */
-  virtual Page readPage(const PageId page_number) const = 0;
+  Page readPage(const PageId page_number) const;
+
+  /**
+   * Reads an existing page from the file straight into the given page, e.g. a
+   * frame of the buffer pool.  The page is left undefined if this throws.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Overwritten with the page read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPage(const PageId page_number, Page& page) const = 0;
+
+  /**
+   * Reads existing pages of consecutive numbers straight into the given pages,
+   * e.g. frames of the buffer pool, with one vectored read.  Pages the read
+   * did not return as readPage would are read again with readPage.
+   *
+   * @param first_page_number Number of the first page to read.
+   * @param pages             Overwritten with the pages read, in order.
+   * @param count             Number of pages.
+   * @throws  InvalidPageException  If a page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPages(const PageId first_page_number, Page* const* pages,
+                 const std::size_t count) const;
 
   /**
    * Writes a page into the file at the given page number.
@@ -143,6 +228,18 @@ class File {
    */
   virtual void writePage(const PageId page_number, const Page& new_page) = 0;
 
+  /**
+   * Writes pages of consecutive numbers, e.g. from frames of the buffer pool,
+   * with one vectored write if writePage is a plain write, and one writePage
+   * each otherwise.  No bounds checking is performed.
+   *
+   * @param first_page_number Number of the first page to replace.
+   * @param pages             Pages to write, in order.
+   * @param count             Number of pages.
+   */
+  virtual void writePages(const PageId first_page_number, const Page* const* pages,
+                          const std::size_t count);
+
   /**
    * Deletes a page from the file.
    *
@@ -157,6 +254,28 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Waits until every page written to the file so far is on disk.
+   *
+   * @throws  FileIOException  If the operating system reports that a write
+   *                           since the last sync did not reach the disk.
+   */
+  void sync() const;
+
+  /**
+   * Returns true if a page read as it lies on disk is the page readPage would
+   * return.  Used by I/O engines that read pages without readPage.
+   *
+   * @param page  Page as read from disk.
+   */
+  virtual bool isRawPageValid(const Page& page) const { return true; }
+
+  /**
+   * Returns true if writePage does nothing but write the page where it lies,
+   * so an I/O engine may write it there itself.
+   */
+  virtual bool hasRawPageWrites() const { return true; }
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -172,14 +291,14 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return sizeof(FileHeader) + (static_cast<off_t>(page_number - 1) * Page::SIZE);
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -190,7 +309,51 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Brings the header of a file of an older version up to the current version.
+   * The header grows, so every page is moved back by as many bytes. Free pages
+   * of the old free list are linked in at the tail of the used list. Otherwise
+   * the tail of a file without a version is left to be found by the first
+   * PageFile::allocatePage.  The new file is written beside the old one, synced
+   * and renamed over it, and handle_ is replaced by a handle on it.
+   *
+   * @param version   Version of the header on disk.
+   * @throws  FileIOException  If the new file cannot be written; the old file
+   *                           is left as it was.
+   */
+  void upgradeHeader(const std::uint32_t version);
+
+  /**
+   * Reads only the header of the given page from disk (not the record data
+   * or slot table).  No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose header is to be read.
+   * @return  Header of page.
+   */
+  PageHeader readPageHeader(const PageId page_number) const;
+
+  /**
+   * Reads bytes of the file at the given position.  Bytes past the end of the
+   * file read as zeros.
+   *
+   * @param buffer    Buffer to read into.
+   * @param size      Number of bytes to read.
+   * @param position  Offset from the beginning of the file.
+   * @throws  FileIOException  If the read fails.
+   */
+  void readBytes(void* buffer, const std::size_t size, const off_t position) const;
+
+  /**
+   * Writes bytes to the file at the given position.
+   *
+   * @param buffer    Bytes to write.
+   * @param size      Number of bytes to write.
+   * @param position  Offset from the beginning of the file.
+   * @throws  FileIOException  If the write fails, e.g. when the disk is full.
+   */
+  void writeBytes(const void* buffer, const std::size_t size, const off_t position);
+
+  /**
+   * Closes the underlying descriptor in <handle_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
@@ -210,13 +373,58 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Descriptor of an opened file, shared by the File objects for it.  It is
+   * closed when the last of them lets go of it.
+   */
+  struct Handle {
+    /**
+     * File descriptor.
+     */
+    int fd;
+
+    /**
+     * Serializes changes to the file header, the page lists and the
+     * free-space map, which are read, changed and written back.
+     */
+    std::recursive_mutex latch;
+
+    /**
+     * Whether map_pages and map_entries hold the free-space map of a
+     * PageFile.  They are read in on first use, under the latch, and kept in
+     * step with the map on disk from then on.
+     */
+    bool map_loaded;
+
+    /**
+     * Page numbers of the map pages, in the order of their chain.
+     */
+    std::vector<PageId> map_pages;
+
+    /**
+     * Data of the map pages, one after the other, so the entry of page p is
+     * in byte (p - 1) / 2.
+     */
+    std::vector<std::uint8_t> map_entries;
+
+    /**
+     * For each map entry e, the lowest page whose entry may be e or more;
+     * none of the pages before it has that much room.  insertRecord starts
+     * looking there and setFreeSpace lowers it when a page gains room.
+     */
+    std::vector<PageId> map_hints;
+
+    explicit Handle(const int fd) : fd(fd), map_loaded(false) {}
+    ~Handle();
+  };
+
+  typedef std::map<std::string, std::shared_ptr<Handle> > HandleMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * Descriptors for opened files.
    */
-  static StreamMap open_streams_;
+  static HandleMap open_handles_;
 
   /**
    * Counts for opened files.
@@ -229,11 +437,12 @@ class File {
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<Handle> handle_;
 
   friend class FileIterator;
+  friend class UringIoEngine;
 };
 
 class PageFile : public File {
@@ -249,10 +458,10 @@ class PageFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * open_handles_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -294,25 +503,41 @@ class PageFile : public File {
   ~PageFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file, reusing a free page if there is one.
+   * A reused page keeps its place in the used list; a page at the end of the
+   * file is appended to the tail of the used list.
    *
-   * @return The new page.
+   * @param new_page_number   Number of the new page, returned.
+   * @param new_page          Overwritten with the new page.
    */
-  Page allocatePage(PageId &new_page_number);
+  void allocatePage(PageId &new_page_number, Page& new_page);
+  using File::allocatePage;
+
+  /**
+   * Inserts a record into a used page that the free-space map shows to have
+   * room for it, or into a newly allocated page if there is none.
+   *
+   * @param record_data   Bytes of the record.
+   * @return  ID of the inserted record.
+   * @throws  InsufficientSpaceException  If the record does not fit in an
+   *                                      empty page.
+   */
+  RecordId insertRecord(const std::string& record_data);
 
   /**
    * Reads an existing page from the file.
    *
    * @param page_number   Number of page to read.
-   * @return  The page.
+   * @param page          Overwritten with the page read.
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
    */
-  Page readPage(const PageId page_number) const;
+  void readPage(const PageId page_number, Page& page) const;
+  using File::readPage;
 
   /**
-   * Writes a page into the file at the given page number.
-   * No bounds checking is performed.
+   * Writes a page into the file at the given page number, and records its free
+   * space in the free-space map.  No bounds checking is performed.
    *
    * @param page_number Number of page whose contents to replace.
    * @param new_page    Page to write.
@@ -320,12 +545,27 @@ class PageFile : public File {
   void writePage(const PageId page_number, const Page& new_page);
 
   /**
-   * Deletes a page from the file.
+   * Deletes a page from the file.  The page stays in the used list, where
+   * iterators skip it, until it is allocated again.
    *
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Returns true if the page is used; free pages and map pages are not pages
+   * readPage returns.
+   *
+   * @param page  Page as read from disk.
+   */
+  bool isRawPageValid(const Page& page) const { return page.isUsed(); }
+
+  /**
+   * Returns false, since writePage keeps the next page number on disk and
+   * records the free space of the page in the map.
+   */
+  bool hasRawPageWrites() const { return false; }
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -342,6 +582,19 @@ class PageFile : public File {
   FileIterator end();
 
  private:
+  /**
+   * Number of pages one map page keeps the free space of, at four bits a page.
+   * Map page k of the chain covers pages k * MAP_ENTRIES + 1 to
+   * (k + 1) * MAP_ENTRIES.
+   */
+  static const std::size_t MAP_ENTRIES = Page::DATA_SIZE * 2;
+
+  /**
+   * Bytes of free space per step of a map entry.  An entry of n means the page
+   * has at least n * MAP_UNIT bytes free; 0 is also used for free pages and
+   * map pages.
+   */
+  static const std::size_t MAP_UNIT = Page::DATA_SIZE / 16;
 
   /**
    * Reads a page from the file.  If <allow_free> is not set, an exception
@@ -351,12 +604,12 @@ class PageFile : public File {
    * an exception if the page is past the end of the file.
    *
    * @param page_number   Number of page to read.
+   * @param page          Overwritten with the page read.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPage(const PageId page_number, Page& page, const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -371,13 +624,35 @@ class PageFile : public File {
                  const Page& new_page);
 
   /**
-   * Reads only the header of the given page from disk (not the record data
-   * or slot table).  No bounds checking is performed.
+   * Walks the used list to its tail, for a file upgraded from one without a version.
    *
-   * @param page_number   Number of page whose header is to be read.
-   * @return  Header of page.
+   * @param header  File header.
+   * @return  Page number of the last used page.
    */
-  PageHeader readPageHeader(const PageId page_number) const;
+  PageId findLastUsedPage(const FileHeader& header) const;
+
+  /**
+   * Reads the map pages into the handle, if that has not been done since the
+   * file was opened.
+   */
+  void loadMap() const;
+
+  /**
+   * Adds map pages at the end of the file until the map covers every page in
+   * it, so a map page follows the first page it has an entry for.
+   *
+   * @param header  File header, updated in place and not written.
+   */
+  void extendMap(FileHeader& header);
+
+  /**
+   * Records the free space of a page in the map.  Pages the map does not reach
+   * yet are ignored.  The map entry is written only if it changes.
+   *
+   * @param page_number Number of page.
+   * @param free_space  Bytes free in the page, 0 for a free page.
+   */
+  void setFreeSpace(const PageId page_number, const std::size_t free_space);
 
   friend class FileIterator;
 };
@@ -395,10 +670,10 @@ class BlobFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
 	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * open_handles_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -444,19 +719,22 @@ class BlobFile : public File {
   /**
    * Allocates a new page in the file.
    *
-   * @return The new page.
+   * @param new_page_number   Number of the new page, returned.
+   * @param new_page          Overwritten with the new page.
    */
-  Page allocatePage(PageId &new_page_number);
+  void allocatePage(PageId &new_page_number, Page& new_page);
+  using File::allocatePage;
 
   /**
    * Reads an existing page from the file.
    *
    * @param page_number   Number of page to read.
-   * @return  The page.
+   * @param page          Overwritten with the page read.
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
    */
-  Page readPage(const PageId page_number) const;
+  void readPage(const PageId page_number, Page& page) const;
+  using File::readPage;
 
   /**
    * Writes a page into the file at the given page number.
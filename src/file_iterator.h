@@ -18,7 +18,8 @@ namespace badgerdb {
  * @brief Iterator for iterating over the pages in a file.
  *
  * This class provides a forward-only iterator for iterating over all of the
- * pages in a file.
+ * pages in a file.  Free pages, which stay in the used list until they are
+ * allocated again, are skipped.
  */
 class FileIterator {
  public:
@@ -41,6 +42,7 @@ class FileIterator {
     assert(file_ != NULL);
     const FileHeader& header = file_->readHeader();
     current_page_number_ = header.first_used_page;
+    skipFreePages();
   }
 
   /**
@@ -53,6 +55,7 @@ class FileIterator {
   FileIterator(PageFile* file, PageId page_number)
       : file_(file),
         current_page_number_(page_number) {
+    skipFreePages();
   }
 
   /**
@@ -62,6 +65,7 @@ class FileIterator {
     assert(file_ != NULL);
     const PageHeader& header = file_->readPageHeader(current_page_number_);
     current_page_number_ = header.next_page_number;
+    skipFreePages();
 
 		return *this;
 	}
@@ -74,6 +78,7 @@ class FileIterator {
     assert(file_ != NULL);
     const PageHeader& header = file_->readPageHeader(current_page_number_);
     current_page_number_ = header.next_page_number;
+    skipFreePages();
 
 		return tmp;
 	}
@@ -103,7 +108,28 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the current page without reading the page.
+   *
+   * @return  Page number, Page::INVALID_NUMBER at the end of the file.
+   */
+  inline PageId page_number() const { return current_page_number_; }
+
  private:
+  /**
+   * Moves the iterator past free pages to the next used page, if it is not at
+   * a used page already.
+   */
+  inline void skipFreePages() {
+    while (current_page_number_ != Page::INVALID_NUMBER) {
+      const PageHeader& header = file_->readPageHeader(current_page_number_);
+      if (header.current_page_number != Page::INVALID_NUMBER) {
+        break;
+      }
+      current_page_number_ = header.next_page_number;
+    }
+  }
+
   /**
    * File we're iterating over.
    */
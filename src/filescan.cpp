@@ -14,21 +14,19 @@ FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
 	filePageIter = file->begin();
+	batchPos = 0;
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
+  if (curPage)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
+    curPage.release();
     filePageIter = file->begin();
   }
+  batch.clear();
   bufMgr->flushFile(file);
   delete file;
 }
@@ -43,7 +41,7 @@ void FileScan::scanNext(RecordId& outRid)
 	}
 
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (!curPage)
   {
     // need to get the first page of the file
 		filePageIter = file->begin();
@@ -53,8 +51,7 @@ void FileScan::scanNext(RecordId& outRid)
 		}
 	 
 		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    readCurrentPage();
 
 		// get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -76,19 +73,16 @@ void FileScan::scanNext(RecordId& outRid)
   while (pageRecordIter == curPage->end())
   {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    curPage.release();
 
     filePageIter++;
     if (filePageIter == file->end())
     {
-      curPage = NULL;
 			throw EndOfFileException();
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    readCurrentPage();
 
     // get the first record off the page
     pageRecordIter = curPage->begin(); 
@@ -104,6 +98,26 @@ void FileScan::scanNext(RecordId& outRid)
 	return;
 }
 
+void FileScan::readCurrentPage()
+{
+  const PageId pageNo = filePageIter.page_number();
+  if (batchPos == batch.size() || batch[batchPos].pageNumber() != pageNo)
+  {
+    // pages are mostly allocated in the order they are linked, so the next pages of the
+    // file usually have the next numbers
+    std::size_t count = 1;
+    FileIterator ahead = filePageIter;
+    while (count < SCANBATCHPAGES && (++ahead).page_number() == pageNo + count)
+    {
+      count++;
+    }
+    batch.clear();
+    batchPos = 0;
+    bufMgr->readPages(file, pageNo, count, batch, ACCESS_SEQUENTIAL);
+  }
+  curPage = std::move(batch[batchPos++]);
+}
+
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page 
 std::string FileScan::getRecord()
@@ -114,7 +128,7 @@ std::string FileScan::getRecord()
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  curPage.markDirty();
 }
 
 }
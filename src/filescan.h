@@ -9,6 +9,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
@@ -17,6 +18,11 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Most pages a file scan pins ahead of the page it is on, read as one request
+ */
+const std::size_t SCANBATCHPAGES = 8;
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
@@ -49,17 +55,26 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Current page being scanned, pinned while the scan is on it; unpinned dirty if
+   * markDirty was called for it.
    */
-  Page*         curPage;
+  PageHandle    curPage;
 
-  FileIterator  filePageIter;
-  PageIterator  pageRecordIter;
+  /**
+   * Pages after the current page, read with it as one run of consecutive page numbers
+   * and pinned until the scan gets to them. batchPos is the next one to go to.
+   */
+  std::vector<PageHandle> batch;
+  std::size_t   batchPos;
 
   /**
-   * True if page has been updated
+   * Pins the page filePageIter is at as curPage, from batch if it is there, otherwise
+   * together with the run of consecutively numbered pages that follows it in the file.
    */
-  bool  	      curDirtyFlag;
+  void readCurrentPage();
+
+  FileIterator  filePageIter;
+  PageIterator  pageRecordIter;
 };
 
 }
@@ -0,0 +1,418 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "io_engine.h"
+#include "exceptions/badgerdb_exception.h"
+
+#ifdef BADGERDB_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace badgerdb {
+
+IoEngine* IoEngine::create(const std::uint32_t queueDepth)
+{
+#ifdef BADGERDB_HAVE_IO_URING
+  if (UringIoEngine::available())
+  {
+    return new UringIoEngine(queueDepth);
+  }
+#endif
+  return new ThreadPoolIoEngine(std::min<std::uint32_t>(queueDepth, 8));
+}
+
+void IoEngine::perform(IoRequest& request)
+{
+  try
+  {
+    if (request.kind == IoRequest::READ && request.pages != NULL)
+      request.file->readPages(request.pageNo, request.pages, request.count);
+    else if (request.kind == IoRequest::READ)
+      request.file->readPage(request.pageNo, *request.page);
+    else if (request.pages != NULL)
+      request.file->writePages(request.pageNo, request.pages, request.count);
+    else
+      request.file->writePage(request.pageNo, *request.page);
+  }
+  catch(BadgerDbException e)
+  {
+    request.error = std::current_exception();
+  }
+}
+
+//----------------------------------------
+// ThreadPoolIoEngine
+//----------------------------------------
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(const std::uint32_t threads)
+  : stop(false), numThreads(std::max<std::uint32_t>(threads, 1))
+{
+}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine()
+{
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stop = true;
+  }
+  jobWanted.notify_all();
+  for (std::size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
+  }
+}
+
+void ThreadPoolIoEngine::run(IoRequest* requests, const std::size_t count)
+{
+  if (count == 0) return;
+  if (count == 1)
+  {
+    perform(requests[0]);
+    return;
+  }
+
+  Batch batch;
+  batch.remaining = count;
+  std::unique_lock<std::mutex> lock(queueMutex);
+  if (workers.empty())
+  {
+    for (std::uint32_t i = 0; i < numThreads; i++)
+    {
+      workers.push_back(std::thread(&ThreadPoolIoEngine::workerLoop, this));
+    }
+  }
+  for (std::size_t i = 0; i < count; i++)
+  {
+    Job job = {&requests[i], &batch};
+    jobs.push_back(job);
+  }
+  jobWanted.notify_all();
+
+  while (batch.remaining > 0)
+  {
+    batch.done.wait(lock);
+  }
+}
+
+void ThreadPoolIoEngine::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(queueMutex);
+  while (true)
+  {
+    while (!stop && jobs.empty())
+    {
+      jobWanted.wait(lock);
+    }
+    if (jobs.empty())
+    {
+      return; // stopping, and nothing is left for a batch to wait on
+    }
+
+    Job job = jobs.front();
+    jobs.pop_front();
+    lock.unlock();
+    perform(*job.request);
+    lock.lock();
+
+    if (--job.batch->remaining == 0)
+    {
+      job.batch->done.notify_one();
+    }
+  }
+}
+
+#ifdef BADGERDB_HAVE_IO_URING
+
+//----------------------------------------
+// UringIoEngine
+//----------------------------------------
+
+/**
+ * The rings of an io_uring instance as mapped into this process.
+ */
+struct UringIoEngine::Ring {
+  int fd;
+  void* sqMap;
+  std::size_t sqMapSize;
+  void* cqMap;
+  std::size_t cqMapSize;
+  io_uring_sqe* sqes;
+  std::size_t sqesSize;
+  std::uint32_t entries;
+
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  io_uring_cqe* cqes;
+};
+
+static int uringSetup(const std::uint32_t entries, io_uring_params* params)
+{
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(const int fd, const unsigned toSubmit, const unsigned minComplete)
+{
+  return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                 minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+bool UringIoEngine::available()
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  const int fd = uringSetup(1, &params);
+  if (fd < 0)
+  {
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+UringIoEngine::UringIoEngine(const std::uint32_t queueDepth)
+  : queueDepth(std::max<std::uint32_t>(queueDepth, 1))
+{
+}
+
+UringIoEngine::~UringIoEngine()
+{
+  for (std::size_t i = 0; i < allRings.size(); i++)
+  {
+    closeRing(allRings[i]);
+  }
+}
+
+UringIoEngine::Ring* UringIoEngine::openRing()
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  const int fd = uringSetup(queueDepth, &params);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  Ring* ring = new Ring();
+  ring->fd = fd;
+  ring->entries = params.sq_entries;
+  ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  // newer kernels map both rings at once
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    ring->sqMapSize = ring->cqMapSize = std::max(ring->sqMapSize, ring->cqMapSize);
+  }
+  ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  ring->cqMap = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sqMap :
+      mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+           fd, IORING_OFF_CQ_RING);
+  ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes = static_cast<io_uring_sqe*>(
+      mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+           fd, IORING_OFF_SQES));
+  if (ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED)
+  {
+    closeRing(ring);
+    return NULL;
+  }
+
+  char* sq = static_cast<char*>(ring->sqMap);
+  ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  char* cq = static_cast<char*>(ring->cqMap);
+  ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+  return ring;
+}
+
+void UringIoEngine::closeRing(Ring* ring)
+{
+  if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqesSize);
+  if (ring->cqMap != MAP_FAILED && ring->cqMap != ring->sqMap) munmap(ring->cqMap, ring->cqMapSize);
+  if (ring->sqMap != MAP_FAILED) munmap(ring->sqMap, ring->sqMapSize);
+  close(ring->fd);
+  delete ring;
+}
+
+void UringIoEngine::run(IoRequest* requests, const std::size_t count)
+{
+  if (count == 0) return;
+
+  Ring* ring = NULL;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    if (!idleRings.empty())
+    {
+      ring = idleRings.back();
+      idleRings.pop_back();
+    }
+  }
+  if (ring == NULL)
+  {
+    ring = openRing();
+    if (ring == NULL)
+    {
+      // e.g. out of locked memory for another ring, the requests are done here
+      for (std::size_t i = 0; i < count; i++)
+      {
+        perform(requests[i]);
+      }
+      return;
+    }
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    allRings.push_back(ring);
+  }
+
+  const std::size_t entries = ring->entries;
+  for (std::size_t done = 0; done < count; done += entries)
+  {
+    const std::size_t batch = std::min<std::size_t>(entries, count - done);
+    if (ring == NULL)
+    {
+      for (std::size_t i = done; i < done + batch; i++)
+      {
+        perform(requests[i]);
+      }
+    }
+    else if (!runOnRing(ring, requests + done, batch))
+    {
+      ring = NULL;
+    }
+  }
+
+  if (ring != NULL)
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    idleRings.push_back(ring);
+  }
+}
+
+bool UringIoEngine::runOnRing(Ring* ring, IoRequest* requests, const std::size_t count)
+{
+  // Vectored requests point the kernel at their share of vectors, which must last until reaped.
+  std::size_t numVectors = 0;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    if (requests[i].pages != NULL) numVectors += requests[i].count;
+  }
+  std::vector<iovec> vectors(numVectors);
+
+  // Fill one entry per request; the kernel reads the tail after the entries.
+  unsigned tail = *ring->sqTail;
+  unsigned submitted = 0;
+  std::vector<bool> inFlight(count, false);
+  std::size_t vectorsUsed = 0;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    IoRequest& request = requests[i];
+    if (request.kind == IoRequest::WRITE && !request.file->hasRawPageWrites())
+    {
+      perform(request);
+      continue;
+    }
+
+    const unsigned index = tail & *ring->sqMask;
+    io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request.kind == IoRequest::READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = request.file->handle_->fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(request.page);
+    sqe->len = Page::SIZE;
+    if (request.pages != NULL)
+    {
+      for (std::size_t j = 0; j < request.count; j++)
+      {
+        vectors[vectorsUsed + j].iov_base = request.pages[j];
+        vectors[vectorsUsed + j].iov_len = Page::SIZE;
+      }
+      sqe->opcode = request.kind == IoRequest::READ ? IORING_OP_READV : IORING_OP_WRITEV;
+      sqe->addr = reinterpret_cast<std::uint64_t>(&vectors[vectorsUsed]);
+      sqe->len = request.count;
+      vectorsUsed += request.count;
+    }
+    sqe->off = File::pagePosition(request.pageNo);
+    sqe->user_data = i;
+    ring->sqArray[index] = index;
+    inFlight[i] = true;
+    ++tail;
+    ++submitted;
+  }
+  __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+  unsigned toSubmit = submitted;
+  unsigned reaped = 0;
+  while (reaped < submitted)
+  {
+    const int entered = uringEnter(ring->fd, toSubmit, submitted - reaped);
+    if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    {
+      break; // the ring is broken, whatever is not reaped is done below
+    }
+    if (entered > 0)
+    {
+      toSubmit -= std::min<unsigned>(toSubmit, entered);
+    }
+
+    unsigned head = *ring->cqHead;
+    const unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != cqTail; ++head, ++reaped)
+    {
+      const io_uring_cqe& cqe = ring->cqes[head & *ring->cqMask];
+      IoRequest& request = requests[cqe.user_data];
+      inFlight[cqe.user_data] = false;
+      const std::size_t numPages = request.pages != NULL ? request.count : 1;
+      bool whole = cqe.res == static_cast<int>(numPages * Page::SIZE);
+      for (std::size_t j = 0; whole && request.kind == IoRequest::READ && j < numPages; j++)
+      {
+        whole = request.file->isRawPageValid(request.pages != NULL ? *request.pages[j] : *request.page);
+      }
+      if (!whole)
+      {
+        // short, failed, or not a page readPage would return: let the file decide
+        perform(request);
+      }
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  if (reaped == submitted)
+  {
+    return true;
+  }
+
+  // Unreaped entries could still land in the frames, so the ring is not reused; the
+  // requests not reaped are done here instead, and fail with the file's own exceptions
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    allRings.erase(std::find(allRings.begin(), allRings.end(), ring));
+  }
+  closeRing(ring);
+  for (std::size_t i = 0; i < count; i++)
+  {
+    if (inFlight[i]) perform(requests[i]);
+  }
+  return false;
+}
+
+#endif
+
+}
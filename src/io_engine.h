@@ -0,0 +1,267 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "file.h"
+#include "page.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BADGERDB_HAVE_IO_URING
+#endif
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief A page read or write handed to an IoEngine.
+ */
+struct IoRequest {
+  /**
+   * Whether the page is read into the frame or written from it.
+   */
+  enum Kind { READ, WRITE } kind;
+
+  /**
+   * File the page belongs to.
+   */
+  File* file;
+
+  /**
+   * Number of the page in the file.
+   */
+  PageId pageNo;
+
+  /**
+   * Frame the page is read into or written from.
+   */
+  Page* page;
+
+  /**
+   * Exception readPage or writePage of the file would have thrown, empty if
+   * the request succeeded.
+   */
+  std::exception_ptr error;
+
+  /**
+   * Number of pages of the request, numbered from pageNo on.  For more than one
+   * pages holds their frames in order, the first of them being page.  pages is
+   * NULL for a request of the one page in page.
+   */
+  Page* const* pages;
+  std::size_t count;
+};
+
+/**
+ * @brief Carries out page reads and writes for the buffer manager.
+ *
+ * A batch of requests is started at once and waited for as a whole, so the
+ * device sees as many requests as the batch holds.  Batches of different
+ * threads are in flight at the same time.
+ */
+class IoEngine {
+ public:
+  virtual ~IoEngine() {}
+
+  /**
+   * Starts every request of the batch and waits until all of them are done.
+   * Failures are left in the error of each request.
+   *
+   * @param requests  Requests of the batch.
+   * @param count     Number of requests.
+   */
+  virtual void run(IoRequest* requests, const std::size_t count) = 0;
+
+  /**
+   * Returns the name of the engine, for printing.
+   */
+  virtual const char* name() const = 0;
+
+  /**
+   * Returns an io_uring engine if the kernel has io_uring, a thread pool
+   * engine otherwise.
+   *
+   * @param queueDepth  Number of requests each engine keeps in flight.
+   * @return  New engine, owned by the caller.
+   */
+  static IoEngine* create(const std::uint32_t queueDepth);
+
+ protected:
+  /**
+   * Carries out a request with readPage, readPages, writePage or writePages of
+   * its file.
+   *
+   * @param request   Request to carry out.
+   */
+  static void perform(IoRequest& request);
+};
+
+/**
+ * @brief Engine that hands requests to a pool of threads doing blocking I/O.
+ * A single request is carried out by the calling thread, which would only wait
+ * for a thread of the pool to do it; the threads are started by the first run
+ * of more than one request.
+ */
+class ThreadPoolIoEngine : public IoEngine {
+ public:
+  /**
+   * Constructor of ThreadPoolIoEngine class, with no threads started yet.
+   *
+   * @param threads   Number of threads, and so of requests in flight.
+   */
+  explicit ThreadPoolIoEngine(const std::uint32_t threads);
+
+  /**
+   * Stops the threads once the requests queued are done.
+   */
+  ~ThreadPoolIoEngine();
+
+  void run(IoRequest* requests, const std::size_t count);
+
+  const char* name() const { return "thread pool"; }
+
+ private:
+  /**
+   * Requests of one run() left to be done, and the signal that they are.
+   */
+  struct Batch {
+    std::size_t remaining;
+    std::condition_variable done;
+  };
+
+  /**
+   * Request queued for the threads.
+   */
+  struct Job {
+    IoRequest* request;
+    Batch* batch;
+  };
+
+  /**
+   * Body of the threads.
+   */
+  void workerLoop();
+
+  /**
+   * Guards jobs, stop and the remaining counts of the batches.
+   */
+  std::mutex queueMutex;
+
+  /**
+   * Signalled when jobs are queued or the threads are to stop.
+   */
+  std::condition_variable jobWanted;
+
+  /**
+   * Requests waiting for a thread, oldest first.
+   */
+  std::deque<Job> jobs;
+
+  /**
+   * Set by the destructor to stop the threads.
+   */
+  bool stop;
+
+  /**
+   * Number of threads started by the first batch.
+   */
+  std::uint32_t numThreads;
+
+  std::vector<std::thread> workers;
+};
+
+#ifdef BADGERDB_HAVE_IO_URING
+
+/**
+ * @brief Engine that submits a batch to an io_uring ring with one system call
+ * and reaps the completions as they arrive.
+ *
+ * A run() takes a ring from a pool for as long as it lasts, so threads never
+ * share a ring.  Pages of files whose writePage is not a plain write, and
+ * requests the ring did not complete in full, are done with readPage and
+ * writePage, which also gives the file's own exceptions on failure.
+ */
+class UringIoEngine : public IoEngine {
+ public:
+  /**
+   * @param queueDepth  Number of entries of each ring.
+   */
+  explicit UringIoEngine(const std::uint32_t queueDepth);
+
+  /**
+   * Closes the rings.
+   */
+  ~UringIoEngine();
+
+  void run(IoRequest* requests, const std::size_t count);
+
+  const char* name() const { return "io_uring"; }
+
+  /**
+   * Returns true if the kernel lets this process set up a ring.
+   */
+  static bool available();
+
+ private:
+  struct Ring;
+
+  /**
+   * Sets up a ring.
+   *
+   * @return  The ring, NULL if the kernel refused it.
+   */
+  Ring* openRing();
+
+  /**
+   * Unmaps and closes a ring.
+   */
+  static void closeRing(Ring* ring);
+
+  /**
+   * Submits up to one ring of requests and reaps their completions.
+   *
+   * @param ring      Ring to use.
+   * @param requests  Requests, at most as many as the ring has entries.
+   * @param count     Number of requests.
+   * @return  False if the ring broke and was closed; the requests are done
+   *          regardless.
+   */
+  bool runOnRing(Ring* ring, IoRequest* requests, const std::size_t count);
+
+  /**
+   * Entries of each ring.
+   */
+  std::uint32_t queueDepth;
+
+  /**
+   * Guards idleRings and allRings.
+   */
+  std::mutex ringsMutex;
+
+  /**
+   * Rings no run() is using.
+   */
+  std::vector<Ring*> idleRings;
+
+  /**
+   * Every ring set up, to close in the destructor.
+   */
+  std::vector<Ring*> allRings;
+};
+
+#endif
+
+}
@@ -6,11 +6,15 @@
  */
 
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
+#include "node_search.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
@@ -19,6 +23,11 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
+#include "exceptions/page_pinned_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -70,6 +79,11 @@ void createRelationRandom();
 void createRelationAlot();
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int intCursorScan(BTreeIndex *index, int lowVal1, int highVal1, int lowVal2, int highVal2);
+int intBatchScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize);
+int intConcurrentInserts(BTreeIndex *index, int lowVal, int numThreads, int perThread);
+int intDescendingScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize);
+int intOpenScan(BTreeIndex *index, const int* lowVal, const int* highVal, ScanOrder order);
 void indexTests();
 void doubleTests();
 int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
@@ -80,6 +94,22 @@ void test2();
 void test3();
 void test7();
 void errorTests();
+void indexUpgradeTests();
+void searchKernelTests();
+void longStringKeyTests();
+void ioEngineTests();
+void scanResistanceTests();
+void replacementPolicyTests();
+void hashTableTests();
+void pageHandleTests();
+void inPlaceIoTests();
+void fileUpgradeTests();
+void backgroundWriterTests();
+void evictionWriteTests();
+void flushFileTests();
+void readPagesTests();
+void resizeTests();
+void bufferPoolsTests();
 void deleteRelation();
 
 int main(int argc, char **argv)
@@ -104,7 +134,7 @@ int main(int argc, char **argv)
 			std::cout << "leaf size:" << DOUBLEARRAYLEAFSIZE << " non-leaf size:" << DOUBLEARRAYNONLEAFSIZE << std::endl;
 			break;
 		case 3:
-			std::cout << "leaf size:" << STRINGARRAYLEAFSIZE << " non-leaf size:" << STRINGARRAYNONLEAFSIZE << std::endl;
+			std::cout << "slotted nodes, max key size:" << STRINGSIZE - 1 << std::endl;
 			break;
 	}
 
@@ -137,6 +167,50 @@ int main(int argc, char **argv)
 			new_file.writePage(new_page_number, new_page);
 		}
 
+		// A deleted page is reused in place, and records placed through the
+		// free-space map go to pages with room before the file grows.
+		PageId deleted_page_number = (*new_file.begin()).page_number();
+		new_file.deletePage(deleted_page_number);
+		for (int i = 20; i < 40; ++i)
+		{
+    	sprintf(record1.s, "%05d string record", i);
+    	record1.i = i;
+    	record1.d = (double)i;
+    	std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+			new_file.insertRecord(new_data);
+		}
+		PageId new_page_number;
+		new_file.allocatePage(new_page_number);
+		checkPassFail(new_page_number, deleted_page_number)
+		int num_pages = 0;
+		for (FileIterator iter = new_file.begin(); iter != new_file.end(); ++iter)
+		{
+			++num_pages;
+		}
+		checkPassFail(num_pages, 20)
+
+		// Once large records have filled every page, a page that is emptied
+		// takes the next one before the file grows.
+		const std::string large(Page::DATA_SIZE * 3 / 5, 'x');
+		for (int i = 0; i < num_pages; ++i)
+		{
+			new_file.insertRecord(large);
+		}
+		const RecordId large_id = new_file.insertRecord(large);
+		const PageId emptied_page_number = (*new_file.begin()).page_number();
+		Page emptied = new_file.readPage(emptied_page_number);
+		std::vector<RecordId> emptied_ids;
+		for (PageIterator iter = emptied.begin(); iter != emptied.end(); ++iter)
+		{
+			emptied_ids.push_back(iter.getCurrentRecord());
+		}
+		for (std::size_t i = 0; i < emptied_ids.size(); ++i)
+		{
+			emptied.deleteRecord(emptied_ids[i]);
+		}
+		new_file.writePage(emptied_page_number, emptied);
+		checkPassFail((large_id.page_number != emptied_page_number &&
+		               new_file.insertRecord(large).page_number == emptied_page_number), true)
 	}
 	// new_file goes out of scope here, so file is automatically closed.
 
@@ -183,6 +257,22 @@ int main(int argc, char **argv)
 	test3();
 	//test7();
 	errorTests();
+	indexUpgradeTests();
+	searchKernelTests();
+	longStringKeyTests();
+	ioEngineTests();
+	scanResistanceTests();
+	replacementPolicyTests();
+	hashTableTests();
+	pageHandleTests();
+	inPlaceIoTests();
+	fileUpgradeTests();
+	backgroundWriterTests();
+	evictionWriteTests();
+	flushFileTests();
+	readPagesTests();
+	resizeTests();
+	bufferPoolsTests();
 
 	printf("PASSED ALL TESTS\n");
 
@@ -531,6 +621,42 @@ void intTests()
 	//additional tests
 	checkPassFail(intScan(&index,-1000,GT,6000,LT), 5000)
 
+	// descending scans
+	checkPassFail(intDescendingScan(&index,25,GT,40,LT,4), 14)
+	checkPassFail(intDescendingScan(&index,20,GTE,35,LTE,1000), 16)
+	checkPassFail(intDescendingScan(&index,-1000,GT,6000,LT,100), 5000)
+
+	// insert keys past the end of the relation into the bulk loaded tree
+	RecordId firstRid = {1, 1};
+	for (int i = relationSize; i < relationSize + 2000; i++)
+		index.insertEntry(&i, firstRid);
+	checkPassFail(intScan(&index,relationSize,GTE,relationSize+2000,LT), 2000)
+	checkPassFail(intScan(&index,-1000,GT,relationSize+3000,LT), relationSize+2000)
+
+	// two cursors scanning the index at the same time
+	checkPassFail(intCursorScan(&index,100,2000,1500,3000), 3400)
+
+	// batched scans, with batches smaller and larger than a leaf
+	checkPassFail(intBatchScan(&index,25,GT,40,LT,4), 14)
+	checkPassFail(intBatchScan(&index,20,GTE,35,LTE,1), 16)
+	checkPassFail(intBatchScan(&index,-1000,GT,relationSize+3000,LT,1000), relationSize+2000)
+
+	// threads inserting while another one scans
+	checkPassFail(intConcurrentInserts(&index,relationSize+10000,4,5000), 20000)
+	checkPassFail(intScan(&index,-1000,GT,relationSize+40000,LT), relationSize+22000)
+
+	// ranges open at one or both ends
+	int bound = 100;
+	checkPassFail(intOpenScan(&index,NULL,&bound,DESCENDING), 100)
+	checkPassFail(intOpenScan(&index,&bound,NULL,ASCENDING), relationSize+21900)
+	checkPassFail(intOpenScan(&index,NULL,NULL,DESCENDING), relationSize+22000)
+
+	// scans without read ahead and with a window of one leaf
+	index.setReadAhead(0);
+	checkPassFail(intScan(&index,-1000,GT,relationSize+40000,LT), relationSize+22000)
+	index.setReadAhead(1);
+	checkPassFail(intOpenScan(&index,NULL,NULL,DESCENDING), relationSize+22000)
+	index.setReadAhead(DEFAULTREADAHEAD);
 
 }
 
@@ -594,6 +720,275 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
    return numResults;
 }
 
+// -----------------------------------------------------------------------------
+// intCursorScan
+// interleave two cursors over [lowVal1,highVal1) and [lowVal2,highVal2)
+// -----------------------------------------------------------------------------
+
+int intCursorScan(BTreeIndex * index, int lowVal1, int highVal1, int lowVal2, int highVal2)
+{
+  std::cout << "Interleaved scans for [" << lowVal1 << "," << highVal1 << ") and [";
+  std::cout << lowVal2 << "," << highVal2 << ")" << std::endl;
+
+  ScanCursor* cursor1 = index->openScan(&lowVal1, GTE, &highVal1, LT);
+  ScanCursor* cursor2 = index->openScan(&lowVal2, GTE, &highVal2, LT);
+  bool done1 = false;
+  bool done2 = false;
+  int numResults = 0;
+
+  while(!done1 || !done2)
+  {
+    RecordId scanRid;
+    if(!done1)
+    {
+      try
+      {
+        cursor1->scanNext(scanRid);
+        numResults++;
+      }
+      catch(IndexScanCompletedException e)
+      {
+        done1 = true;
+      }
+    }
+    if(!done2)
+    {
+      try
+      {
+        cursor2->scanNext(scanRid);
+        numResults++;
+      }
+      catch(IndexScanCompletedException e)
+      {
+        done2 = true;
+      }
+    }
+  }
+
+  delete cursor1;
+  delete cursor2;
+  std::cout << "Number of results: " << numResults << std::endl << std::endl;
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// intBatchScan
+// -----------------------------------------------------------------------------
+
+int intBatchScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize)
+{
+  std::cout << "Batched scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowVal << "," << highVal;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << " in batches of " << batchSize << std::endl;
+
+  try
+  {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  }
+  catch(NoSuchKeyFoundException e)
+  {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  std::vector<RecordId> rids(batchSize);
+  int numResults = 0;
+  while(1)
+  {
+    size_t n = index->scanNextBatch(&rids[0], batchSize);
+    numResults += n;
+    if( n < (size_t)batchSize )
+    {
+      break;
+    }
+  }
+
+  // a completed scan keeps returning empty batches
+  if( index->scanNextBatch(&rids[0], batchSize) != 0 )
+  {
+    numResults = -1;
+  }
+  index->endScan();
+  std::cout << "Number of results: " << numResults << std::endl << std::endl;
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// intConcurrentInserts
+// numThreads threads insert perThread keys each from lowVal on, interleaved, while
+// one more thread keeps scanning them. Returns the number of keys found afterwards.
+// -----------------------------------------------------------------------------
+
+int intConcurrentInserts(BTreeIndex * index, int lowVal, int numThreads, int perThread)
+{
+  std::cout << "Concurrent inserts of " << numThreads << "x" << perThread << " keys from " << lowVal << std::endl;
+
+  int highVal = lowVal + numThreads * perThread;
+  std::atomic<bool> inserting(true);
+
+  std::vector<std::thread> inserters;
+  for(int t = 0; t < numThreads; t++)
+  {
+    inserters.push_back(std::thread([=]() {
+      RecordId rid = {1, 1};
+      for(int i = 0; i < perThread; i++)
+      {
+        int key = lowVal + i * numThreads + t;
+        index->insertEntry(&key, rid);
+      }
+    }));
+  }
+
+  // the scanner alternates between both orders, descending scans cross splits leftwards
+  std::thread scanner([&]() {
+    ScanOrder order = ASCENDING;
+    while(inserting)
+    {
+      ScanCursor* cursor;
+      order = (order == ASCENDING) ? DESCENDING : ASCENDING;
+      try
+      {
+        cursor = index->openScan(&lowVal, GTE, &highVal, LT, order);
+      }
+      catch(NoSuchKeyFoundException e)
+      {
+        continue;
+      }
+      std::vector<RecordId> rids(100);
+      while(cursor->scanNextBatch(&rids[0], rids.size()) == rids.size())
+      {
+      }
+      delete cursor;
+    }
+  });
+
+  for(size_t t = 0; t < inserters.size(); t++)
+    inserters[t].join();
+  inserting = false;
+  scanner.join();
+
+  // every key must be found exactly once
+  ScanCursor* cursor = index->openScan(&lowVal, GTE, &highVal, LT);
+  int numResults = 0;
+  RecordId rid;
+  try
+  {
+    while(1)
+    {
+      cursor->scanNext(rid);
+      numResults++;
+    }
+  }
+  catch(IndexScanCompletedException e)
+  {
+  }
+  delete cursor;
+
+  std::cout << "Number of results: " << numResults << std::endl << std::endl;
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// intDescendingScan
+// scan from the high bound down in batches, checking the keys of the records come
+// in descending order. Returns -1 if they do not.
+// -----------------------------------------------------------------------------
+
+int intDescendingScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp, int batchSize)
+{
+  std::cout << "Descending scan for ";
+  if( lowOp == GT ) { std::cout << "("; } else { std::cout << "["; }
+  std::cout << lowVal << "," << highVal;
+  if( highOp == LT ) { std::cout << ")"; } else { std::cout << "]"; }
+  std::cout << " in batches of " << batchSize << std::endl;
+
+  ScanCursor* cursor;
+  try
+  {
+    cursor = index->openScan(&lowVal, lowOp, &highVal, highOp, DESCENDING);
+  }
+  catch(NoSuchKeyFoundException e)
+  {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  std::vector<RecordId> rids(batchSize);
+  int numResults = 0;
+  int lastKey = 0;
+  bool ordered = true;
+  size_t n;
+  do
+  {
+    n = cursor->scanNextBatch(&rids[0], batchSize);
+    for(size_t i = 0; i < n; i++)
+    {
+      Page *curPage;
+      bufMgr->readPage(file1, rids[i].page_number, curPage);
+      RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(rids[i]).data()));
+      bufMgr->unPinPage(file1, rids[i].page_number, false);
+      if( numResults > 0 && myRec.i >= lastKey )
+      {
+        ordered = false;
+      }
+      lastKey = myRec.i;
+      numResults++;
+    }
+  } while( n == (size_t)batchSize );
+  delete cursor;
+
+  if( !ordered )
+  {
+    numResults = -1;
+  }
+  std::cout << "Number of results: " << numResults << std::endl << std::endl;
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// intOpenScan
+// scan with scanNext, a NULL value leaves the range open at that end
+// -----------------------------------------------------------------------------
+
+int intOpenScan(BTreeIndex * index, const int* lowVal, const int* highVal, ScanOrder order)
+{
+  std::cout << "Open scan for ";
+  if( lowVal == NULL ) { std::cout << "(-inf"; } else { std::cout << "[" << *lowVal; }
+  std::cout << ",";
+  if( highVal == NULL ) { std::cout << "+inf)"; } else { std::cout << *highVal << ")"; }
+  std::cout << (order == ASCENDING ? " ascending" : " descending") << std::endl;
+
+  try
+  {
+    index->startScan(lowVal, GTE, highVal, LT, order);
+  }
+  catch(NoSuchKeyFoundException e)
+  {
+    std::cout << "No Key Found satisfying the scan criteria." << std::endl;
+    return 0;
+  }
+
+  int numResults = 0;
+  RecordId rid;
+  try
+  {
+    while(1)
+    {
+      index->scanNext(rid);
+      numResults++;
+    }
+  }
+  catch(IndexScanCompletedException e)
+  {
+  }
+  index->endScan();
+
+  std::cout << "Number of results: " << numResults << std::endl << std::endl;
+  return numResults;
+}
+
 // -----------------------------------------------------------------------------
 // doubleTests
 // -----------------------------------------------------------------------------
@@ -614,6 +1009,16 @@ void doubleTests()
 
 	//additonal tests
 	checkPassFail(doubleScan(&index,-1000,GT,6000,LT), 5000)
+
+	// insert keys past the end of the relation into the bulk loaded tree
+	RecordId firstRid = {1, 1};
+	for (int i = relationSize; i < relationSize + 2000; i++)
+	{
+		double key = i;
+		index.insertEntry(&key, firstRid);
+	}
+	checkPassFail(doubleScan(&index,relationSize,GTE,relationSize+2000,LT), 2000)
+	checkPassFail(doubleScan(&index,-1000,GT,relationSize+3000,LT), relationSize+2000)
 }
 
 int doubleScan(BTreeIndex * index, double lowVal, Operator lowOp, double highVal, Operator highOp)
@@ -695,6 +1100,28 @@ void stringTests()
 	checkPassFail(stringScan(&index,3000,GTE,4000,LT), 1000)
 	//additonal tests
 	checkPassFail(stringScan(&index,-1000,GT,6000,LT), 5000)
+
+	// insert keys past the end of the relation into the bulk loaded tree
+	RecordId firstRid = {1, 1};
+	for (int i = relationSize; i < relationSize + 2000; i++)
+	{
+		char key[100];
+		sprintf(key, "%05d string record", i);
+		index.insertEntry(key, firstRid);
+	}
+	checkPassFail(stringScan(&index,relationSize,GTE,relationSize+2000,LT), 2000)
+	checkPassFail(stringScan(&index,-1000,GT,relationSize+3000,LT), relationSize+2000)
+
+	// long keys that share a long prefix, split across many slotted nodes
+	for (int i = relationSize + 2000; i < relationSize + 4000; i++)
+	{
+		char key[STRINGSIZE];
+		sprintf(key, "%05d string record/%0140d", i, i % 7);
+		index.insertEntry(key, firstRid);
+	}
+	checkPassFail(stringScan(&index,relationSize+2000,GTE,relationSize+4000,LT), 2000)
+	checkPassFail(stringScan(&index,relationSize+1990,GTE,relationSize+2010,LT), 20)
+	checkPassFail(stringScan(&index,-1000,GT,relationSize+5000,LT), relationSize+4000)
 }
 
 int stringScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
@@ -762,6 +1189,1427 @@ int stringScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Oper
 	return numResults;
 }
 
+// -----------------------------------------------------------------------------
+// searchKernelTests
+// every vector kernel the CPU supports gives the answers of the scalar one
+// -----------------------------------------------------------------------------
+
+template<class K>
+int countKernelMismatches(int (*kernel)(const K*, const int, const K), int (*scalar)(const K*, const int, const K),
+                          const std::vector<K>& keys, const std::vector<K>& probes)
+{
+	int mismatches = 0;
+	for (size_t n = 0; n <= keys.size(); n++)
+	{
+		for (size_t i = 0; i < probes.size(); i++)
+		{
+			if (kernel(n == 0 ? NULL : &keys[0], n, probes[i]) != scalar(n == 0 ? NULL : &keys[0], n, probes[i]))
+			{
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
+
+// Sorted keys with runs of equal keys, of each length up to numKeys; one key of each
+// run, the keys between runs and keys below and above every key are searched for.
+// Then keys all equal, searched for with that key and its neighbours.
+template<class K>
+int countKeyMismatches(const SearchKernels& kernels, int (*SearchKernels::*kernel)(const K*, const int, const K), const int numKeys)
+{
+	const SearchKernels scalar = searchKernelTables()[0];
+	std::vector<K> keys;
+	std::vector<K> probes;
+	probes.push_back(-1000);
+	for (int i = 0; i < numKeys; i++)
+	{
+		keys.push_back((K) (2 * (i / 3) - numKeys / 2));
+	}
+	for (int i = 0; i < numKeys; i += 3)
+	{
+		probes.push_back(keys[i]);
+		probes.push_back(keys[i] + 1);
+	}
+	probes.push_back(1000);
+	int mismatches = countKernelMismatches<K>(kernels.*kernel, scalar.*kernel, keys, probes);
+
+	std::vector<K> equal(numKeys, (K) 7);
+	std::vector<K> equalProbes;
+	equalProbes.push_back(6);
+	equalProbes.push_back(7);
+	equalProbes.push_back(8);
+	return mismatches + countKernelMismatches<K>(kernels.*kernel, scalar.*kernel, equal, equalProbes);
+}
+
+void searchKernelTests()
+{
+	std::cout << "Search kernel tests" << std::endl;
+	std::cout << "-------------------" << std::endl;
+	// longer than a vector of each kernel, and not a multiple of any width
+	const int numKeys = 37;
+	const std::vector<SearchKernels> tables = searchKernelTables();
+	checkPassFail(std::string(tables[0].name), std::string("scalar"))
+	checkPassFail(std::string(tables.back().name), std::string(searchKernelName()))
+
+	for (size_t t = 0; t < tables.size(); t++)
+	{
+		std::cout << tables[t].name << " kernels" << std::endl;
+		checkPassFail(countKeyMismatches<int>(tables[t], &SearchKernels::lowerBoundInt, numKeys), 0)
+		checkPassFail(countKeyMismatches<int>(tables[t], &SearchKernels::upperBoundInt, numKeys), 0)
+		checkPassFail(countKeyMismatches<double>(tables[t], &SearchKernels::lowerBoundDouble, numKeys), 0)
+		checkPassFail(countKeyMismatches<double>(tables[t], &SearchKernels::upperBoundDouble, numKeys), 0)
+
+		// the first empty slot at each position, slot numbers and padding of record ids
+		// set all ones or zero so that only page numbers count
+		int mismatches = 0;
+		for (int n = 0; n <= numKeys; n++)
+		{
+			for (int empty = 0; empty <= n; empty++)
+			{
+				std::vector<PageId> pageNos(numKeys + 1, 5);
+				std::vector<RecordId> rids(numKeys + 1);
+				memset(&rids[0], 0xFF, rids.size() * sizeof(RecordId));
+				for (int i = 0; i <= numKeys; i++)
+				{
+					if (i % 2 == 1)
+					{
+						rids[i].slot_number = 0;
+					}
+				}
+				pageNos[empty] = 0;
+				rids[empty].page_number = 0;
+				if (tables[t].countOccupiedPages(&pageNos[0], n) != tables[0].countOccupiedPages(&pageNos[0], n) ||
+				    tables[t].countOccupiedRids(&rids[0], n) != tables[0].countOccupiedRids(&rids[0], n))
+				{
+					mismatches++;
+				}
+			}
+		}
+		checkPassFail(mismatches, 0)
+	}
+
+	// the binary search in front of the kernels, over arrays longer than its window
+	std::vector<int> keys;
+	std::vector<double> doubleKeys;
+	for (int i = 0; i < 500; i++)
+	{
+		keys.push_back(2 * (i / 3));
+		doubleKeys.push_back(2 * (i / 3));
+	}
+	int mismatches = 0;
+	for (int n = 0; n <= (int) keys.size(); n += 7)
+	{
+		for (int key = -1; key <= keys.back() + 1; key++)
+		{
+			if (lowerBound(&keys[0], n, key) != tables[0].lowerBoundInt(&keys[0], n, key) ||
+			    upperBound(&keys[0], n, key) != tables[0].upperBoundInt(&keys[0], n, key) ||
+			    lowerBound(&doubleKeys[0], n, (double) key) != tables[0].lowerBoundInt(&keys[0], n, key) ||
+			    upperBound(&doubleKeys[0], n, (double) key) != tables[0].upperBoundInt(&keys[0], n, key))
+			{
+				mismatches++;
+			}
+		}
+	}
+	checkPassFail(mismatches, 0)
+}
+
+// -----------------------------------------------------------------------------
+// longStringKeyTests
+// inserts of long random string keys split nodes up to the root many times over
+// -----------------------------------------------------------------------------
+
+void longStringKeyTests()
+{
+	std::cout << "Long string key tests" << std::endl;
+	std::cout << "---------------------" << std::endl;
+	const std::string longRelationName = relationName + ".longkeys";
+	const std::string indexName = longRelationName + "." + std::to_string(offsetof(tuple,s));
+	try
+	{
+		File::remove(longRelationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	try
+	{
+		File::remove(indexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile relation = PageFile::create(longRelationName);
+	}
+	{
+		BufMgr pool(500);
+		std::string outIndexName;
+		BTreeIndex index(longRelationName, outIndexName, &pool, offsetof(tuple,s), STRING);
+
+		// keys of 240 to 250 letters; non-leaf nodes keep room for the longest key, yet
+		// short separators still fit where that room is lacking
+		const int numKeys = 20000;
+		unsigned int seed = 12345;
+		for (int i = 0; i < numKeys; i++)
+		{
+			char key[STRINGSIZE];
+			seed = seed * 1103515245 + 12345;
+			const int length = 240 + (seed >> 16) % 11;
+			for (int j = 0; j < length; j++)
+			{
+				seed = seed * 1103515245 + 12345;
+				key[j] = 'a' + (seed >> 16) % 26;
+			}
+			key[length] = '\0';
+			RecordId rid = {(PageId) (i + 1), 1};
+			index.insertEntry(key, rid);
+		}
+
+		int numResults = 0;
+		index.startScan("a", GTE, "{", LTE);
+		try
+		{
+			RecordId scanRid;
+			while (1)
+			{
+				index.scanNext(scanRid);
+				numResults++;
+			}
+		}
+		catch(IndexScanCompletedException e)
+		{
+		}
+		index.endScan();
+		checkPassFail(numResults, numKeys)
+	}
+	File::remove(indexName);
+	File::remove(longRelationName);
+}
+
+// -----------------------------------------------------------------------------
+// indexUpgradeTests
+// index files written in format 1, before the format had a version, are
+// upgraded when they are opened
+// -----------------------------------------------------------------------------
+
+void setFormat1Key(int& slot, const int i) { slot = i; }
+void setFormat1Key(double& slot, const int i) { slot = i + 0.5; }
+void setFormat1Key(char (&slot)[STRINGSIZEFORMAT3], const int i)
+{
+	// format 1 kept the first STRINGSIZEFORMAT3 bytes of the key, with no NUL
+	char key[STRINGSIZE];
+	sprintf(key, "%05d string record", i);
+	strncpy(slot, key, STRINGSIZEFORMAT3);
+}
+
+// Writes the index a format 1 tree had once its first leaf split: the meta page,
+// the leaf of the first root on page 2, its right sibling on page 3 and a new
+// root above both on page 4. Entry i has record id {i + 1, 1}. Format 1 nodes
+// have no count; unused slots have page number 0.
+template<class L_T, class NL_T>
+void writeFormat1Index(const std::string& indexName, const std::string& indexRelationName, const int attrByteOffset,
+                       const Datatype type, const int leftEntries, const int rightEntries)
+{
+	BlobFile file = BlobFile::create(indexName);
+	Page pages[4];
+	for (int i = 0; i < 4; i++)
+	{
+		memset(reinterpret_cast<char*>(&pages[i]), 0, Page::SIZE);
+	}
+
+	IndexMetaInfo* meta = reinterpret_cast<IndexMetaInfo*>(&pages[0]);
+	strcpy(meta->relationName, indexRelationName.c_str());
+	meta->attrByteOffset = attrByteOffset;
+	meta->attrType = type;
+	meta->rootPageNo = 4;
+
+	L_T* left = reinterpret_cast<L_T*>(&pages[1]);
+	L_T* right = reinterpret_cast<L_T*>(&pages[2]);
+	for (int i = 0; i < leftEntries; i++)
+	{
+		setFormat1Key(left->keyArray[i], i);
+		left->ridArray[i].page_number = i + 1;
+		left->ridArray[i].slot_number = 1;
+	}
+	left->rightSibPageNo = 3;
+	for (int i = 0; i < rightEntries; i++)
+	{
+		setFormat1Key(right->keyArray[i], leftEntries + i);
+		right->ridArray[i].page_number = leftEntries + i + 1;
+		right->ridArray[i].slot_number = 1;
+	}
+
+	// format 1 kept the level in a whole int, 1 above the leaves
+	NL_T* root = reinterpret_cast<NL_T*>(&pages[3]);
+	*reinterpret_cast<int*>(root) = 1;
+	setFormat1Key(root->keyArray[0], leftEntries);
+	root->pageNoArray[0] = 2;
+	root->pageNoArray[1] = 3;
+
+	for (int i = 0; i < 4; i++)
+	{
+		PageId pageNo;
+		file.allocatePage(pageNo);
+		file.writePage(pageNo, pages[i]);
+	}
+}
+
+// Scans every entry of the index, -1 if the record ids do not come in order
+int upgradedScan(BTreeIndex* index, const void* lowVal, const void* highVal)
+{
+	int numResults = 0;
+	index->startScan(lowVal, GTE, highVal, LTE);
+	try
+	{
+		while (1)
+		{
+			RecordId scanRid;
+			index->scanNext(scanRid);
+			if (scanRid.page_number != (PageId) (numResults + 1))
+			{
+				numResults = -1;
+				break;
+			}
+			numResults++;
+		}
+	}
+	catch(IndexScanCompletedException e)
+	{
+	}
+	index->endScan();
+	return numResults;
+}
+
+// Counts the entries of a string index in a range of keys "%05d string record"
+int upgradedStringScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	char lowValStr[STRINGSIZE];
+	sprintf(lowValStr, "%05d string record", lowVal);
+	char highValStr[STRINGSIZE];
+	sprintf(highValStr, "%05d string record", highVal);
+	int numResults = 0;
+	try
+	{
+		index->startScan(lowValStr, lowOp, highValStr, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return 0;
+	}
+	try
+	{
+		while (1)
+		{
+			RecordId scanRid;
+			index->scanNext(scanRid);
+			numResults++;
+		}
+	}
+	catch(IndexScanCompletedException e)
+	{
+	}
+	index->endScan();
+	return numResults;
+}
+
+void indexUpgradeTests()
+{
+	std::cout << "Index upgrade tests" << std::endl;
+	std::cout << "-------------------" << std::endl;
+	const std::string upgradeRelationName = relationName + ".format1";
+	const std::string indexName = upgradeRelationName + ".0";
+	std::string outIndexName;
+	const int rightEntries = 100;
+
+	// integer leaves lose a key slot to the left sibling link, so a full
+	// format 1 leaf gives up its last entry, which is inserted again
+	{
+		try
+		{
+			File::remove(indexName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		writeFormat1Index<LeafNodeIntFormat2, NonLeafNodeInt>(indexName, upgradeRelationName, 0, INTEGER, INTARRAYLEAFSIZEFORMAT2, rightEntries);
+		const int total = INTARRAYLEAFSIZEFORMAT2 + rightEntries;
+		const int lowVal = 0;
+		const int highVal = total;
+		for (int round = 0; round < 2; round++)
+		{
+			BTreeIndex index(upgradeRelationName, outIndexName, bufMgr, 0, INTEGER);
+			checkPassFail(upgradedScan(&index, &lowVal, &highVal), total)
+		}
+		File::remove(indexName);
+	}
+
+	{
+		writeFormat1Index<LeafNodeDouble, NonLeafNodeDouble>(indexName, upgradeRelationName, 0, DOUBLE, DOUBLEARRAYLEAFSIZE / 2, rightEntries);
+		const int total = DOUBLEARRAYLEAFSIZE / 2 + rightEntries;
+		const double lowVal = 0;
+		const double highVal = total;
+		for (int round = 0; round < 2; round++)
+		{
+			BTreeIndex index(upgradeRelationName, outIndexName, bufMgr, 0, DOUBLE);
+			checkPassFail(upgradedScan(&index, &lowVal, &highVal), total)
+		}
+		File::remove(indexName);
+	}
+
+	// string nodes are built again as slotted nodes from the relation, as format 1
+	// only kept the first STRINGSIZEFORMAT3 bytes of the keys
+	{
+		const std::string stringIndexName = upgradeRelationName + "." + std::to_string(offsetof(tuple,s));
+		const int total = STRINGARRAYLEAFSIZEFORMAT3 + rightEntries;
+		try
+		{
+			File::remove(upgradeRelationName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		writeFormat1Index<LeafNodeStringFormat3, NonLeafNodeStringFormat3>(stringIndexName, upgradeRelationName,
+		    offsetof(tuple,s), STRING, STRINGARRAYLEAFSIZEFORMAT3, rightEntries);
+
+		// no upgrade without the relation
+		bool thrown = false;
+		try
+		{
+			BTreeIndex index(upgradeRelationName, outIndexName, bufMgr, offsetof(tuple,s), STRING);
+		}
+		catch(BadIndexInfoException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		{
+			PageFile relation = PageFile::create(upgradeRelationName);
+			RECORD record;
+			memset(&record, 0, sizeof(record));
+			for (int i = 0; i < total; i++)
+			{
+				sprintf(record.s, "%05d string record", i);
+				record.i = i;
+				record.d = i;
+				relation.insertRecord(std::string(reinterpret_cast<char*>(&record), sizeof(record)));
+			}
+		}
+		for (int round = 0; round < 2; round++)
+		{
+			BTreeIndex index(upgradeRelationName, outIndexName, bufMgr, offsetof(tuple,s), STRING);
+			checkPassFail(upgradedStringScan(&index, 0, GTE, total, LT), total)
+			checkPassFail(upgradedStringScan(&index, 5, GTE, 5, LTE), 1)
+			checkPassFail(upgradedStringScan(&index, 5, GT, 10, LT), 4)
+			checkPassFail(upgradedStringScan(&index, total - 1, GTE, total + 5, LTE), 1)
+		}
+		File::remove(stringIndexName);
+		File::remove(upgradeRelationName);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// ioEngineTests
+// -----------------------------------------------------------------------------
+
+void ioEngineTests()
+{
+	std::cout << "I/O engine tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	const std::string blobName = relationName + ".io";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	IoEngine* engines[2] = {IoEngine::create(IOQUEUEDEPTH), new ThreadPoolIoEngine(4)};
+	std::cout << "default engine: " << engines[0]->name() << std::endl;
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numPages = 100;
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			blob.allocatePage(pageNos[i]);
+		}
+
+		// each engine writes every page as one batch, and the other engine reads them back
+		for (int e = 0; e < 2; e++)
+		{
+			std::vector<Page> pages(numPages), readPages(numPages);
+			std::vector<IoRequest> writes, reads;
+			for (int i = 0; i < numPages; i++)
+			{
+				sprintf(reinterpret_cast<char*>(&pages[i]), "engine %d page %u", e, pageNos[i]);
+				IoRequest write = {IoRequest::WRITE, &blob, pageNos[i], &pages[i], std::exception_ptr(), NULL, 1};
+				writes.push_back(write);
+				IoRequest read = {IoRequest::READ, &blob, pageNos[i], &readPages[i], std::exception_ptr(), NULL, 1};
+				reads.push_back(read);
+			}
+			engines[e]->run(&writes[0], writes.size());
+			engines[1 - e]->run(&reads[0], reads.size());
+
+			int matching = 0;
+			for (int i = 0; i < numPages; i++)
+			{
+				if (!reads[i].error && strcmp(reinterpret_cast<char*>(&readPages[i]), reinterpret_cast<char*>(&pages[i])) == 0)
+					matching++;
+			}
+			checkPassFail(matching, numPages)
+		}
+	}
+	File::remove(blobName);
+
+	// a page readPage refuses comes back with the file's exception
+	{
+		PageFile file = PageFile::create(blobName);
+		PageId pageNo;
+		file.allocatePage(pageNo);
+		file.deletePage(pageNo);
+		int failed = 0;
+		for (int e = 0; e < 2; e++)
+		{
+			Page page;
+			IoRequest read = {IoRequest::READ, &file, pageNo, &page, std::exception_ptr(), NULL, 1};
+			engines[e]->run(&read, 1);
+			try
+			{
+				if (read.error) std::rethrow_exception(read.error);
+			}
+			catch(InvalidPageException e)
+			{
+				failed++;
+			}
+		}
+		checkPassFail(failed, 2)
+	}
+	File::remove(blobName);
+
+	delete engines[0];
+	delete engines[1];
+}
+
+void scanResistanceTests()
+{
+	std::cout << "Scan resistance tests" << std::endl;
+	std::cout << "---------------------" << std::endl;
+	const std::string blobName = relationName + ".scan";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numHot = 10;
+		const int numPages = 60;
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			blob.allocatePage(pageNos[i]);
+		}
+
+		// a scan three times the size of the pool leaves the pages read before it alone
+		BufMgr pool(20);
+		Page* page;
+		for (int i = 0; i < numHot; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+		pool.clearBufStats();
+		for (int i = numHot; i < numPages; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page, ACCESS_SEQUENTIAL);
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+		checkPassFail(pool.getBufStats().diskreads, numPages - numHot)
+		checkPassFail(pool.getBufStats().ringreuses, numPages - numHot - 2)
+
+		pool.clearBufStats();
+		for (int i = 0; i < numHot; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+		checkPassFail(pool.getBufStats().diskreads, 0)
+	}
+	File::remove(blobName);
+}
+
+void replacementPolicyTests()
+{
+	std::cout << "Replacement policy tests" << std::endl;
+	std::cout << "------------------------" << std::endl;
+	const std::string blobName = relationName + ".policy";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numHot = 10;
+		const int numPages = 110;
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			Page page = blob.allocatePage(pageNos[i]);
+			sprintf(reinterpret_cast<char*>(&page), "page %u", pageNos[i]);
+			blob.writePage(pageNos[i], page);
+		}
+
+		// Point lookups on a hot set mixed with scans that carry no hint. Every policy
+		// has to return the right pages; the ones that tell a page used twice from a page
+		// used once keep the hot set through the scans.
+		const ReplacementPolicyKind kinds[4] = {REPLACE_CLOCK, REPLACE_LRU2, REPLACE_2Q, REPLACE_ARC};
+		double hitRates[4];
+		for (int k = 0; k < 4; k++)
+		{
+			BufMgr pool(20, NULL, kinds[k]);
+			Page* page;
+			int correct = 0;
+			int reads = 0;
+			for (int round = 0; round < 5; round++)
+			{
+				for (int i = 0; i < 2 * numHot; i++)
+				{
+					pool.readPage(&blob, pageNos[i % numHot], page);
+					char expected[32];
+					sprintf(expected, "page %u", pageNos[i % numHot]);
+					if (strcmp(reinterpret_cast<char*>(page), expected) == 0) correct++;
+					pool.unPinPage(&blob, pageNos[i % numHot], false);
+					reads++;
+				}
+				for (int i = numHot + round * 20; i < numHot + (round + 1) * 20; i++)
+				{
+					pool.readPage(&blob, pageNos[i], page);
+					pool.unPinPage(&blob, pageNos[i], false);
+					reads++;
+				}
+			}
+			BufStats& stats = pool.getBufStats();
+			hitRates[k] = stats.hitRate();
+			std::cout << pool.getPolicyName() << ": hit rate " << stats.hitRate()
+			          << ", evictions " << stats.evictions << std::endl;
+			checkPassFail(correct, 5 * 2 * numHot)
+			checkPassFail(stats.accesses, reads)
+			checkPassFail(stats.hits + stats.diskreads, reads)
+			checkPassFail(stats.evictions, stats.diskreads - 20)
+		}
+		// the hot pages are only read from disk in the first round
+		checkPassFail((hitRates[1] > hitRates[0]), true)
+		checkPassFail((hitRates[3] > hitRates[0]), true)
+	}
+	File::remove(blobName);
+}
+
+void hashTableTests()
+{
+	std::cout << "Hash table tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	const std::string blobName = relationName + ".hash";
+	try
+	{
+		File::remove(blobName + "0");
+		File::remove(blobName + "1");
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		// two files' worth of pages, so the table has to tell files apart
+		BlobFile blob0 = BlobFile::create(blobName + "0");
+		BlobFile blob1 = BlobFile::create(blobName + "1");
+		File* files[2] = {&blob0, &blob1};
+		const std::uint32_t numEntries = 1000;
+		BufHashTbl table(numEntries);
+		for (std::uint32_t i = 0; i < numEntries; i++)
+		{
+			table.insert(files[i % 2], i / 2 + 1, i);
+		}
+
+		// a full table refuses more entries, and any table a page it already has
+		checkPassFail(table.insert(files[0], numEntries, numEntries), false)
+		checkPassFail(table.insert(files[1], 1, 0), false)
+
+		// remove every third entry; the others have to stay where lookup finds them
+		int removed = 0;
+		for (std::uint32_t i = 0; i < numEntries; i += 3)
+		{
+			if (table.remove(files[i % 2], i / 2 + 1)) removed++;
+			if (table.remove(files[i % 2], i / 2 + 1)) removed++;
+		}
+		checkPassFail(removed, (numEntries + 2) / 3)
+		int found = 0;
+		int missing = 0;
+		for (std::uint32_t i = 0; i < numEntries; i++)
+		{
+			FrameId frameNo;
+			if (!table.lookup(files[i % 2], i / 2 + 1, frameNo)) missing++;
+			else if (frameNo == i) found++;
+		}
+		checkPassFail(found, numEntries - (numEntries + 2) / 3)
+		checkPassFail(missing, (numEntries + 2) / 3)
+	}
+	File::remove(blobName + "0");
+	File::remove(blobName + "1");
+}
+
+void pageHandleTests()
+{
+	std::cout << "Page handle tests" << std::endl;
+	std::cout << "-----------------" << std::endl;
+	const std::string blobName = relationName + ".handle";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		BufMgr pool(5);
+		PageId pageNo;
+		{
+			// a handle going out of scope unpins its page, dirty as marked
+			PageHandle page = pool.allocPage(&blob, pageNo);
+			strcpy(reinterpret_cast<char*>(page.get()), "written through a handle");
+			page.markDirty();
+		}
+		pool.flushFile(&blob);
+		Page written = blob.readPage(pageNo);
+		checkPassFail(strcmp(reinterpret_cast<char*>(&written), "written through a handle"), 0)
+
+		// the pin moves with the handle and is given up once
+		PageHandle first = pool.readPage(&blob, pageNo);
+		PageHandle second = std::move(first);
+		checkPassFail((!first && second), true)
+		second.latch(LATCH_EXCLUSIVE);
+		second.release();
+		int notPinned = 0;
+		try
+		{
+			pool.unPinPage(&blob, pageNo, false);
+		}
+		catch(PageNotPinnedException e)
+		{
+			notPinned++;
+		}
+		checkPassFail(notPinned, 1)
+
+		// the latch went with the pin, so the page can be latched again
+		PageHandle again = pool.readPage(&blob, pageNo);
+		again.latch(LATCH_EXCLUSIVE);
+		checkPassFail(again.pageNumber(), pageNo)
+	}
+	File::remove(blobName);
+}
+
+void inPlaceIoTests()
+{
+	std::cout << "In place page I/O tests" << std::endl;
+	std::cout << "-----------------------" << std::endl;
+	const std::string fileName = relationName + ".inplace";
+	try
+	{
+		File::remove(fileName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(fileName);
+		PageId kept;
+		Page page = file.allocatePage(kept);
+		const RecordId rid = page.insertRecord("read in place");
+		file.writePage(kept, page);
+
+		// whatever the frame held before is overwritten, not merged
+		Page frame;
+		memset(reinterpret_cast<char*>(&frame), 0x5a, Page::SIZE);
+		file.readPage(kept, frame);
+		checkPassFail((frame.getRecord(rid) == "read in place"), true)
+
+		PageId fresh;
+		memset(reinterpret_cast<char*>(&frame), 0x5a, Page::SIZE);
+		file.allocatePage(fresh, frame);
+		checkPassFail((frame.page_number() == fresh && frame.insertRecord("new").slot_number == 1), true)
+
+		// a reused free page is built in the frame too
+		file.deletePage(fresh);
+		PageId reused;
+		memset(reinterpret_cast<char*>(&frame), 0x5a, Page::SIZE);
+		file.allocatePage(reused, frame);
+		checkPassFail((reused == fresh && frame.page_number() == fresh && frame.insertRecord("new").slot_number == 1), true)
+	}
+	File::remove(fileName);
+}
+
+void fileUpgradeTests()
+{
+	std::cout << "File upgrade tests" << std::endl;
+	std::cout << "------------------" << std::endl;
+	const std::string fileName = relationName + ".unversioned";
+	try
+	{
+		File::remove(fileName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	// A file the way it was written before headers had a version: the header is
+	// the page count and the heads of the used and free lists, and free pages are
+	// linked through their next page numbers, off the used list.
+	{
+		const PageId oldHeader[4] = {4, 1, 1, 2};
+		Page pages[3];
+		const PageId numbers[3][2] = {{1, 3},
+		                              {Page::INVALID_NUMBER, Page::INVALID_NUMBER},
+		                              {3, Page::INVALID_NUMBER}};
+		for (int i = 0; i < 3; i++)
+		{
+			PageHeader* header = reinterpret_cast<PageHeader*>(&pages[i]);
+			header->current_page_number = numbers[i][0];
+			header->next_page_number = numbers[i][1];
+		}
+		const RecordId firstRid = pages[0].insertRecord("first page");
+		const RecordId thirdRid = pages[2].insertRecord("third page");
+		FILE* raw = fopen(fileName.c_str(), "wb");
+		fwrite(oldHeader, sizeof(oldHeader), 1, raw);
+		for (int i = 0; i < 3; i++)
+		{
+			fwrite(&pages[i], Page::SIZE, 1, raw);
+		}
+		fclose(raw);
+
+		{
+			PageFile file = PageFile::open(fileName);
+			std::vector<PageId> used;
+			for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+			{
+				used.push_back((*iter).page_number());
+			}
+			checkPassFail((used.size() == 2 && used[0] == 1 && used[1] == 3), true)
+			checkPassFail((file.readPage(1).getRecord(firstRid) == "first page"), true)
+			checkPassFail((file.readPage(3).getRecord(thirdRid) == "third page"), true)
+
+			// the free page is handed out again before the file grows
+			PageId reused;
+			file.allocatePage(reused);
+			checkPassFail(reused, 2)
+			PageId grown;
+			file.allocatePage(grown);
+			checkPassFail(grown, 4)
+		}
+		checkPassFail(File::exists(fileName + ".upgrade"), false)
+
+		// the upgraded file opens as it is
+		{
+			PageFile file = PageFile::open(fileName);
+			int numUsed = 0;
+			for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+			{
+				++numUsed;
+			}
+			checkPassFail(numUsed, 4)
+			checkPassFail((file.readPage(3).getRecord(thirdRid) == "third page"), true)
+		}
+	}
+	File::remove(fileName);
+}
+
+void backgroundWriterTests()
+{
+	std::cout << "Background writer tests" << std::endl;
+	std::cout << "-----------------------" << std::endl;
+	const std::string blobName = relationName + ".writer";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numDirty = 8;
+		const int numPages = 24;
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			blob.allocatePage(pageNos[i]);
+		}
+
+		BufMgr pool(16);
+		WriterSettings settings;
+		settings.pagesPerRound = 4;
+		settings.roundMillis = 1;
+		settings.lowWatermark = 0;
+		pool.startBackgroundWriter(settings);
+
+		Page* page;
+		for (int i = 0; i < numDirty; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			sprintf(reinterpret_cast<char*>(page), "written behind %d", i);
+			pool.unPinPage(&blob, pageNos[i], true);
+		}
+		for (int waited = 0; waited < 5000 && pool.getBufStats().bgwrites < numDirty; waited++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		checkPassFail(pool.getBufStats().bgwrites, numDirty)
+
+		// the dirty pages are on disk already, so pushing them out of the pool writes nothing
+		for (int i = numDirty; i < numPages; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+		checkPassFail(pool.getBufStats().diskwrites, numDirty)
+
+		char expected[32];
+		sprintf(expected, "written behind %d", numDirty - 1);
+		Page written = blob.readPage(pageNos[numDirty - 1]);
+		checkPassFail(strcmp(reinterpret_cast<char*>(&written), expected), 0)
+	}
+	File::remove(blobName);
+}
+
+void evictionWriteTests()
+{
+	std::cout << "Eviction write tests" << std::endl;
+	std::cout << "--------------------" << std::endl;
+	const std::string blobName = relationName + ".evict";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numThreads = 4;
+		const int pagesPerThread = 8;
+		const int rounds = 50;
+		std::vector<PageId> pageNos(numThreads * pagesPerThread);
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page empty = blob.allocatePage(pageNos[i]);
+			*reinterpret_cast<int*>(&empty) = 0;
+			blob.writePage(pageNos[i], empty);
+		}
+
+		// every read makes room by writing out a dirty page of another thread, with the
+		// pool let go of meanwhile; no update may be lost on the way
+		BufMgr pool(8);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&pool, &blob, &pageNos, t]() {
+				for (int round = 0; round < rounds; round++)
+				{
+					for (int i = 0; i < pagesPerThread; i++)
+					{
+						const PageId pageNo = pageNos[t * pagesPerThread + i];
+						Page* page;
+						pool.readPage(&blob, pageNo, page);
+						(*reinterpret_cast<int*>(page))++;
+						pool.unPinPage(&blob, pageNo, true);
+					}
+				}
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads[t].join();
+		}
+		checkPassFail((pool.getBufStats().diskwrites > 0), true)
+		pool.flushFile(&blob);
+
+		int counted = 0;
+		for (std::size_t i = 0; i < pageNos.size(); i++)
+		{
+			Page written = blob.readPage(pageNos[i]);
+			if (*reinterpret_cast<int*>(&written) == rounds) counted++;
+		}
+		checkPassFail(counted, numThreads * pagesPerThread)
+	}
+	File::remove(blobName);
+}
+
+void flushFileTests()
+{
+	std::cout << "Flush file tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	const std::string blobName = relationName + ".flush";
+	try
+	{
+		File::remove(blobName + "0");
+		File::remove(blobName + "1");
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile flushed = BlobFile::create(blobName + "0");
+		BlobFile kept = BlobFile::create(blobName + "1");
+		const int numPages = 12;
+		std::vector<PageId> flushedNos(numPages);
+		std::vector<PageId> keptNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			flushed.allocatePage(flushedNos[i]);
+			kept.allocatePage(keptNos[i]);
+		}
+
+		// dirty runs of four, one and two pages, written back in page order
+		BufMgr pool(64);
+		Page* page;
+		const int dirty[] = {2, 3, 4, 5, 8, 10, 11};
+		for (int i = 0; i < numPages; i++)
+		{
+			pool.readPage(&kept, keptNos[i], page);
+			pool.unPinPage(&kept, keptNos[i], false);
+		}
+		for (int i = 0; i < 7; i++)
+		{
+			pool.readPage(&flushed, flushedNos[dirty[i]], page);
+			sprintf(reinterpret_cast<char*>(page), "flushed %d", dirty[i]);
+			pool.unPinPage(&flushed, flushedNos[dirty[i]], true);
+		}
+
+		// a pinned page fails the flush before anything is written or dropped
+		pool.readPage(&flushed, flushedNos[0], page);
+		int pinned = 0;
+		try
+		{
+			pool.flushFile(&flushed);
+		}
+		catch(PagePinnedException e)
+		{
+			pinned++;
+		}
+		checkPassFail(pinned, 1)
+		Page onDisk = flushed.readPage(flushedNos[2]);
+		checkPassFail((reinterpret_cast<char*>(&onDisk)[0] == '\0'), true)
+		pool.unPinPage(&flushed, flushedNos[0], false);
+
+		pool.flushFile(&flushed);
+		int matching = 0;
+		for (int i = 0; i < 7; i++)
+		{
+			char expected[32];
+			sprintf(expected, "flushed %d", dirty[i]);
+			onDisk = flushed.readPage(flushedNos[dirty[i]]);
+			if (strcmp(reinterpret_cast<char*>(&onDisk), expected) == 0) matching++;
+		}
+		checkPassFail(matching, 7)
+
+		// pages of other files stay in the pool
+		pool.clearBufStats();
+		for (int i = 0; i < numPages; i++)
+		{
+			pool.readPage(&kept, keptNos[i], page);
+			pool.unPinPage(&kept, keptNos[i], false);
+		}
+		checkPassFail(pool.getBufStats().hits, numPages)
+	}
+	File::remove(blobName + "0");
+	File::remove(blobName + "1");
+
+	// a write that fails leaves its page in the pool, dirty; the other runs are flushed
+	try
+	{
+		File::remove(blobName + "2");
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		PageFile failing = PageFile::create(blobName + "2");
+		PageId pageNos[3];
+		for (int i = 0; i < 3; i++)
+		{
+			failing.allocatePage(pageNos[i]);
+		}
+		BufMgr pool(8);
+		Page* page;
+		pool.readPage(&failing, pageNos[0], page);
+		pool.unPinPage(&failing, pageNos[0], true);
+		pool.readPage(&failing, pageNos[2], page);
+		pool.unPinPage(&failing, pageNos[2], true);
+		failing.deletePage(pageNos[2]);
+
+		int failed = 0;
+		try
+		{
+			pool.flushFile(&failing);
+		}
+		catch(InvalidPageException e)
+		{
+			failed++;
+		}
+		checkPassFail(failed, 1)
+		pool.clearBufStats();
+		pool.readPage(&failing, pageNos[2], page);
+		pool.unPinPage(&failing, pageNos[2], false);
+		pool.readPage(&failing, pageNos[0], page);
+		pool.unPinPage(&failing, pageNos[0], false);
+		checkPassFail((pool.getBufStats().hits == 1 && pool.getBufStats().diskreads == 1), true)
+	}
+	File::remove(blobName + "2");
+}
+
+void readPagesTests()
+{
+	std::cout << "Read pages tests" << std::endl;
+	std::cout << "----------------" << std::endl;
+	const std::string blobName = relationName + ".pages";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numPages = 10;
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			Page page;
+			blob.allocatePage(pageNos[i], page);
+			sprintf(reinterpret_cast<char*>(&page), "page %d", i);
+			blob.writePage(pageNos[i], page);
+		}
+
+		// pages in the pool split the misses into two runs
+		BufMgr pool(16);
+		Page* page;
+		pool.readPage(&blob, pageNos[3], page);
+		pool.unPinPage(&blob, pageNos[3], false);
+		pool.readPage(&blob, pageNos[4], page);
+		pool.unPinPage(&blob, pageNos[4], false);
+		pool.clearBufStats();
+
+		std::vector<Page*> pages(numPages);
+		pool.readPages(&blob, pageNos[0], numPages, &pages[0]);
+		checkPassFail(pool.getBufStats().hits, 2)
+		checkPassFail(pool.getBufStats().diskreads, numPages - 2)
+		int matching = 0;
+		for (int i = 0; i < numPages; i++)
+		{
+			char expected[16];
+			sprintf(expected, "page %d", i);
+			if (strcmp(reinterpret_cast<char*>(pages[i]), expected) == 0) matching++;
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+		checkPassFail(matching, numPages)
+
+		// too few frames: nothing is left pinned
+		BufMgr small(4);
+		small.readPage(&blob, pageNos[0], page);
+		int exceeded = 0;
+		try
+		{
+			small.readPages(&blob, pageNos[1], 4, &pages[0]);
+		}
+		catch(BufferExceededException e)
+		{
+			exceeded++;
+		}
+		checkPassFail(exceeded, 1)
+		std::vector<PageHandle> handles;
+		small.readPages(&blob, pageNos[1], 3, handles);
+		checkPassFail((handles.size() == 3 && handles[2].pageNumber() == pageNos[3]), true)
+		small.unPinPage(&blob, pageNos[0], false);
+	}
+	File::remove(blobName);
+}
+
+void resizeTests()
+{
+	std::cout << "Resize tests" << std::endl;
+	std::cout << "------------" << std::endl;
+	const std::string blobName = relationName + ".resize";
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile blob = BlobFile::create(blobName);
+		const int numPages = 16;
+		std::vector<PageId> pageNos(numPages);
+		for (int i = 0; i < numPages; i++)
+		{
+			blob.allocatePage(pageNos[i]);
+		}
+
+		// a pinned page stays in its frame while the pool grows and shrinks around it
+		BufMgr pool(4);
+		PageHandle pinned = pool.readPage(&blob, pageNos[0]);
+		strcpy(reinterpret_cast<char*>(pinned.get()), "stays pinned");
+		Page* page;
+		for (int i = 1; i < 4; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+
+		pool.resize(numPages);
+		pool.clearBufStats();
+		for (int i = 1; i < numPages; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			if (i == numPages - 1) sprintf(reinterpret_cast<char*>(page), "dropped dirty");
+			pool.unPinPage(&blob, pageNos[i], i == numPages - 1);
+		}
+		checkPassFail((pool.numFrames() == numPages && pool.getBufStats().hits == 3 &&
+		               pool.getBufStats().evictions == 0), true)
+
+		// the last frame holds the last page read; pinned, it keeps the pool from shrinking
+		pool.readPage(&blob, pageNos[numPages - 1], page);
+		int refused = 0;
+		try
+		{
+			pool.resize(8);
+		}
+		catch(PagePinnedException e)
+		{
+			refused++;
+		}
+		checkPassFail((refused == 1 && pool.numFrames() == numPages), true)
+		pool.unPinPage(&blob, pageNos[numPages - 1], false);
+
+		pool.resize(8);
+		Page written = blob.readPage(pageNos[numPages - 1]);
+		checkPassFail(strcmp(reinterpret_cast<char*>(&written), "dropped dirty"), 0)
+		checkPassFail(strcmp(reinterpret_cast<char*>(pinned.get()), "stays pinned"), 0)
+		pool.clearBufStats();
+		for (int i = 0; i < 8; i++)
+		{
+			pool.readPage(&blob, pageNos[i], page);
+			pool.unPinPage(&blob, pageNos[i], false);
+		}
+		checkPassFail((pool.numFrames() == 8 && pool.getBufStats().hits == 8), true)
+	}
+	File::remove(blobName);
+
+	const std::string pagedName = relationName + ".resize.paged";
+	try
+	{
+		File::remove(pagedName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile paged = PageFile::create(pagedName);
+		std::vector<PageId> pageNos(4);
+		for (int i = 0; i < 4; i++)
+		{
+			paged.allocatePage(pageNos[i]);
+		}
+
+		// a dirty page that cannot be written keeps the pool from shrinking and stays in it
+		BufMgr pool(4);
+		Page* page;
+		for (int i = 0; i < 4; i++)
+		{
+			pool.readPage(&paged, pageNos[i], page);
+			if (i == 3) page->insertRecord("kept dirty");
+			pool.unPinPage(&paged, pageNos[i], i == 3);
+		}
+		paged.deletePage(pageNos[3]);
+		int failed = 0;
+		try
+		{
+			pool.resize(2);
+		}
+		catch(InvalidPageException e)
+		{
+			failed++;
+		}
+		pool.clearBufStats();
+		pool.readPage(&paged, pageNos[3], page);
+		pool.unPinPage(&paged, pageNos[3], false);
+		checkPassFail((failed == 1 && pool.numFrames() == 4 && pool.getBufStats().hits == 1), true)
+
+		// once the page is back in the file the shrink writes it and goes through
+		PageId reused;
+		paged.allocatePage(reused);
+		checkPassFail(reused, pageNos[3])
+		pool.resize(2);
+		Page written = paged.readPage(pageNos[3]);
+		checkPassFail((pool.numFrames() == 2 && *written.begin() == "kept dirty"), true)
+	}
+	File::remove(pagedName);
+}
+
+void bufferPoolsTests()
+{
+	std::cout << "Buffer pools tests" << std::endl;
+	std::cout << "------------------" << std::endl;
+	const std::string indexBlobName = relationName + ".pools.index";
+	const std::string heapBlobName = relationName + ".pools.heap";
+	try
+	{
+		File::remove(indexBlobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	try
+	{
+		File::remove(heapBlobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BlobFile indexBlob = BlobFile::create(indexBlobName);
+		BlobFile heapBlob = BlobFile::create(heapBlobName);
+		const int numIndexPages = 20;
+		const int numHeapPages = 64;
+		std::vector<PageId> indexPages(numIndexPages);
+		std::vector<PageId> heapPages(numHeapPages);
+		for (int i = 0; i < numIndexPages; i++)
+		{
+			indexBlob.allocatePage(indexPages[i]);
+		}
+		for (int i = 0; i < numHeapPages; i++)
+		{
+			heapBlob.allocatePage(heapPages[i]);
+		}
+
+		RebalanceSettings settings;
+		settings.stepFrames = 4;
+		settings.minFrames = 8;
+		BufferPools pools(settings);
+		BufMgr* heap = pools.addPool("heap", 16);
+		BufMgr* index = pools.addPool("index", 16);
+		BufMgr* temp = pools.addPool("temp", 8, REPLACE_ARC);
+		pools.route(indexBlobName, "index");
+		checkPassFail((pools.poolFor(&indexBlob) == index && pools.poolFor(&heapBlob) == heap &&
+		               pools.pool("temp") == temp && pools.pool("sort") == NULL &&
+		               pools.addPool("heap", 32) == heap), true)
+		checkPassFail(strcmp(temp->getPolicyName(), "ARC"), 0)
+
+		// a loop over 20 index pages misses every time in 16 frames, and each miss is on a
+		// page let go of lately; heap pages read once gain nothing from more frames
+		Page* page;
+		for (int round = 0; round < 3; round++)
+		{
+			for (int i = 0; i < numIndexPages; i++)
+			{
+				index->readPage(&indexBlob, indexPages[i], page);
+				index->unPinPage(&indexBlob, indexPages[i], false);
+			}
+		}
+		for (int i = 0; i < numHeapPages; i++)
+		{
+			heap->readPage(&heapBlob, heapPages[i], page);
+			heap->unPinPage(&heapBlob, heapPages[i], false);
+		}
+		checkPassFail((index->getBufStats().ghosthits > 0 && heap->getBufStats().ghosthits == 0), true)
+		checkPassFail(pools.rebalance(), 4)
+		checkPassFail((index->numFrames() == 20 && heap->numFrames() == 12 && temp->numFrames() == 8), true)
+
+		// the loop fits now, and nothing more is to be gained by moving frames
+		for (int i = 0; i < numIndexPages; i++)
+		{
+			index->readPage(&indexBlob, indexPages[i], page);
+			index->unPinPage(&indexBlob, indexPages[i], false);
+		}
+		index->clearBufStats();
+		for (int i = 0; i < numIndexPages; i++)
+		{
+			index->readPage(&indexBlob, indexPages[i], page);
+			index->unPinPage(&indexBlob, indexPages[i], false);
+		}
+		checkPassFail(index->getBufStats().hits, numIndexPages)
+		checkPassFail(pools.rebalance(), 0)
+		pools.rebalance();
+		checkPassFail((index->numFrames() + heap->numFrames() + temp->numFrames()), 40)
+
+		index->flushFile(&indexBlob);
+		heap->flushFile(&heapBlob);
+	}
+	File::remove(indexBlobName);
+	File::remove(heapBlobName);
+
+	// an index built through the pools keeps its pages apart from the relation's
+	try
+	{
+		File::remove(relationName + ".0");
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	createRelationForward();
+	{
+		BufferPools pools;
+		BufMgr* heap = pools.addPool("heap", 32);
+		BufMgr* index = pools.addPool("index", 32, REPLACE_LRU2);
+		std::string indexName;
+		pools.route(relationName + ".0", "index");
+		BTreeIndex btree(relationName, indexName, &pools, offsetof(tuple,i), INTEGER);
+		checkPassFail((indexName == relationName + ".0"), true)
+		checkPassFail((heap->getBufStats().accesses > 0 && index->getBufStats().accesses > 0), true)
+		heap->clearBufStats();
+		checkPassFail(intScan(&btree,25,GT,40,LT), 14)
+		checkPassFail(heap->getBufStats().accesses, 0)
+	}
+
+	// a pool set without pools has no pool for the index
+	{
+		BufferPools pools;
+		std::string indexName;
+		bool thrown = false;
+		try
+		{
+			BTreeIndex btree(relationName, indexName, &pools, offsetof(tuple,i), INTEGER);
+		}
+		catch(BadIndexInfoException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+	}
+	deleteRelation();
+	File::remove(relationName + ".0");
+}
+
 // -----------------------------------------------------------------------------
 // errorTests
 // -----------------------------------------------------------------------------
@@ -0,0 +1,303 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "node_search.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BADGERDB_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace badgerdb {
+
+static_assert(sizeof(RecordId) == 8, "rid kernels expect 8 byte record ids");
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Scalar kernels, also used for the tails the vector kernels leave over
+// -----------------------------------------------------------------------------
+
+template<class K, bool orEqual>
+int countLessScalar(const K* keys, const int n, const K key)
+{
+  int pos = 0;
+  while (pos < n && (orEqual ? keys[pos] <= key : keys[pos] < key)) {
+    pos++;
+  }
+  return pos;
+}
+
+int countOccupiedScalar(const PageId* pageNos, const int n)
+{
+  int pos = 0;
+  while (pos < n && pageNos[pos] != 0) {
+    pos++;
+  }
+  return pos;
+}
+
+int countOccupiedScalar(const RecordId* rids, const int n)
+{
+  int pos = 0;
+  while (pos < n && rids[pos].page_number != 0) {
+    pos++;
+  }
+  return pos;
+}
+
+#ifdef BADGERDB_X86_KERNELS
+
+// -----------------------------------------------------------------------------
+// SSE2 kernels
+// Keys are sorted, so the lanes before the insertion point form a prefix of the
+// compare mask and the first vector with a clear lane holds the answer.
+// -----------------------------------------------------------------------------
+
+template<bool orEqual>
+__attribute__((target("sse2"))) int countLessIntSse2(const int* keys, const int n, const int key)
+{
+  const __m128i k = _mm_set1_epi32(key);
+  int pos = 0;
+  for (; pos + 4 <= n; pos += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + pos));
+    int mask = orEqual
+        ? ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, k))) & 0xF
+        : _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k)));
+    if (mask != 0xF) {
+      return pos + __builtin_popcount(mask);
+    }
+  }
+  return pos + countLessScalar<int, orEqual>(keys + pos, n - pos, key);
+}
+
+template<bool orEqual>
+__attribute__((target("sse2"))) int countLessDoubleSse2(const double* keys, const int n, const double key)
+{
+  const __m128d k = _mm_set1_pd(key);
+  int pos = 0;
+  for (; pos + 2 <= n; pos += 2) {
+    __m128d v = _mm_loadu_pd(keys + pos);
+    int mask = _mm_movemask_pd(orEqual ? _mm_cmple_pd(v, k) : _mm_cmplt_pd(v, k));
+    if (mask != 0x3) {
+      return pos + __builtin_popcount(mask);
+    }
+  }
+  return pos + countLessScalar<double, orEqual>(keys + pos, n - pos, key);
+}
+
+__attribute__((target("sse2"))) int countOccupiedPagesSse2(const PageId* pageNos, const int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int pos = 0;
+  for (; pos + 4 <= n; pos += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pageNos + pos));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero)));
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return pos + countOccupiedScalar(pageNos + pos, n - pos);
+}
+
+__attribute__((target("sse2"))) int countOccupiedRidsSse2(const RecordId* rids, const int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int pos = 0;
+  for (; pos + 2 <= n; pos += 2) {
+    // page numbers sit in the even 32 bit lanes, slot number and padding in the odd ones
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rids + pos));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, zero))) & 0x5;
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask) / 2;
+    }
+  }
+  return pos + countOccupiedScalar(rids + pos, n - pos);
+}
+
+// -----------------------------------------------------------------------------
+// AVX2 kernels
+// -----------------------------------------------------------------------------
+
+template<bool orEqual>
+__attribute__((target("avx2"))) int countLessIntAvx2(const int* keys, const int n, const int key)
+{
+  const __m256i k = _mm256_set1_epi32(key);
+  int pos = 0;
+  for (; pos + 8 <= n; pos += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + pos));
+    int mask = orEqual
+        ? ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, k))) & 0xFF
+        : _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+    if (mask != 0xFF) {
+      return pos + __builtin_popcount(mask);
+    }
+  }
+  return pos + countLessScalar<int, orEqual>(keys + pos, n - pos, key);
+}
+
+template<bool orEqual>
+__attribute__((target("avx2"))) int countLessDoubleAvx2(const double* keys, const int n, const double key)
+{
+  const __m256d k = _mm256_set1_pd(key);
+  int pos = 0;
+  for (; pos + 4 <= n; pos += 4) {
+    __m256d v = _mm256_loadu_pd(keys + pos);
+    int mask = _mm256_movemask_pd(_mm256_cmp_pd(v, k, orEqual ? _CMP_LE_OQ : _CMP_LT_OQ));
+    if (mask != 0xF) {
+      return pos + __builtin_popcount(mask);
+    }
+  }
+  return pos + countLessScalar<double, orEqual>(keys + pos, n - pos, key);
+}
+
+__attribute__((target("avx2"))) int countOccupiedPagesAvx2(const PageId* pageNos, const int n)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  int pos = 0;
+  for (; pos + 8 <= n; pos += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pageNos + pos));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, zero)));
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return pos + countOccupiedScalar(pageNos + pos, n - pos);
+}
+
+__attribute__((target("avx2"))) int countOccupiedRidsAvx2(const RecordId* rids, const int n)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  int pos = 0;
+  for (; pos + 4 <= n; pos += 4) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rids + pos));
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, zero))) & 0x55;
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask) / 2;
+    }
+  }
+  return pos + countOccupiedScalar(rids + pos, n - pos);
+}
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Runtime dispatch
+// -----------------------------------------------------------------------------
+
+SearchKernels selectKernels()
+{
+  return searchKernelTables().back();
+}
+
+const SearchKernels& kernels()
+{
+  static const SearchKernels selected = selectKernels();
+  return selected;
+}
+
+/**
+ * Keys left to the vector kernels once the binary search has narrowed the range.
+ */
+const int LINEARWINDOW = 32;
+
+/**
+ * Binary search a sorted key array down to a window of at most LINEARWINDOW keys that
+ * holds the answer. Returns the start of the window, n is set to its length.
+ */
+template<class K, bool orEqual>
+int narrowWindow(const K* keys, int& n, const K key)
+{
+  int lo = 0;
+  int hi = n;
+  while (hi - lo > LINEARWINDOW) {
+    int mid = lo + (hi - lo) / 2;
+    if (orEqual ? keys[mid] <= key : keys[mid] < key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  n = hi - lo;
+  return lo;
+}
+
+}
+
+int lowerBound(const int* keys, const int n, const int key)
+{
+  int window = n;
+  int base = narrowWindow<int, false>(keys, window, key);
+  return base + kernels().lowerBoundInt(keys + base, window, key);
+}
+
+int lowerBound(const double* keys, const int n, const double key)
+{
+  int window = n;
+  int base = narrowWindow<double, false>(keys, window, key);
+  return base + kernels().lowerBoundDouble(keys + base, window, key);
+}
+
+int upperBound(const int* keys, const int n, const int key)
+{
+  int window = n;
+  int base = narrowWindow<int, true>(keys, window, key);
+  return base + kernels().upperBoundInt(keys + base, window, key);
+}
+
+int upperBound(const double* keys, const int n, const double key)
+{
+  int window = n;
+  int base = narrowWindow<double, true>(keys, window, key);
+  return base + kernels().upperBoundDouble(keys + base, window, key);
+}
+
+int countOccupied(const PageId* pageNos, const int n)
+{
+  return kernels().countOccupiedPages(pageNos, n);
+}
+
+int countOccupied(const RecordId* rids, const int n)
+{
+  return kernels().countOccupiedRids(rids, n);
+}
+
+const char* searchKernelName()
+{
+  return kernels().name;
+}
+
+std::vector<SearchKernels> searchKernelTables()
+{
+  std::vector<SearchKernels> tables;
+  SearchKernels scalar = {"scalar",
+      countLessScalar<int, false>, countLessScalar<int, true>,
+      countLessScalar<double, false>, countLessScalar<double, true>,
+      countOccupiedScalar, countOccupiedScalar};
+  tables.push_back(scalar);
+#ifdef BADGERDB_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    SearchKernels sse2 = {"sse2",
+        countLessIntSse2<false>, countLessIntSse2<true>,
+        countLessDoubleSse2<false>, countLessDoubleSse2<true>,
+        countOccupiedPagesSse2, countOccupiedRidsSse2};
+    tables.push_back(sse2);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    SearchKernels avx2 = {"avx2",
+        countLessIntAvx2<false>, countLessIntAvx2<true>,
+        countLessDoubleAvx2<false>, countLessDoubleAvx2<true>,
+        countOccupiedPagesAvx2, countOccupiedRidsAvx2};
+    tables.push_back(avx2);
+  }
+#endif
+  return tables;
+}
+
+}
@@ -0,0 +1,101 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Search kernels for the key and pointer arrays of B+Tree nodes.
+ *
+ * Each function has a scalar, an SSE2 and an AVX2 implementation. The widest one
+ * supported by the CPU is picked the first time any kernel is called.
+ * Key searches binary search large arrays down to a short window first and only scan
+ * that window with the vector kernel.
+ */
+
+/**
+ * Position of the first key in a sorted array that is not less than the given key.
+ *
+ * @param keys  Sorted key array.
+ * @param n     Number of valid keys in the array.
+ * @param key   Key to search for.
+ * @return  Number of keys less than key (n if there is none).
+ */
+int lowerBound(const int* keys, const int n, const int key);
+
+/**
+ * @see lowerBound(const int*, const int, const int)
+ */
+int lowerBound(const double* keys, const int n, const double key);
+
+/**
+ * Position of the first key in a sorted array that is greater than the given key.
+ *
+ * @param keys  Sorted key array.
+ * @param n     Number of valid keys in the array.
+ * @param key   Key to search for.
+ * @return  Number of keys less than or equal to key (n if there is none).
+ */
+int upperBound(const int* keys, const int n, const int key);
+
+/**
+ * @see upperBound(const int*, const int, const int)
+ */
+int upperBound(const double* keys, const int n, const double key);
+
+/**
+ * Number of leading slots in use in a page number array, i.e. the position of the first
+ * Page::INVALID_NUMBER.
+ *
+ * @param pageNos Page number array.
+ * @param n       Size of the array.
+ * @return  Position of the first empty slot (n if the array is full).
+ */
+int countOccupied(const PageId* pageNos, const int n);
+
+/**
+ * Number of leading slots in use in a record id array, i.e. the position of the first
+ * record id whose page number is Page::INVALID_NUMBER.
+ *
+ * @param rids    Record id array.
+ * @param n       Size of the array.
+ * @return  Position of the first empty slot (n if the array is full).
+ */
+int countOccupied(const RecordId* rids, const int n);
+
+/**
+ * Name of the instruction set the kernels run on ("avx2", "sse2" or "scalar").
+ */
+const char* searchKernelName();
+
+/**
+ * @brief Kernels of one instruction set. The key searches count the keys less than
+ * (lowerBound*) or less than or equal to (upperBound*) the key over the whole array,
+ * without the binary search the functions above narrow it with first.
+ */
+struct SearchKernels {
+  const char* name;
+  int (*lowerBoundInt)(const int*, const int, const int);
+  int (*upperBoundInt)(const int*, const int, const int);
+  int (*lowerBoundDouble)(const double*, const int, const double);
+  int (*upperBoundDouble)(const double*, const int, const double);
+  int (*countOccupiedPages)(const PageId*, const int);
+  int (*countOccupiedRids)(const RecordId*, const int);
+};
+
+/**
+ * Kernels of every instruction set the CPU supports, scalar first and the one the
+ * functions above use last. Lets tests check each vector kernel against the scalar one.
+ */
+std::vector<SearchKernels> searchKernelTables();
+
+}
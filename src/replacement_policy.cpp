@@ -0,0 +1,530 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "replacement_policy.h"
+#include "page.h"
+
+namespace badgerdb {
+
+//----------------------------------------
+// ReplacementPolicy
+//----------------------------------------
+
+ReplacementPolicy::ReplacementPolicy(const std::uint32_t frames)
+  : numFrames(frames), resident(frames, false), emptyFrames(frames)
+{
+  PageKey none = {NULL, Page::INVALID_NUMBER};
+  pages.assign(frames, none);
+  for (FrameId i = 0; i < frames; i++)
+  {
+    emptyFrames.pushBack(i);
+  }
+}
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyKind kind, const std::uint32_t frames)
+{
+  switch (kind)
+  {
+    case REPLACE_LRU2:
+      return new Lru2Policy(frames);
+    case REPLACE_2Q:
+      return new TwoQueuePolicy(frames);
+    case REPLACE_ARC:
+      return new ArcPolicy(frames);
+    default:
+      return new ClockPolicy(frames);
+  }
+}
+
+void ReplacementPolicy::loaded(const FrameId frame, File* file, const PageId pageNo, const bool once)
+{
+  // a frame a ring takes back is removed and loaded again without going through evict
+  if (emptyFrames.contains(frame))
+  {
+    emptyFrames.erase(frame);
+  }
+  resident[frame] = true;
+  pages[frame].file = file;
+  pages[frame].pageNo = pageNo;
+  onLoad(frame, once);
+}
+
+void ReplacementPolicy::accessed(const FrameId frame)
+{
+  if (resident[frame])
+  {
+    onAccess(frame);
+  }
+}
+
+void ReplacementPolicy::removed(const FrameId frame)
+{
+  if (resident[frame])
+  {
+    onRemove(frame);
+    resident[frame] = false;
+  }
+  if (!emptyFrames.contains(frame))
+  {
+    emptyFrames.pushBack(frame);
+  }
+}
+
+bool ReplacementPolicy::evict(const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  if (emptyFrames.size() > 0)
+  {
+    frame = *emptyFrames.begin();
+    emptyFrames.erase(frame);
+    return true;
+  }
+
+  if (!chooseVictim(evictable, frame))
+  {
+    return false;
+  }
+  resident[frame] = false;
+  return true;
+}
+
+void ReplacementPolicy::resize(const std::uint32_t frames)
+{
+  for (FrameId i = frames; i < numFrames; i++)
+  {
+    if (emptyFrames.contains(i)) emptyFrames.erase(i);
+  }
+  PageKey none = {NULL, Page::INVALID_NUMBER};
+  resident.resize(frames, false);
+  pages.resize(frames, none);
+  emptyFrames.resize(frames);
+  for (FrameId i = numFrames; i < frames; i++)
+  {
+    emptyFrames.pushBack(i);
+  }
+  numFrames = frames;
+  onResize();
+}
+
+void ReplacementPolicy::FrameList::pushFront(const FrameId frame)
+{
+  positions[frame] = frames.insert(frames.begin(), frame);
+  members[frame] = true;
+}
+
+void ReplacementPolicy::FrameList::pushBack(const FrameId frame)
+{
+  positions[frame] = frames.insert(frames.end(), frame);
+  members[frame] = true;
+}
+
+void ReplacementPolicy::FrameList::erase(const FrameId frame)
+{
+  frames.erase(positions[frame]);
+  members[frame] = false;
+}
+
+void ReplacementPolicy::FrameList::resize(const std::uint32_t frames)
+{
+  positions.resize(frames);
+  members.resize(frames, false);
+}
+
+void ReplacementPolicy::GhostList::pushBack(const PageKey& page)
+{
+  positions[page] = pages.insert(pages.end(), page);
+}
+
+void ReplacementPolicy::GhostList::erase(const PageKey& page)
+{
+  std::map<PageKey, std::list<PageKey>::iterator>::iterator it = positions.find(page);
+  pages.erase(it->second);
+  positions.erase(it);
+}
+
+ReplacementPolicy::PageKey ReplacementPolicy::GhostList::popFront()
+{
+  PageKey page = pages.front();
+  positions.erase(page);
+  pages.pop_front();
+  return page;
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t frames)
+  : ReplacementPolicy(frames), clockHand(frames - 1), refbits(frames, false)
+{
+}
+
+void ClockPolicy::onLoad(const FrameId frame, const bool once)
+{
+  refbits[frame] = !once;
+}
+
+void ClockPolicy::onAccess(const FrameId frame)
+{
+  refbits[frame] = true;
+}
+
+void ClockPolicy::onRemove(const FrameId frame)
+{
+  refbits[frame] = false;
+}
+
+bool ClockPolicy::chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  // twice around: the first time may only clear reference bits
+  for (std::uint32_t scanned = 0; scanned < 2 * numFrames; scanned++)
+  {
+    clockHand = (clockHand + 1) % numFrames;
+    if (!isResident(clockHand))
+    {
+      continue;
+    }
+
+    if (refbits[clockHand])
+    {
+      refbits[clockHand] = false;
+    }
+    else if (evictable(clockHand))
+    {
+      frame = clockHand;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ClockPolicy::onResize()
+{
+  refbits.resize(numFrames, false);
+  if (clockHand >= numFrames)
+  {
+    clockHand = numFrames - 1;
+  }
+}
+
+void ClockPolicy::upcoming(std::vector<FrameId>& frames) const
+{
+  // the hand takes the frames it finds unreferenced, then on its second time around the rest
+  frames.clear();
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (std::uint32_t i = 1; i <= numFrames; i++)
+    {
+      const FrameId frame = (clockHand + i) % numFrames;
+      if (isResident(frame) && refbits[frame] == (pass == 1))
+      {
+        frames.push_back(frame);
+      }
+    }
+  }
+}
+
+//----------------------------------------
+// Lru2Policy
+//----------------------------------------
+
+Lru2Policy::Lru2Policy(const std::uint32_t frames)
+  : ReplacementPolicy(frames), now(0), histories(frames)
+{
+}
+
+void Lru2Policy::setHistory(const FrameId frame, const History& history)
+{
+  histories[frame] = history;
+  byAge.insert(std::make_pair(history, frame));
+}
+
+void Lru2Policy::onLoad(const FrameId frame, const bool once)
+{
+  now++;
+  // a retained history is let go of on any load, so a page is never retained twice
+  History history(0, now);
+  std::map<PageKey, History>::iterator it = retained.find(pageOf(frame));
+  if (it != retained.end())
+  {
+    history.first = it->second.second;
+    retained.erase(it);
+    retainedOrder.erase(pageOf(frame));
+  }
+  setHistory(frame, once ? History(0, 0) : history);
+}
+
+void Lru2Policy::onAccess(const FrameId frame)
+{
+  now++;
+  byAge.erase(std::make_pair(histories[frame], frame));
+  setHistory(frame, History(histories[frame].second, now));
+}
+
+void Lru2Policy::onRemove(const FrameId frame)
+{
+  byAge.erase(std::make_pair(histories[frame], frame));
+}
+
+bool Lru2Policy::chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  for (std::set<std::pair<History, FrameId> >::iterator it = byAge.begin(); it != byAge.end(); ++it)
+  {
+    if (!evictable(it->second))
+    {
+      continue;
+    }
+
+    frame = it->second;
+    byAge.erase(it);
+    if (histories[frame].second != 0)
+    {
+      retained[pageOf(frame)] = histories[frame];
+      retainedOrder.pushBack(pageOf(frame));
+      while (retainedOrder.size() > numFrames)
+      {
+        retained.erase(retainedOrder.popFront());
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+void Lru2Policy::onResize()
+{
+  histories.resize(numFrames);
+}
+
+void Lru2Policy::upcoming(std::vector<FrameId>& frames) const
+{
+  frames.clear();
+  for (std::set<std::pair<History, FrameId> >::const_iterator it = byAge.begin(); it != byAge.end(); ++it)
+  {
+    frames.push_back(it->second);
+  }
+}
+
+//----------------------------------------
+// TwoQueuePolicy
+//----------------------------------------
+
+TwoQueuePolicy::TwoQueuePolicy(const std::uint32_t frames)
+  : ReplacementPolicy(frames),
+    inSize(std::max<std::uint32_t>(1, frames / 4)), outSize(std::max<std::uint32_t>(1, frames / 2)),
+    a1in(frames), am(frames)
+{
+}
+
+void TwoQueuePolicy::onLoad(const FrameId frame, const bool once)
+{
+  // the page leaves A1out on any load, so it is never in A1out twice
+  const bool inA1out = a1out.contains(pageOf(frame));
+  if (inA1out)
+  {
+    a1out.erase(pageOf(frame));
+  }
+
+  if (once)
+  {
+    a1in.pushFront(frame);
+  }
+  else if (inA1out)
+  {
+    am.pushBack(frame);
+  }
+  else
+  {
+    a1in.pushBack(frame);
+  }
+}
+
+void TwoQueuePolicy::onAccess(const FrameId frame)
+{
+  // uses while in A1in are taken to belong to the use that brought the page in
+  if (am.contains(frame))
+  {
+    am.erase(frame);
+    am.pushBack(frame);
+  }
+}
+
+void TwoQueuePolicy::onRemove(const FrameId frame)
+{
+  if (am.contains(frame)) am.erase(frame);
+  else a1in.erase(frame);
+}
+
+bool TwoQueuePolicy::takeFirst(FrameList& list, const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  for (std::list<FrameId>::const_iterator it = list.begin(); it != list.end(); ++it)
+  {
+    if (evictable(*it))
+    {
+      frame = *it;
+      list.erase(frame);
+      return true;
+    }
+  }
+  return false;
+}
+
+void TwoQueuePolicy::rememberOut(const FrameId frame)
+{
+  a1out.pushBack(pageOf(frame));
+  while (a1out.size() > outSize)
+  {
+    a1out.popFront();
+  }
+}
+
+bool TwoQueuePolicy::chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  if (a1in.size() > inSize || am.size() == 0)
+  {
+    if (takeFirst(a1in, evictable, frame))
+    {
+      rememberOut(frame);
+      return true;
+    }
+    return takeFirst(am, evictable, frame);
+  }
+
+  if (takeFirst(am, evictable, frame))
+  {
+    return true;
+  }
+  if (takeFirst(a1in, evictable, frame))
+  {
+    rememberOut(frame);
+    return true;
+  }
+  return false;
+}
+
+void TwoQueuePolicy::onResize()
+{
+  inSize = std::max<std::uint32_t>(1, numFrames / 4);
+  outSize = std::max<std::uint32_t>(1, numFrames / 2);
+  a1in.resize(numFrames);
+  am.resize(numFrames);
+}
+
+void TwoQueuePolicy::upcoming(std::vector<FrameId>& frames) const
+{
+  const bool inFirst = a1in.size() > inSize || am.size() == 0;
+  const FrameList& first = inFirst ? a1in : am;
+  const FrameList& second = inFirst ? am : a1in;
+  frames.assign(first.begin(), first.end());
+  frames.insert(frames.end(), second.begin(), second.end());
+}
+
+//----------------------------------------
+// ArcPolicy
+//----------------------------------------
+
+ArcPolicy::ArcPolicy(const std::uint32_t frames)
+  : ReplacementPolicy(frames), target(0), t1(frames), t2(frames)
+{
+}
+
+void ArcPolicy::onLoad(const FrameId frame, const bool once)
+{
+  const PageKey& page = pageOf(frame);
+  if (once)
+  {
+    // a page read once tells nothing about the split, but still leaves the ghost
+    // lists, so it is never in them twice
+    if (b1.contains(page)) b1.erase(page);
+    else if (b2.contains(page)) b2.erase(page);
+    t1.pushFront(frame);
+  }
+  else if (b1.contains(page))
+  {
+    // T1 let go of the page too early
+    target = std::min<std::size_t>(numFrames, target + std::max<std::size_t>(b2.size() / b1.size(), 1));
+    b1.erase(page);
+    t2.pushBack(frame);
+  }
+  else if (b2.contains(page))
+  {
+    // T2 let go of the page too early
+    target -= std::min(target, std::max<std::size_t>(b1.size() / b2.size(), 1));
+    b2.erase(page);
+    t2.pushBack(frame);
+  }
+  else
+  {
+    t1.pushBack(frame);
+  }
+
+  // T1 and B1 together remember at most a pool of pages, all four lists two pools
+  while (t1.size() + b1.size() > numFrames && b1.size() > 0)
+  {
+    b1.popFront();
+  }
+  while (t1.size() + t2.size() + b1.size() + b2.size() > 2 * numFrames && b2.size() > 0)
+  {
+    b2.popFront();
+  }
+}
+
+void ArcPolicy::onAccess(const FrameId frame)
+{
+  if (t1.contains(frame)) t1.erase(frame);
+  else t2.erase(frame);
+  t2.pushBack(frame);
+}
+
+void ArcPolicy::onRemove(const FrameId frame)
+{
+  if (t1.contains(frame)) t1.erase(frame);
+  else t2.erase(frame);
+}
+
+bool ArcPolicy::takeFirst(FrameList& list, GhostList& ghosts,
+                          const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  for (std::list<FrameId>::const_iterator it = list.begin(); it != list.end(); ++it)
+  {
+    if (evictable(*it))
+    {
+      frame = *it;
+      list.erase(frame);
+      ghosts.pushBack(pageOf(frame));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ArcPolicy::chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame)
+{
+  if (t1.size() > 0 && (t1.size() > target || t2.size() == 0))
+  {
+    return takeFirst(t1, b1, evictable, frame) || takeFirst(t2, b2, evictable, frame);
+  }
+  return takeFirst(t2, b2, evictable, frame) || takeFirst(t1, b1, evictable, frame);
+}
+
+void ArcPolicy::onResize()
+{
+  target = std::min<std::size_t>(target, numFrames);
+  t1.resize(numFrames);
+  t2.resize(numFrames);
+}
+
+void ArcPolicy::upcoming(std::vector<FrameId>& frames) const
+{
+  const bool t1First = t1.size() > 0 && (t1.size() > target || t2.size() == 0);
+  const FrameList& first = t1First ? t1 : t2;
+  const FrameList& second = t1First ? t2 : t1;
+  frames.assign(first.begin(), first.end());
+  frames.insert(frames.end(), second.begin(), second.end());
+}
+
+}
@@ -0,0 +1,385 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+* @brief Replacement policies a buffer manager can be built with
+*/
+enum ReplacementPolicyKind
+{
+	REPLACE_CLOCK,
+	REPLACE_LRU2,
+	REPLACE_2Q,
+	REPLACE_ARC
+};
+
+/**
+ * @brief Decides which frame of the buffer pool is given to the next page read in.
+ *
+ * The buffer manager tells the policy about every page placed in a frame, every
+ * hit on a frame and every frame emptied, and asks it for a frame when it needs
+ * one. Frames holding no page are handed out first. Called with the pool mutex
+ * held, so the policies are not thread safe on their own.
+ */
+class ReplacementPolicy {
+ public:
+  /**
+   * @param frames  Number of frames of the buffer pool, all empty to begin with.
+   */
+  explicit ReplacementPolicy(const std::uint32_t frames);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * Returns the name of the policy, for printing.
+   */
+  virtual const char* name() const = 0;
+
+  /**
+   * A page was placed in an empty frame.
+   *
+   * @param frame   Frame the page is in
+   * @param file    File of the page
+   * @param pageNo  Number of the page in the file
+   * @param once    True if the page is expected to be used once, by a scan or a bulk
+   *                load; such pages are the first to go
+   */
+  void loaded(const FrameId frame, File* file, const PageId pageNo, const bool once);
+
+  /**
+   * The page in a frame was used again.
+   *
+   * @param frame   Frame of the page
+   */
+  void accessed(const FrameId frame);
+
+  /**
+   * The page in a frame was dropped from the pool other than by evict, e.g. flushed
+   * or deleted. The frame is empty again. Does nothing for an empty frame.
+   *
+   * @param frame   Frame of the page
+   */
+  void removed(const FrameId frame);
+
+  /**
+   * Picks the frame the next page goes to: an empty frame if there is one, otherwise
+   * the frame whose page the policy lets go of. The frame counts as empty from here on.
+   *
+   * @param evictable  Tells whether the page of a frame may be let go of now
+   * @param frame      The frame picked, returned
+   * @return  False if every frame holds a page that may not be let go of
+   */
+  bool evict(const std::function<bool(FrameId)>& evictable, FrameId& frame);
+
+  /**
+   * Lists the frames holding a page in the order the policy would let go of them, as
+   * far as it can tell without changing its state. Used to clean pages before they
+   * are needed.
+   *
+   * @param frames  Filled with the frames, next to go first
+   */
+  virtual void upcoming(std::vector<FrameId>& frames) const = 0;
+
+  /**
+   * The pool was resized. New frames are empty; frames past the new end were emptied
+   * with removed beforehand.
+   *
+   * @param frames  New number of frames
+   */
+  void resize(const std::uint32_t frames);
+
+  /**
+   * Returns a new policy of the given kind.
+   *
+   * @param kind    Kind of policy
+   * @param frames  Number of frames of the buffer pool
+   * @return  New policy, owned by the caller.
+   */
+  static ReplacementPolicy* create(const ReplacementPolicyKind kind, const std::uint32_t frames);
+
+ protected:
+  /**
+   * Identifies a page, also after it left the pool.
+   */
+  struct PageKey {
+    File* file;
+    PageId pageNo;
+
+    bool operator<(const PageKey& rhs) const
+    {
+      return file != rhs.file ? file < rhs.file : pageNo < rhs.pageNo;
+    }
+  };
+
+  /**
+   * Frames in recency order, least recent at the front, with O(1) removal.
+   */
+  class FrameList {
+   public:
+    explicit FrameList(const std::uint32_t frames) : positions(frames), members(frames, false) {}
+
+    bool contains(const FrameId frame) const { return members[frame]; }
+    std::size_t size() const { return frames.size(); }
+    std::list<FrameId>::const_iterator begin() const { return frames.begin(); }
+    std::list<FrameId>::const_iterator end() const { return frames.end(); }
+
+    void pushFront(const FrameId frame);
+    void pushBack(const FrameId frame);
+    void erase(const FrameId frame);
+
+    /**
+     * Changes the number of frames the list can hold. Frames past the new end must not
+     * be in the list.
+     */
+    void resize(const std::uint32_t frames);
+
+   private:
+    std::list<FrameId> frames;
+    std::vector<std::list<FrameId>::iterator> positions;
+    std::vector<bool> members;
+  };
+
+  /**
+   * Pages that recently left the pool, oldest at the front, with O(log n) lookup.
+   */
+  class GhostList {
+   public:
+    bool contains(const PageKey& page) const { return positions.count(page) > 0; }
+    std::size_t size() const { return pages.size(); }
+
+    void pushBack(const PageKey& page);
+    void erase(const PageKey& page);
+    PageKey popFront();
+
+   private:
+    std::list<PageKey> pages;
+    std::map<PageKey, std::list<PageKey>::iterator> positions;
+  };
+
+  /**
+   * Hooks of the policies. The frame given to onLoad is empty, the frames given to
+   * onAccess and onRemove hold a page.
+   */
+  virtual void onLoad(const FrameId frame, const bool once) = 0;
+  virtual void onAccess(const FrameId frame) = 0;
+  virtual void onRemove(const FrameId frame) = 0;
+
+  /**
+   * Picks a frame holding a page to let go of, and forgets the frame.
+   *
+   * @param evictable  Tells whether the page of a frame may be let go of now
+   * @param frame      The frame picked, returned
+   * @return  False if no frame may be let go of
+   */
+  virtual bool chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame) = 0;
+
+  /**
+   * Adapts the state of a policy to numFrames having changed. Frames past the end hold
+   * no page.
+   */
+  virtual void onResize() = 0;
+
+  /**
+   * Returns true if the frame holds a page.
+   */
+  bool isResident(const FrameId frame) const { return resident[frame]; }
+
+  /**
+   * Returns the page in a frame, or the page it last held.
+   */
+  const PageKey& pageOf(const FrameId frame) const { return pages[frame]; }
+
+  /**
+   * Number of frames of the buffer pool.
+   */
+  std::uint32_t numFrames;
+
+ private:
+  std::vector<bool> resident;
+  std::vector<PageKey> pages;
+
+  /**
+   * Frames holding no page, handed out from the front. A frame evict hands out is in
+   * neither this list nor resident until loaded or removed is called for it.
+   */
+  FrameList emptyFrames;
+};
+
+/**
+ * @brief Second chance replacement: a clock hand sweeps the frames and takes the first
+ * one not used since the hand last passed it.
+ */
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  explicit ClockPolicy(const std::uint32_t frames);
+
+  const char* name() const { return "clock"; }
+  void upcoming(std::vector<FrameId>& frames) const;
+
+ protected:
+  void onLoad(const FrameId frame, const bool once);
+  void onAccess(const FrameId frame);
+  void onRemove(const FrameId frame);
+  bool chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame);
+  void onResize();
+
+ private:
+  /**
+   * Frame the hand was last at.
+   */
+  FrameId clockHand;
+
+  /**
+   * Set when a frame is used, cleared when the hand passes it.
+   */
+  std::vector<bool> refbits;
+};
+
+/**
+ * @brief LRU-2: lets go of the page whose second to last use is the oldest, pages used
+ * once first. The last two uses of pages that left the pool are kept for as many pages as
+ * the pool has frames, so a page read again soon is not taken for a page used once.
+ */
+class Lru2Policy : public ReplacementPolicy {
+ public:
+  explicit Lru2Policy(const std::uint32_t frames);
+
+  const char* name() const { return "LRU-2"; }
+  void upcoming(std::vector<FrameId>& frames) const;
+
+ protected:
+  void onLoad(const FrameId frame, const bool once);
+  void onAccess(const FrameId frame);
+  void onRemove(const FrameId frame);
+  bool chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame);
+  void onResize();
+
+ private:
+  /**
+   * Times of the second to last and of the last use; 0 for none.
+   */
+  typedef std::pair<std::uint64_t, std::uint64_t> History;
+
+  /**
+   * Moves a frame to its place in byAge.
+   */
+  void setHistory(const FrameId frame, const History& history);
+
+  /**
+   * Counts the uses of pages.
+   */
+  std::uint64_t now;
+
+  /**
+   * History of the page in each frame.
+   */
+  std::vector<History> histories;
+
+  /**
+   * Frames holding a page, oldest history first.
+   */
+  std::set<std::pair<History, FrameId> > byAge;
+
+  /**
+   * History of pages that left the pool, and the order they left in.
+   */
+  std::map<PageKey, History> retained;
+  GhostList retainedOrder;
+};
+
+/**
+ * @brief 2Q: pages come into a FIFO queue A1in, a quarter of the pool, and are let go of
+ * from there unless they come back while A1out remembers them. Pages that come back go to
+ * an LRU list Am. Pages used only within their stay in A1in never get to Am.
+ */
+class TwoQueuePolicy : public ReplacementPolicy {
+ public:
+  explicit TwoQueuePolicy(const std::uint32_t frames);
+
+  const char* name() const { return "2Q"; }
+  void upcoming(std::vector<FrameId>& frames) const;
+
+ protected:
+  void onLoad(const FrameId frame, const bool once);
+  void onAccess(const FrameId frame);
+  void onRemove(const FrameId frame);
+  bool chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame);
+  void onResize();
+
+ private:
+  /**
+   * Takes the first evictable frame of a list.
+   */
+  static bool takeFirst(FrameList& list, const std::function<bool(FrameId)>& evictable, FrameId& frame);
+
+  /**
+   * Remembers the page of a frame let go of from A1in in A1out.
+   */
+  void rememberOut(const FrameId frame);
+
+  /**
+   * Frames A1in holds before it gives up pages, and pages A1out remembers.
+   */
+  std::size_t inSize;
+  std::size_t outSize;
+
+  FrameList a1in;
+  FrameList am;
+  GhostList a1out;
+};
+
+/**
+ * @brief Adaptive replacement cache: T1 holds pages used once lately, T2 pages used more
+ * than once. B1 and B2 remember the pages that left them, and a hit in either moves the
+ * target size of T1 towards the list that would have kept the page.
+ */
+class ArcPolicy : public ReplacementPolicy {
+ public:
+  explicit ArcPolicy(const std::uint32_t frames);
+
+  const char* name() const { return "ARC"; }
+  void upcoming(std::vector<FrameId>& frames) const;
+
+ protected:
+  void onLoad(const FrameId frame, const bool once);
+  void onAccess(const FrameId frame);
+  void onRemove(const FrameId frame);
+  bool chooseVictim(const std::function<bool(FrameId)>& evictable, FrameId& frame);
+  void onResize();
+
+ private:
+  /**
+   * Lets go of the first evictable frame of a resident list, and remembers its page.
+   */
+  bool takeFirst(FrameList& list, GhostList& ghosts, const std::function<bool(FrameId)>& evictable,
+                 FrameId& frame);
+
+  /**
+   * Target size of T1.
+   */
+  std::size_t target;
+
+  FrameList t1;
+  FrameList t2;
+  GhostList b1;
+  GhostList b2;
+};
+
+}
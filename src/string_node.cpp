@@ -0,0 +1,484 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "string_node.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+// -----------------------------------------------------------------------------
+// Entries of slotted nodes
+// Leaves and non-leaf nodes share their layout, N is the node and V the value kept
+// with each key (the record id or the page number of the child right of it).
+// -----------------------------------------------------------------------------
+
+const int SLOTSIZE = sizeof(std::uint16_t);
+
+/**
+ * Bytes an entry with a suffix of suffixLen bytes takes in the key heap.
+ */
+template<class V> int entrySize(int suffixLen)
+{
+  return sizeof(std::uint16_t) + sizeof(V) + suffixLen;
+}
+
+template<class N> const char* nodeBytes(const N* node)
+{
+  return reinterpret_cast<const char*>(node);
+}
+
+template<class N> char* nodeBytes(N* node)
+{
+  return reinterpret_cast<char*>(node);
+}
+
+template<class N> const char* prefixOf(const N* node)
+{
+  return nodeBytes(node) + Page::SIZE - node->prefixLen;
+}
+
+template<class N> int freeBytes(const N* node)
+{
+  return node->heapStart - STRINGNODEHEADERSIZE - SLOTSIZE * node->count;
+}
+
+template<class N> int suffixLenAt(const N* node, int i)
+{
+  std::uint16_t len;
+  memcpy(&len, nodeBytes(node) + node->slotArray[i], sizeof(len));
+  return len;
+}
+
+template<class N, class V> const char* suffixAt(const N* node, int i)
+{
+  return nodeBytes(node) + node->slotArray[i] + sizeof(std::uint16_t) + sizeof(V);
+}
+
+template<class N, class V> V valueAt(const N* node, int i)
+{
+  V value;
+  memcpy(&value, nodeBytes(node) + node->slotArray[i] + sizeof(std::uint16_t), sizeof(V));
+  return value;
+}
+
+template<class V> void writeEntry(char* at, const char* suffix, int suffixLen, V value)
+{
+  std::uint16_t len = suffixLen;
+  memcpy(at, &len, sizeof(len));
+  memcpy(at + sizeof(len), &value, sizeof(V));
+  memcpy(at + sizeof(len) + sizeof(V), suffix, suffixLen);
+}
+
+int keyLength(const char* key)
+{
+  return strnlen(key, STRINGSIZE - 1);
+}
+
+int commonPrefix(const char* a, int aLen, const char* b, int bLen)
+{
+  int n = std::min(aLen, bLen);
+  int i = 0;
+  while (i < n && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+int compareBytes(const char* a, int aLen, const char* b, int bLen)
+{
+  int cmp = memcmp(a, b, std::min(aLen, bLen));
+  if (cmp != 0) {
+    return cmp;
+  }
+  return (aLen > bLen) - (aLen < bLen);
+}
+
+/**
+ * Number of keys less than (orEqual false) or not greater than (orEqual true) key.
+ * The prefix is compared once, the binary search only looks at the suffixes.
+ */
+template<class N, class V, bool orEqual> int countBelow(const N* node, const char* key)
+{
+  int keyLen = keyLength(key);
+  int p = node->prefixLen;
+  int cmp = memcmp(prefixOf(node), key, std::min(p, keyLen));
+  if (cmp > 0 || (cmp == 0 && keyLen < p)) {
+    return 0;
+  }
+  if (cmp < 0) {
+    return node->count;
+  }
+
+  const char* rest = key + p;
+  int restLen = keyLen - p;
+  int lo = 0;
+  int hi = node->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int c = compareBytes(suffixAt<N, V>(node, mid), suffixLenAt(node, mid), rest, restLen);
+    if (orEqual ? c <= 0 : c < 0) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+template<class N, class V> int compareAt(const N* node, int i, const char* key)
+{
+  int keyLen = keyLength(key);
+  int p = node->prefixLen;
+  int cmp = memcmp(prefixOf(node), key, std::min(p, keyLen));
+  if (cmp != 0) {
+    return cmp;
+  }
+  if (keyLen < p) {
+    return 1;
+  }
+  return compareBytes(suffixAt<N, V>(node, i), suffixLenAt(node, i), key + p, keyLen - p);
+}
+
+template<class N, class V> void keyBytesAt(const N* node, int i, char* bytes)
+{
+  int p = node->prefixLen;
+  int suffixLen = suffixLenAt(node, i);
+  memcpy(bytes, prefixOf(node), p);
+  memcpy(bytes + p, suffixAt<N, V>(node, i), suffixLen);
+  bytes[p + suffixLen] = '\0';
+}
+
+template<class N, class V> void decode(const N* node, std::vector<std::string>& keys, std::vector<V>& values)
+{
+  std::string prefix(prefixOf(node), node->prefixLen);
+  for (int i = 0; i < node->count; i++) {
+    keys.push_back(prefix + std::string(suffixAt<N, V>(node, i), suffixLenAt(node, i)));
+    values.push_back(valueAt<N, V>(node, i));
+  }
+}
+
+/**
+ * Lay out n sorted keys and their values, with the prefix all of them share kept once.
+ */
+template<class N, class V> void encode(N* node, const char* const* keys, const int* lens, const V* values, int n)
+{
+  // the keys are sorted, so the first and the last share no more than all of them do
+  int p = (n == 0) ? 0 : commonPrefix(keys[0], lens[0], keys[n - 1], lens[n - 1]);
+  char* bytes = nodeBytes(node);
+  int heap = Page::SIZE - p;
+  if (p > 0) {
+    memcpy(bytes + heap, keys[0], p);
+  }
+  for (int i = 0; i < n; i++) {
+    heap -= entrySize<V>(lens[i] - p);
+    writeEntry<V>(bytes + heap, keys[i] + p, lens[i] - p, values[i]);
+    node->slotArray[i] = heap;
+  }
+  node->count = n;
+  node->prefixLen = p;
+  node->heapStart = heap;
+}
+
+template<class N, class V> void encodeRange(N* node, const std::vector<std::string>& keys, const std::vector<V>& values, int from, int to)
+{
+  std::vector<const char*> ptrs;
+  std::vector<int> lens;
+  for (int i = from; i < to; i++) {
+    ptrs.push_back(keys[i].data());
+    lens.push_back((int) keys[i].size());
+  }
+  if (to > from) {
+    encode<N, V>(node, &ptrs[0], &lens[0], &values[from], to - from);
+  }
+  else {
+    encode<N, V>(node, NULL, NULL, NULL, 0);
+  }
+}
+
+template<class N, class V> bool fits(const N* node, const char* key)
+{
+  int keyLen = keyLength(key);
+  int p = node->prefixLen;
+  int q = commonPrefix(prefixOf(node), p, key, keyLen);
+  // a shorter prefix lengthens every suffix but is kept once less
+  int need = SLOTSIZE + entrySize<V>(keyLen - q) + (p - q) * (node->count - 1);
+  return need <= freeBytes(node);
+}
+
+template<class N, class V> void insertAt(N* node, int pos, const char* key, V value)
+{
+  int keyLen = keyLength(key);
+  int p = node->prefixLen;
+  if (commonPrefix(prefixOf(node), p, key, keyLen) == p) {
+    node->heapStart -= entrySize<V>(keyLen - p);
+    writeEntry<V>(nodeBytes(node) + node->heapStart, key + p, keyLen - p, value);
+    memmove(&(node->slotArray[pos + 1]), &(node->slotArray[pos]), (node->count - pos) * SLOTSIZE);
+    node->slotArray[pos] = node->heapStart;
+    node->count++;
+    return;
+  }
+
+  // the key does not share the whole prefix, lay the node out again with a shorter one
+  std::vector<std::string> keys;
+  std::vector<V> values;
+  decode<N, V>(node, keys, values);
+  keys.insert(keys.begin() + pos, std::string(key, keyLen));
+  values.insert(values.begin() + pos, value);
+  encodeRange<N, V>(node, keys, values, 0, (int) keys.size());
+}
+
+/**
+ * Index of the first key past the first half of the bytes the keys take.
+ */
+int halfway(const std::vector<int>& sizes)
+{
+  int total = 0;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    total += sizes[i];
+  }
+  int acc = 0;
+  int i = 0;
+  while (i < (int) sizes.size() && acc + sizes[i] <= total / 2) {
+    acc += sizes[i];
+    i++;
+  }
+  return i;
+}
+
+}
+
+// -----------------------------------------------------------------------------
+// LeafLayout<LeafNodeString>
+// -----------------------------------------------------------------------------
+
+void LeafLayout<LeafNodeString>::init(LeafNodeString* leaf)
+{
+  leaf->count = 0;
+  leaf->prefixLen = 0;
+  leaf->heapStart = Page::SIZE;
+  leaf->unused = 0;
+}
+
+int LeafLayout<LeafNodeString>::lowerBound(const LeafNodeString* leaf, const char* key)
+{
+  return countBelow<LeafNodeString, RecordId, false>(leaf, key);
+}
+
+int LeafLayout<LeafNodeString>::upperBound(const LeafNodeString* leaf, const char* key)
+{
+  return countBelow<LeafNodeString, RecordId, true>(leaf, key);
+}
+
+int LeafLayout<LeafNodeString>::compareAt(const LeafNodeString* leaf, int i, const char* key)
+{
+  return badgerdb::compareAt<LeafNodeString, RecordId>(leaf, i, key);
+}
+
+void LeafLayout<LeafNodeString>::keyBytesAt(const LeafNodeString* leaf, int i, char* bytes)
+{
+  badgerdb::keyBytesAt<LeafNodeString, RecordId>(leaf, i, bytes);
+}
+
+RecordId LeafLayout<LeafNodeString>::ridAt(const LeafNodeString* leaf, int i)
+{
+  return valueAt<LeafNodeString, RecordId>(leaf, i);
+}
+
+void LeafLayout<LeafNodeString>::copyRids(const LeafNodeString* leaf, int from, int n, RecordId* out)
+{
+  for (int i = 0; i < n; i++) {
+    out[i] = valueAt<LeafNodeString, RecordId>(leaf, from + i);
+  }
+}
+
+bool LeafLayout<LeafNodeString>::fits(const LeafNodeString* leaf, const char* key)
+{
+  return badgerdb::fits<LeafNodeString, RecordId>(leaf, key);
+}
+
+void LeafLayout<LeafNodeString>::insertAt(LeafNodeString* leaf, int pos, const char* key, RecordId rid)
+{
+  badgerdb::insertAt<LeafNodeString, RecordId>(leaf, pos, key, rid);
+}
+
+int LeafLayout<LeafNodeString>::splitPoint(const LeafNodeString* leaf, int pos, const char* key, bool& toLeft)
+{
+  // bytes every entry takes with the prefix the new key leaves, the new one at pos
+  int keyLen = keyLength(key);
+  int p = leaf->prefixLen;
+  int q = commonPrefix(prefixOf(leaf), p, key, keyLen);
+  std::vector<int> sizes;
+  for (int i = 0; i < leaf->count; i++) {
+    if (i == pos) {
+      sizes.push_back(SLOTSIZE + entrySize<RecordId>(keyLen - q));
+    }
+    sizes.push_back(SLOTSIZE + entrySize<RecordId>(p - q + suffixLenAt(leaf, i)));
+  }
+  if (pos == leaf->count) {
+    sizes.push_back(SLOTSIZE + entrySize<RecordId>(keyLen - q));
+  }
+
+  // both halves keep at least one entry
+  int leftCount = std::max(1, std::min(halfway(sizes), (int) leaf->count));
+  toLeft = pos < leftCount;
+  return toLeft ? leftCount - 1 : leftCount;
+}
+
+void LeafLayout<LeafNodeString>::moveTail(LeafNodeString* leaf, int from, LeafNodeString* to)
+{
+  std::vector<std::string> keys;
+  std::vector<RecordId> rids;
+  decode<LeafNodeString, RecordId>(leaf, keys, rids);
+  init(to);
+  encodeRange<LeafNodeString, RecordId>(to, keys, rids, from, (int) keys.size());
+  encodeRange<LeafNodeString, RecordId>(leaf, keys, rids, 0, from);
+}
+
+void LeafLayout<LeafNodeString>::separator(const char* left, const char* right, char* bytes)
+{
+  int leftLen = keyLength(left);
+  int rightLen = keyLength(right);
+  int common = commonPrefix(left, leftLen, right, rightLen);
+  // one byte past the common prefix tells right from left, unless right is no greater
+  int len = (common < rightLen) ? common + 1 : rightLen;
+  memcpy(bytes, right, len);
+  bytes[len] = '\0';
+}
+
+int LeafLayout<LeafNodeString>::fill(LeafNodeString* leaf, const RIDKeyPair<char*>* entries, int n, double fillFactor)
+{
+  const int budget = STRINGNODEHEADERSIZE + (int) ((Page::SIZE - STRINGNODEHEADERSIZE) * fillFactor);
+  std::vector<const char*> keys;
+  std::vector<int> lens;
+  std::vector<RecordId> rids;
+  int firstLen = keyLength(entries[0].key);
+  int prefix = firstLen;
+  int suffixBytes = 0;
+  for (int k = 0; k < n; k++) {
+    int len = keyLength(entries[k].key);
+    int p = std::min(prefix, commonPrefix(entries[0].key, firstLen, entries[k].key, len));
+    int used = STRINGNODEHEADERSIZE + p + (k + 1) * (SLOTSIZE + entrySize<RecordId>(0)) + suffixBytes + (prefix - p) * k + len - p;
+    if (k > 0 && used > budget) {
+      break;
+    }
+    suffixBytes += (prefix - p) * k + len - p;
+    prefix = p;
+    keys.push_back(entries[k].key);
+    lens.push_back(len);
+    rids.push_back(entries[k].rid);
+  }
+  init(leaf);
+  encode<LeafNodeString, RecordId>(leaf, &keys[0], &lens[0], &rids[0], (int) keys.size());
+  return (int) keys.size();
+}
+
+// -----------------------------------------------------------------------------
+// NonLeafLayout<NonLeafNodeString>
+// -----------------------------------------------------------------------------
+
+int NonLeafLayout<NonLeafNodeString>::lowerBound(const NonLeafNodeString* node, const char* key)
+{
+  return countBelow<NonLeafNodeString, PageId, false>(node, key);
+}
+
+int NonLeafLayout<NonLeafNodeString>::upperBound(const NonLeafNodeString* node, const char* key)
+{
+  return countBelow<NonLeafNodeString, PageId, true>(node, key);
+}
+
+int NonLeafLayout<NonLeafNodeString>::compareAt(const NonLeafNodeString* node, int i, const char* key)
+{
+  return badgerdb::compareAt<NonLeafNodeString, PageId>(node, i, key);
+}
+
+void NonLeafLayout<NonLeafNodeString>::keyBytesAt(const NonLeafNodeString* node, int i, char* bytes)
+{
+  badgerdb::keyBytesAt<NonLeafNodeString, PageId>(node, i, bytes);
+}
+
+PageId NonLeafLayout<NonLeafNodeString>::childAt(const NonLeafNodeString* node, int i)
+{
+  return (i == 0) ? node->firstChild : valueAt<NonLeafNodeString, PageId>(node, i - 1);
+}
+
+bool NonLeafLayout<NonLeafNodeString>::fits(const NonLeafNodeString* node, const char* key)
+{
+  return badgerdb::fits<NonLeafNodeString, PageId>(node, key);
+}
+
+bool NonLeafLayout<NonLeafNodeString>::safe(const NonLeafNodeString* node)
+{
+  // the longest key, sharing nothing with the prefix
+  int need = SLOTSIZE + entrySize<PageId>(STRINGSIZE - 1) + node->prefixLen * (node->count - 1);
+  return need <= freeBytes(node);
+}
+
+void NonLeafLayout<NonLeafNodeString>::insertAt(NonLeafNodeString* node, int pos, const char* key, PageId child)
+{
+  badgerdb::insertAt<NonLeafNodeString, PageId>(node, pos, key, child);
+}
+
+void NonLeafLayout<NonLeafNodeString>::build(NonLeafNodeString* node, int level, char* const* keys, const PageId* children, int n)
+{
+  std::vector<int> lens;
+  for (int i = 0; i < n; i++) {
+    lens.push_back(keyLength(keys[i]));
+  }
+  node->level = level;
+  node->firstChild = children[0];
+  node->unused = 0;
+  encode<NonLeafNodeString, PageId>(node, keys, n ? &lens[0] : NULL, children + 1, n);
+}
+
+int NonLeafLayout<NonLeafNodeString>::splitPoint(char* const* keys, int n)
+{
+  if (n < 3) {
+    return n / 2;
+  }
+  int p = commonPrefix(keys[0], keyLength(keys[0]), keys[n - 1], keyLength(keys[n - 1]));
+  std::vector<int> sizes;
+  for (int i = 0; i < n; i++) {
+    sizes.push_back(SLOTSIZE + entrySize<PageId>(keyLength(keys[i]) - p));
+  }
+  // both halves keep at least one key
+  return std::max(1, std::min(halfway(sizes), n - 2));
+}
+
+int NonLeafLayout<NonLeafNodeString>::fill(NonLeafNodeString* node, int level, const PageKeyPair<char*>* children, int n, double fillFactor)
+{
+  const int budget = STRINGNODEHEADERSIZE + (int) ((Page::SIZE - STRINGNODEHEADERSIZE) * fillFactor);
+  std::vector<char*> keys;
+  std::vector<PageId> pageNos(1, children[0].pageNo);
+  if (n > 1) {
+    const char* first = children[1].key;
+    int firstLen = keyLength(first);
+    int prefix = firstLen;
+    int suffixBytes = 0;
+    for (int k = 1; k < n; k++) {
+      int len = keyLength(children[k].key);
+      int p = std::min(prefix, commonPrefix(first, firstLen, children[k].key, len));
+      int before = k - 1;
+      int used = STRINGNODEHEADERSIZE + p + k * (SLOTSIZE + entrySize<PageId>(0)) + suffixBytes + (prefix - p) * before + len - p;
+      if (k > 1 && used > budget) {
+        break;
+      }
+      suffixBytes += (prefix - p) * before + len - p;
+      prefix = p;
+      keys.push_back(children[k].key);
+      pageNos.push_back(children[k].pageNo);
+    }
+  }
+  build(node, level, keys.empty() ? NULL : &keys[0], &pageNos[0], (int) keys.size());
+  return (int) pageNos.size();
+}
+
+}
@@ -0,0 +1,162 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include "btree.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Entries of a slotted STRING leaf, see LeafNodeString.
+ *
+ * Keys are NUL-terminated strings of at most STRINGSIZE - 1 bytes. An entry that shares the
+ * prefix of the node is put in place; one that does not makes the node be laid out again
+ * with the shorter prefix.
+ */
+template<> struct LeafLayout<LeafNodeString> {
+  /**
+   * Make an empty leaf. The sibling links are left to the caller.
+   */
+  static void init(LeafNodeString* leaf);
+
+  /**
+   * Number of keys less than key.
+   */
+  static int lowerBound(const LeafNodeString* leaf, const char* key);
+
+  /**
+   * Number of keys less than or equal to key.
+   */
+  static int upperBound(const LeafNodeString* leaf, const char* key);
+
+  /**
+   * Compare key i with key, like strcmp(key i, key).
+   */
+  static int compareAt(const LeafNodeString* leaf, int i, const char* key);
+
+  /**
+   * Copy key i, NUL-terminated, into a buffer of STRINGSIZE bytes.
+   */
+  static void keyBytesAt(const LeafNodeString* leaf, int i, char* bytes);
+
+  /**
+   * Record id of entry i.
+   */
+  static RecordId ridAt(const LeafNodeString* leaf, int i);
+
+  /**
+   * Copy the record ids of n entries from entry from on.
+   */
+  static void copyRids(const LeafNodeString* leaf, int from, int n, RecordId* out);
+
+  /**
+   * Is there room for an entry with key?
+   */
+  static bool fits(const LeafNodeString* leaf, const char* key);
+
+  /**
+   * Put an entry at pos. There must be room for it.
+   */
+  static void insertAt(LeafNodeString* leaf, int pos, const char* key, RecordId rid);
+
+  /**
+   * Where to split a full leaf that an entry with key is to be put in at pos, so that both
+   * halves take about as many bytes.
+   *
+   * @param toLeft      set if the new entry goes into the left half
+   * @return  number of entries kept in the left half
+   */
+  static int splitPoint(const LeafNodeString* leaf, int pos, const char* key, bool& toLeft);
+
+  /**
+   * Move the entries from entry from on into the empty leaf to.
+   */
+  static void moveTail(LeafNodeString* leaf, int from, LeafNodeString* to);
+
+  /**
+   * Shortest prefix of right that is greater than left, or right itself if there is none.
+   *
+   * @param left        last key of a leaf
+   * @param right       first key of the leaf right of it
+   * @param bytes       buffer of STRINGSIZE bytes the separator is copied into
+   */
+  static void separator(const char* left, const char* right, char* bytes);
+
+  /**
+   * Make a leaf of the leading entries, as many as fit in fillFactor of the page and at
+   * least one.
+   *
+   * @return  number of entries put in the leaf
+   */
+  static int fill(LeafNodeString* leaf, const RIDKeyPair<char*>* entries, int n, double fillFactor);
+};
+
+/**
+ * @brief Keys and children of a slotted STRING non-leaf node, see NonLeafNodeString.
+ */
+template<> struct NonLeafLayout<NonLeafNodeString> {
+  /**
+   * Number of keys less than key.
+   */
+  static int lowerBound(const NonLeafNodeString* node, const char* key);
+
+  /**
+   * Number of keys less than or equal to key.
+   */
+  static int upperBound(const NonLeafNodeString* node, const char* key);
+
+  /**
+   * Compare key i with key, like strcmp(key i, key).
+   */
+  static int compareAt(const NonLeafNodeString* node, int i, const char* key);
+
+  /**
+   * Copy key i, NUL-terminated, into a buffer of STRINGSIZE bytes.
+   */
+  static void keyBytesAt(const NonLeafNodeString* node, int i, char* bytes);
+
+  /**
+   * Page number of child i.
+   */
+  static PageId childAt(const NonLeafNodeString* node, int i);
+
+  /**
+   * Is there room for key?
+   */
+  static bool fits(const NonLeafNodeString* node, const char* key);
+
+  /**
+   * Is there room for any key, even one that shares no prefix with the node?
+   */
+  static bool safe(const NonLeafNodeString* node);
+
+  /**
+   * Put key at pos and child right of it. There must be room for them.
+   */
+  static void insertAt(NonLeafNodeString* node, int pos, const char* key, PageId child);
+
+  /**
+   * Lay out a node with n keys and the n+1 children around them.
+   */
+  static void build(NonLeafNodeString* node, int level, char* const* keys, const PageId* children, int n);
+
+  /**
+   * Which of n keys of a node being split moves up, so that both halves take about as many bytes.
+   */
+  static int splitPoint(char* const* keys, int n);
+
+  /**
+   * Make a node of the leading children, as many as fit in fillFactor of the page and at
+   * least two. The keys are the separators of all children but the first.
+   *
+   * @return  number of children put in the node
+   */
+  static int fill(NonLeafNodeString* node, int level, const PageKeyPair<char*>* children, int n, double fillFactor);
+};
+
+}